@@ -28,6 +28,9 @@
 #include <condition_variable>
 #include <chrono>
 
+#include <unistd.h>
+#include <sys/eventfd.h>
+
 /*
  * Some references in order
  *
@@ -52,6 +55,22 @@ class ConsumerProducerQueue
     std::string queueName ;
     unsigned int maxSize;
     std::chrono::seconds timeout;
+    int eventFd = -1;
+    bool ownsEventFd = false;
+
+    /**
+     * Signals the eventfd, if any. Must be called with the lock held,
+     * right after an element was added to an empty queue.
+     */
+    void signal()
+    {
+        if(eventFd >= 0)
+        {
+            uint64_t val = 1;
+            ssize_t ret = write(eventFd, &val, sizeof(val));
+            (void) ret;
+        }
+    }
 
 public:
 
@@ -65,6 +84,73 @@ public:
         timeout = std::chrono::seconds(1);
     }
 
+    ~ConsumerProducerQueue()
+    {
+        if(ownsEventFd)
+            close(eventFd);
+    }
+
+    /**
+     * Creates an eventfd owned by the queue, signaled each time an element is added to an empty queue
+     *
+     * @return the eventfd file descriptor, -1 on error
+     */
+    int enable_eventfd()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if(eventFd < 0)
+        {
+            eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            ownsEventFd = (eventFd >= 0);
+            if(!isEmpty())
+                signal();
+        }
+
+        return eventFd;
+    }
+
+    /**
+     * Uses an external eventfd, signaled each time an element is added to an empty queue.
+     * The queue does not close it.
+     *
+     * @param fd eventfd file descriptor, -1 to stop signaling
+     */
+    void set_eventfd(int fd)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if(ownsEventFd)
+            close(eventFd);
+
+        eventFd = fd;
+        ownsEventFd = false;
+        if(!isEmpty())
+            signal();
+    }
+
+    /**
+     * Gets the eventfd signaled by the queue
+     *
+     * @return the eventfd file descriptor, -1 if none
+     */
+    int get_eventfd() const
+    {
+        return eventFd;
+    }
+
+    /**
+     * Resets the eventfd counter. The consumer must call this before draining
+     * the queue (until isEmpty() returns true), never after.
+     */
+    void clear_eventfd()
+    {
+        if(eventFd >= 0)
+        {
+            uint64_t val;
+            ssize_t ret = read(eventFd, &val, sizeof(val));
+            (void) ret;
+        }
+    }
+
     /**
      * Gets the queue name
      *
@@ -103,6 +189,8 @@ public:
         }
         cpq.push(request);
         L = cpq.size();
+        if(L == 1)
+            signal();
         lock.unlock();
         cond.notify_all();
         return(L);
@@ -134,6 +222,93 @@ public:
         return(L);
     }
 
+    /**
+     * Adds a range of elements to the queue, taking the lock once for the whole batch
+     *
+     * @param first iterator to the first element to add
+     * @param last iterator past the last element to add
+     *
+     * @return -1 if no element could be added before timing-out (after 1s),
+     *         the number of elements added otherwise
+     */
+    template<typename It>
+    int add_range(It first, It last)
+    {
+        int added = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        while(first != last)
+        {
+            auto res = cond.wait_for(lock, timeout, [this]() {
+                return !isFull();
+            });
+            if(res == false)
+            {
+                break; // Timed-out
+            }
+
+            bool was_empty = isEmpty();
+            while(first != last && !isFull())
+            {
+                cpq.push(*first);
+                ++first;
+                added++;
+            }
+
+            if(was_empty && !isEmpty())
+                signal();
+
+            // Let the consumer make room if the range does not fit
+            cond.notify_all();
+        }
+        lock.unlock();
+
+        return (added == 0 && first != last) ? -1 : added;
+    }
+
+    /**
+     * Gets at most n elements from the queue, taking the lock once for the whole batch
+     *
+     * @param out container to which the elements are appended (using push_back)
+     * @param n maximum number of elements to get
+     *
+     * @return -1 if the attempt timed-out (after 1s), the number of elements appended to out otherwise
+     */
+    template<typename Container>
+    int consume_n(Container &out, size_t n)
+    {
+        int L = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        auto ret = cond.wait_for(lock, timeout, [this]() {
+            return !isEmpty();
+        });
+        if(ret == false)
+        {
+            return -1; // Timed-out
+        }
+        while(!isEmpty() && static_cast<size_t>(L) < n)
+        {
+            out.push_back(cpq.front());
+            cpq.pop();
+            L++;
+        }
+        lock.unlock();
+        cond.notify_all();
+        return(L);
+    }
+
+    /**
+     * Gets all the elements from the queue, taking the lock once for the whole batch
+     *
+     * @param out container to which the elements are appended (using push_back)
+     *
+     * @return -1 if the attempt timed-out (after 1s), the number of elements appended to out otherwise
+     */
+    template<typename Container>
+    int consume_all(Container &out)
+    {
+        return consume_n(out, maxSize);
+    }
+
     /**
      * Wait for the queue to contain at least one element
      *
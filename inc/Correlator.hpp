@@ -25,13 +25,22 @@
 #include <cstdint>
 #include <array>
 #include <numeric>
+#include <algorithm>
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 using namespace std;
 
 /**
  * Class to construct correlator objects, allowing to compute the cross-correlation
  * between a stream of signed 16-bit samples and a known syncword.
- * The correlator has its internal storage for past samples.
+ * The correlator has its internal storage for past samples. The storage is
+ * mirrored: every sample is written twice, BUFFER_SIZE samples apart, so that
+ * any window of the circular buffer is contiguous in memory.
  */
 template < size_t SYNCW_SIZE, size_t SAMPLES_PER_SYM >
 class Correlator
@@ -41,9 +50,95 @@ private:
     static constexpr size_t SYNCWORD_SAMPLES = (SYNCW_SIZE-1) * SAMPLES_PER_SYM + 1;
     static constexpr size_t BUFFER_SIZE = SYNCWORD_SAMPLES + ADDITIONAL_STORAGE;
 
-    array<int16_t, BUFFER_SIZE> samples;    ///< Samples' storage (circular buffer)
-    size_t  sampIdx;                        ///< Index of the next sample to write
-    size_t  prevIdx;                        ///< Index of the last written sample
+public:
+    /**
+     * Length of the syncwords given to full_convolve_raw(): SYNCWORD_SAMPLES
+     * rounded up to a multiple of the SIMD width, so that the dot products have
+     * no scalar tail.
+     */
+    static constexpr size_t PADDED_SYNCWORD_SAMPLES = (SYNCWORD_SAMPLES + 15) / 16 * 16;
+
+private:
+    static constexpr size_t STORAGE_SIZE = std::max(2*BUFFER_SIZE, BUFFER_SIZE - 1 + PADDED_SYNCWORD_SAMPLES);
+
+    alignas(32) array<int16_t, STORAGE_SIZE> samples;   ///< Samples' storage (mirrored circular buffer)
+    size_t  sampIdx;                                    ///< Index of the next sample to write
+    size_t  prevIdx;                                    ///< Index of the last written sample
+
+    /**
+     * Dot products of n samples with N syncwords, accumulated on 64 bits. The
+     * SIMD versions (NEON on aarch64, AVX2 on x86_64 when built with
+     * M17NETD_AVX2) read the samples once for all the syncwords.
+     *
+     * The SIMD versions compute the products on 32 bits and widen them before
+     * accumulation, they give the same result as the scalar version as long as
+     * the syncwords do not contain -32768.
+     */
+    template < size_t N >
+    static std::array< int64_t, N > dot(const int16_t *x, const std::array< const int16_t *, N > &y, const size_t n)
+    {
+        std::array< int64_t, N > acc;
+        acc.fill(0);
+
+#if defined(__aarch64__)
+        const size_t n_vec = n - n % 8;
+        int64x2_t acc_v[N];
+        for(size_t k = 0; k < N; k++)
+            acc_v[k] = vdupq_n_s64(0);
+
+        for(size_t i = 0; i < n_vec; i += 8)
+        {
+            int16x8_t a = vld1q_s16(x + i);
+#pragma GCC unroll 8
+            for(size_t k = 0; k < N; k++)
+            {
+                int16x8_t b = vld1q_s16(y[k] + i);
+                acc_v[k] = vpadalq_s32(acc_v[k], vmull_s16(vget_low_s16(a), vget_low_s16(b)));
+                acc_v[k] = vpadalq_s32(acc_v[k], vmull_high_s16(a, b));
+            }
+        }
+
+        for(size_t k = 0; k < N; k++)
+            acc[k] = vaddvq_s64(acc_v[k]);
+#elif defined(__AVX2__)
+        const size_t n_vec = n - n % 16;
+        __m256i acc_v[N];
+        for(size_t k = 0; k < N; k++)
+            acc_v[k] = _mm256_setzero_si256();
+
+        for(size_t i = 0; i < n_vec; i += 16)
+        {
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(x + i));
+#pragma GCC unroll 8
+            for(size_t k = 0; k < N; k++)
+            {
+                __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(y[k] + i));
+                __m256i p = _mm256_madd_epi16(a, b);
+                // Sign-extend the even and odd 32-bit sums in place, without lane crossing shuffles
+                __m256i even = _mm256_blend_epi32(p, _mm256_srai_epi32(_mm256_slli_epi64(p, 32), 31), 0xAA);
+                __m256i odd  = _mm256_blend_epi32(_mm256_srli_epi64(p, 32), _mm256_srai_epi32(p, 31), 0xAA);
+                acc_v[k] = _mm256_add_epi64(acc_v[k], _mm256_add_epi64(even, odd));
+            }
+        }
+
+        for(size_t k = 0; k < N; k++)
+        {
+            __m128i acc_h = _mm_add_epi64(_mm256_castsi256_si128(acc_v[k]), _mm256_extracti128_si256(acc_v[k], 1));
+            acc[k] = _mm_cvtsi128_si64(acc_h) + _mm_extract_epi64(acc_h, 1);
+        }
+#else
+        const size_t n_vec = 0;
+#endif
+
+        // Scalar tail, or everything without SIMD
+        for(size_t k = 0; k < N; k++)
+        {
+            for(size_t i = n_vec; i < n; i++)
+                acc[k] += static_cast<int32_t>(x[i]) * static_cast<int32_t>(y[k][i]);
+        }
+
+        return acc;
+    }
 
 public:
 
@@ -65,6 +160,17 @@ public:
     void sample(const int16_t sample)
     {
         samples[sampIdx] = sample;
+        samples[sampIdx + BUFFER_SIZE] = sample;
+        prevIdx = sampIdx;
+        sampIdx = (sampIdx + 1) % BUFFER_SIZE;
+    }
+
+    /**
+     * Advance the correlator memory by one sample without storing it. Useful
+     * when the skipped sample will be overwritten before being read.
+     */
+    void skip()
+    {
         prevIdx = sampIdx;
         sampIdx = (sampIdx + 1) % BUFFER_SIZE;
     }
@@ -101,18 +207,27 @@ public:
      */
     int32_t full_convolve(const std::array<int16_t, SYNCWORD_SAMPLES> &syncword) const
     {
-        int64_t acc = 0;
+        // Thanks to the mirroring, the window starting at pos never wraps
         size_t pos = (prevIdx + ADDITIONAL_STORAGE + 1) % BUFFER_SIZE;
+        return (dot< 1 >(samples.data() + pos, {syncword.data()}, SYNCWORD_SAMPLES)[0] >> 13);
+    }
 
-        // Compute the dot product in two parts.
-        // Part 1 from pos to the end of samples array
-        size_t l1 = min ( (BUFFER_SIZE-pos), syncword.size() );
-        acc = inner_product(samples.begin() + pos, samples.begin() + pos + l1, syncword.begin(), acc);
-
-        // Part 2 from beginning of samples array until length of syncword
-        acc = inner_product(syncword.begin() + l1, syncword.end(), samples.begin(), acc);
-
-        return (acc>>13);
+    /**
+     * Compute the complete convolution products between the samples stored in
+     * the correlator memory and several syncwords, in a single pass over the
+     * memory. The products are returned before the scaling applied by
+     * full_convolve(), so that the correlation with a negated syncword can be
+     * obtained exactly as (-product) >> 13.
+     *
+     * @param syncwords: pointers to each syncword, zero-padded to PADDED_SYNCWORD_SAMPLES samples.
+     * @return the unscaled convolution product for each syncword.
+     */
+    template < size_t N >
+    std::array< int64_t, N > full_convolve_raw(const std::array< const int16_t *, N > &syncwords) const
+    {
+        // The samples read past the window are multiplied by the zero padding
+        size_t pos = (prevIdx + ADDITIONAL_STORAGE + 1) % BUFFER_SIZE;
+        return dot< N >(samples.data() + pos, syncwords, PADDED_SYNCWORD_SAMPLES);
     }
 
     /**
@@ -159,7 +274,22 @@ public:
     }
 
     /**
-     * Access the internal sample memory.
+     * Compute the average of the last samples stored.
+     *
+     * @param n: number of samples to average, at most bufferSize().
+     * @return the average of the last n samples.
+     */
+    int32_t average(const size_t n) const
+    {
+        const int16_t *last = samples.data() + prevIdx + BUFFER_SIZE + 1;
+        int32_t sum = std::accumulate(last - n, last, 0);
+
+        return sum / static_cast< int32_t >(n);
+    }
+
+    /**
+     * Access the internal sample memory. The circular buffer is made of the
+     * first bufferSize() samples, the following ones are its mirror.
      *
      * @return a pointer to the correlator memory.
      */
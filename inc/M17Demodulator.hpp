@@ -35,8 +35,10 @@
 #include <cmath>
 #include <Correlator.hpp>
 #include <Synchronizer.hpp>
+#include <SyncwordBank.hpp>
 #include <M17Utils.hpp>
 #include <liquid/liquid.h>
+#include "frame_pool.h"
 
 /**
  * Set to 1 to enable file outputs of various stages of the demodulation
@@ -54,10 +56,27 @@ using m17frame_t   = std::array< uint16_t, 192*2 >; // Data type for a full M17
 using m17syncw_t   = std::array< uint8_t, 2 >; // Data type for a sync word
 using m17ssyncw_t   = std::array< uint16_t, 16 >; // Data type for a sync word as soft bits
 
+/**
+ * M17 4FSK baseband demodulator.
+ *
+ * @tparam SAMPLES_PER_SYMBOL: number of baseband samples per symbol, the
+ * baseband sampling rate is 4800 * SAMPLES_PER_SYMBOL. Instantiated for 5, 10
+ * and 20 samples per symbol (24, 48 and 96 kHz).
+ */
+template < size_t SAMPLES_PER_SYMBOL = 20 >
 class M17Demodulator
 {
 public:
 
+    /**
+     * Symbol timing recovery statistics over a frame.
+     */
+    struct timing_stats_t
+    {
+        float error;        ///< Mean timing error measured over the frame, in samples
+        float correction;   ///< Sampling point correction applied over the frame, in samples
+    };
+
     /**
      * Constructor.
      */
@@ -68,6 +87,14 @@ public:
      */
     ~M17Demodulator();
 
+    /**
+     * Sets the pool the frame buffers are taken from, before init(). Without
+     * a pool, the buffers are allocated.
+     *
+     * @param pool: pool of frame buffers, must outlive the demodulator.
+     */
+    void setFramePool(frame_pool *pool);
+
     /**
      * Allocate buffers for baseband signal sampling and initialise demodulator.
      */
@@ -86,6 +113,15 @@ public:
      */
     const m17frame_t& getFrame();
 
+    /**
+     * Takes the buffer of the frame decoded from the baseband signal, without
+     * copying it. The demodulator gets a new buffer from its pool for the next
+     * frame. getFrame() must not be called again before the next frame.
+     *
+     * @return the last decoded frame.
+     */
+    frame_pool::frame_ptr takeFrame();
+
     /**
      * Returns the sync_word recognized at the beginning of the frame decoded from the baseband signal
      *
@@ -102,39 +138,224 @@ public:
      *
      * @return 1 if a new frame has been fully decoded, -1 if EOT was detected, 0 otherwise
      */
-    int update(float *samples, const size_t N);
+    int update(const float *samples, const size_t N);
+
+    /**
+     * Demodulates fixed-point baseband samples, as produced by rx_frontend_q15.
+     * The RRC filter then runs on integers and the samples reach the
+     * correlator without any conversion to float.
+     *
+     * @param samples: baseband samples in Q3.12 format (4096 is 1.0)
+     * @param N: Number of samples in the *sample array
+     *
+     * @return 1 if a new frame has been fully decoded, -1 if EOT was detected, 0 otherwise
+     */
+    int update(const int16_t *samples, const size_t N);
 
     /**
      * @return true if a demodulator is locked on an M17 stream.
      */
     bool isLocked() const;
 
+    /**
+     * Returns the symbol timing statistics of the last completed frame.
+     *
+     * @return reference to the timing statistics.
+     */
+    const timing_stats_t& getFrameTiming() const;
+
+    /**
+     * Enable or disable the symbol timing recovery loop. When disabled, the
+     * sampling point is only updated on syncwords. Enabled by default.
+     *
+     * @param enable: true to track the symbol timing between syncwords.
+     */
+    void setTimingRecovery(const bool enable);
+
+    /**
+     * Returns the carrier frequency offset of the ongoing, or last,
+     * transmission. It is measured on the preamble and tracked on the
+     * syncwords, then removed from the baseband.
+     *
+     * @return the frequency offset, in the units of the baseband samples.
+     */
+    float getFrequencyOffset() const;
+
+    /**
+     * Set the frequency offset assumed at the start of a transmission, before
+     * its preamble has been measured. Takes effect immediately when the
+     * demodulator is unlocked, otherwise when it unlocks.
+     *
+     * @param offset: frequency offset, in the units of the baseband samples.
+     */
+    void setFrequencyOffset(const float offset);
+
 private:
 
     /**
-     * Quantize a given sample to its corresponding symbol and append it to the
-     * ongoing frame. When a frame is complete, it swaps the pointers and updates
-     * newFrame variable.
+     * Quantize a given sample to the soft bits of its symbol, through the
+     * quantizer table, and append them to the ongoing frame. When a frame is
+     * complete, it swaps the pointers, updates newFrame variable and the noise
+     * variance estimate.
      *
      * @param sample: baseband sample.
      */
     void updateFrame(const int16_t sample);
 
+    /**
+     * Rebuild the quantizer table from the current symbol deviations and noise
+     * variance. Must be called whenever any of them changes.
+     */
+    void buildQuantizer();
+
+    /**
+     * Process one sample, whatever the state of the demodulator.
+     *
+     * @param sample: baseband sample, after RRC filtering and scaling.
+     */
+    void step(const int16_t sample);
+
+    /**
+     * Run the demodulator over a block of float or Q3.12 baseband samples.
+     */
+    template < typename T >
+    int run(const T *samples, const size_t N);
+
+    /**
+     * Apply the RRC filter on a baseband sample and scale it to 16 bits.
+     *
+     * @param sample: baseband sample.
+     * @return the filtered and scaled sample.
+     */
+    int16_t filter(const float sample);
+
+    /**
+     * Apply the fixed-point RRC filter on a Q3.12 baseband sample, with the
+     * same output scale as filter(const float).
+     *
+     * @param sample: baseband sample.
+     * @return the filtered and scaled sample.
+     */
+    int16_t filter(const int16_t sample);
+
+    /**
+     * Push a baseband sample in the RRC filter memory without computing its
+     * output.
+     *
+     * @param sample: baseband sample.
+     */
+    void push(const float sample);
+    void push(const int16_t sample);
+
+    /**
+     * Process a run of samples in the INIT state. Only the samples that the
+     * correlator memory holds at the end of the initialization are filtered.
+     *
+     * @param samples: baseband samples.
+     * @param n: number of samples available.
+     * @return the number of samples consumed.
+     */
+    template < typename T >
+    size_t initRun(const T *samples, const size_t n);
+
+    /**
+     * Process a run of samples in the LOCKED state, until the end of the
+     * samples or the start of the syncpoint update. Only the samples around
+     * the sampling points and the points halfway between symbols, and the
+     * samples that the correlator memory holds when the syncword search
+     * starts, are filtered.
+     *
+     * @param samples: baseband samples.
+     * @param n: number of samples available.
+     * @return the number of samples consumed.
+     */
+    template < typename T >
+    size_t lockedRun(const T *samples, const size_t n);
+
+    /**
+     * Interpolate the filtered baseband between the last four filtered
+     * samples with a cubic Lagrange interpolator in Farrow form.
+     *
+     * @param mu: fractional position between the second and third sample, in
+     * the [0, 1) range.
+     * @return the interpolated sample.
+     */
+    float interpolate(const float mu) const;
+
+    /**
+     * Run the Gardner timing error detector on a symbol just sampled and
+     * move the fractional sampling point through the loop filter.
+     *
+     * @param symbol: interpolated value of the symbol.
+     */
+    void trackTiming(const float symbol);
+
+    /**
+     * Remove part of the residual frequency offset measured on a syncword
+     * from the next samples, and shift the symbol deviations accordingly.
+     *
+     * @param residual: average of the outer symbol deviations.
+     */
+    void trackOffset(const int32_t residual);
+
     /**
      * Reset the demodulator state.
      */
     void reset();
 
     /**
-     * M17 baseband signal sampled at 96kHz
+     * M17 baseband signal sampled at 4800 * SAMPLES_PER_SYMBOL Hz
      */
     static constexpr size_t     M17_SYMBOL_RATE         = 4800;
     static constexpr size_t     M17_FRAME_SYMBOLS       = 192;
-    static constexpr size_t     RX_SAMPLE_RATE          = 96000;
+    static constexpr size_t     RX_SAMPLE_RATE          = M17_SYMBOL_RATE * SAMPLES_PER_SYMBOL;
     static constexpr size_t     M17_SYNCWORD_SYMBOLS    = 8;
-    static constexpr size_t     SAMPLES_PER_SYMBOL      = RX_SAMPLE_RATE / M17_SYMBOL_RATE;
     static constexpr size_t     FRAME_SAMPLES           = M17_FRAME_SYMBOLS * SAMPLES_PER_SYMBOL;
     static constexpr size_t     SYNCWORD_SAMPLES        = SAMPLES_PER_SYMBOL * M17_SYNCWORD_SYMBOLS;
+    static constexpr size_t     RRC_TAPS                = 8 * SAMPLES_PER_SYMBOL + 1;
+
+    /**
+     * Fixed-point RRC filter: the taps are in Q2.14 (they exceed 1 at 5
+     * samples per symbol) and the baseband samples in Q3.12, the products are
+     * thus scaled by 2^RRC_FIXED_SHIFT.
+     */
+    static constexpr int        RRC_TAPS_FRAC_BITS      = 14;
+    static constexpr int        RRC_FIXED_SHIFT         = RRC_TAPS_FRAC_BITS + 12;
+
+    /**
+     * Correlation thresholds and preamble detection time, tuned at 20 samples
+     * per symbol. Correlations are summed over the syncword samples and thus
+     * scale with the number of samples per symbol.
+     */
+    static constexpr int32_t    SYNC_THRESHOLD          = 280000 * SAMPLES_PER_SYMBOL / 20;
+    static constexpr int32_t    PREAMBLE_THRESHOLD      = 90000 * SAMPLES_PER_SYMBOL / 20;
+    static constexpr int        PREAMBLE_SAMPLES        = 2500 * SAMPLES_PER_SYMBOL / 20;
+
+    /**
+     * Symbol timing loop. The proportional gain sets a time constant of about
+     * 50 symbols, the integral one tracks a sample clock mismatch. TED_GAIN is
+     * the slope of the normalized Gardner detector, per symbol of timing error.
+     */
+    static constexpr float      TIMING_KP               = 0.02f;
+    static constexpr float      TIMING_KI               = 0.0001f;
+    static constexpr float      TED_GAIN                = 0.84f;
+
+    /**
+     * Frequency offset tracking: a syncword moves the offset removed from the
+     * baseband by its residual offset divided by 2^AFC_TRACKING_SHIFT.
+     */
+    static constexpr int32_t    AFC_TRACKING_SHIFT      = 2;
+
+    /**
+     * Soft-bit quantizer. The table spans the symbol deviations plus one
+     * symbol spacing on each side, in power of two steps. Soft bits are the
+     * bit LLRs scaled so that QUANT_LLR_MAX saturates them. The noise variance
+     * restarts at (spacing/4)^2 on each transmission, where the LLRs match the
+     * former linear mapping, and follows the symbol errors of each frame.
+     */
+    static constexpr size_t     QUANT_TABLE_SIZE        = 512;
+    static constexpr float      QUANT_LLR_MAX           = 8.0f;
+    static constexpr float      NOISE_VAR_WEIGHT        = 0.25f;
 
     /**
      * M17 sync words
@@ -172,6 +393,16 @@ private:
                                                             0x0,    0xFFFF, 0x0,    0xFFFF, 0xFFFF, 0xFFFF, 0x0,    0xFFFF,
                                                           };
 
+    /**
+     * Quantizer table entry.
+     */
+    struct quant_entry_t
+    {
+        uint16_t msb;       ///< Soft value of the most significant bit
+        uint16_t lsb;       ///< Soft value of the least significant bit
+        uint32_t error;     ///< Squared distance to the closest symbol deviation
+    };
+
     /**
      * Internal state of the demodulator.
      */
@@ -198,25 +429,58 @@ private:
     };
 
     DemodState                     demodState;      ///< Demodulator state
-    std::unique_ptr<m17frame_t >   demodFrame;      ///< Frame being demodulated.
-    std::unique_ptr<m17frame_t >   readyFrame;      ///< Fully demodulated frame to be returned.
+    frame_pool                     *framePool;      ///< Pool of the frame buffers, nullptr to allocate them.
+    frame_pool::frame_ptr          demodFrame;      ///< Frame being demodulated.
+    frame_pool::frame_ptr          readyFrame;      ///< Fully demodulated frame to be returned.
     bool                           locked;          ///< A syncword was correctly demodulated.
     bool                           newFrame;        ///< A new frame has been fully decoded.
     uint16_t                       frameIndex;      ///< Index for filling the raw frame.
     uint32_t                       sampleIndex;     ///< Sample index, from 0 to (SAMPLES_PER_SYMBOL - 1)
     uint8_t                        missedSyncs;     ///< Counter of missed synchronizations
     uint32_t                       initCount;       ///< Downcounter for initialization
+    int32_t                        preambleWait;    ///< Downcounter of the samples without preamble before arming
     uint32_t                       syncCount;       ///< Downcounter for resynchronization
     std::pair < int32_t, int32_t > outerDeviation;  ///< Deviation of outer symbols
     std::pair < int32_t, int32_t > innerDeviation;  ///< Deviation of inner symbols
+    std::array< quant_entry_t, QUANT_TABLE_SIZE > quantTable;   ///< Soft bits and squared error of each sample range
+    int32_t                        quantLow;        ///< Lowest sample of the quantizer table
+    int32_t                        quantShift;      ///< Log2 of the sample range of a quantizer entry
+    float                          noiseVar;        ///< Noise variance of the symbols
+    uint64_t                       noiseSum;        ///< Squared symbol error accumulated over the ongoing frame
     firfilt_rrrf                   rrcos_filt;      ///< Root-raised cosine filter for baseband signal
     SyncWord                       lastSyncWord;
+    std::array< float, 4 >         interpWindow;    ///< Last four filtered samples, oldest first
+    float                          timing;          ///< Fractional sampling point, in samples, within [-0.5, 0.5)
+    float                          timingDrift;     ///< Sampling point drift, in samples per symbol
+    float                          midSample;       ///< Sample halfway between the last two symbols
+    float                          lastSymbol;      ///< Last symbol sampled in LOCKED state
+    bool                           midValid;        ///< midSample follows lastSymbol
+    bool                           symbolValid;     ///< lastSymbol belongs to the ongoing lock
+    bool                           symbolDue;       ///< The nominal sampling point of a symbol was passed in LOCKED state
+    bool                           timingRecovery;  ///< Track the symbol timing between syncwords
+    float                          timingErrSum;    ///< Timing error accumulated over the ongoing frame
+    float                          timingCorrSum;   ///< Timing correction accumulated over the ongoing frame
+    uint32_t                       timingCount;     ///< Timing error measurements over the ongoing frame
+    timing_stats_t                 frameTiming;     ///< Timing statistics of the last completed frame
+    int32_t                        freqOffset;      ///< Frequency offset removed from the filtered samples
+    int32_t                        baseOffset;      ///< Frequency offset assumed at the start of a transmission
+    int32_t                        preambleCount;   ///< Downcounter for the next frequency offset measurement
+    float                          offsetScale;     ///< Filtered value of a unit baseband offset
 
     Correlator   < M17_SYNCWORD_SYMBOLS, SAMPLES_PER_SYMBOL > correlator;
+
+    // The fixed-point RRC filter reuses the correlator memory and dot product:
+    // RRC_TAPS is the length of a 9 symbols syncword.
+    using RrcLine = Correlator < RRC_TAPS / SAMPLES_PER_SYMBOL + 1, SAMPLES_PER_SYMBOL >;
+    RrcLine                                                   rrcLine;    ///< Fixed-point RRC filter memory
+    alignas(32) std::array< int16_t, RrcLine::PADDED_SYNCWORD_SAMPLES > rrcFixedTaps;  ///< Fixed-point RRC filter taps, reversed and zero-padded
     Synchronizer < M17_SYNCWORD_SYMBOLS, SAMPLES_PER_SYMBOL > lsfSync   {{ +3, +3, +3, +3, -3, -3, +3, -3 }};
     Synchronizer < M17_SYNCWORD_SYMBOLS, SAMPLES_PER_SYMBOL > packetSync{{ +3, -3, +3, +3, -3, -3, -3, -3 }};
     Synchronizer < M17_SYNCWORD_SYMBOLS, SAMPLES_PER_SYMBOL > EOTSync   {{ +3, +3, +3, +3, +3, +3, -3, +3 }};
 
+    using Bank = SyncwordBank < M17_SYNCWORD_SYMBOLS, SAMPLES_PER_SYMBOL >;
+    Bank syncBank{lsfSync.filteredSyncword(), packetSync.filteredSyncword(), EOTSync.filteredSyncword()};
+
 #if M17DEMOD_DEBUG_OUT
     uint32_t total_cnt;
     ofstream post_demod;
@@ -236,6 +500,10 @@ private:
 
 };
 
+extern template class M17Demodulator< 5 >;
+extern template class M17Demodulator< 10 >;
+extern template class M17Demodulator< 20 >;
+
 } /* M17 */
 
 #endif /* M17_DEMODULATOR_H */
@@ -30,7 +30,10 @@
 #include <cstdint>
 #include <cmath>
 #include <array>
+#include <algorithm>
+#include <iterator>
 #include <assert.h>
+#include <m17.h>
 
 namespace M17
 {
@@ -159,6 +162,63 @@ inline std::array< int8_t, 4 > byteToSymbols(uint8_t value)
     return symbols;
 }
 
+/**
+ * Root raised cosine filter taps (alpha = 0.5, span of 8 symbols) for a given
+ * number of samples per symbol. The taps are scaled to the same DC gain as
+ * rrc_taps_20 so that the filtered baseband has the same amplitude whatever
+ * the sampling rate. For 20 samples per symbol, rrc_taps_20 is returned as is.
+ *
+ * @tparam SAMPLES_PER_SYM: number of samples per symbol.
+ * @return the 8*SAMPLES_PER_SYM+1 filter taps.
+ */
+template < size_t SAMPLES_PER_SYM >
+std::array< float, 8*SAMPLES_PER_SYM+1 > rrcTaps()
+{
+    std::array< float, 8*SAMPLES_PER_SYM+1 > taps;
+
+    if(SAMPLES_PER_SYM == 20)
+    {
+        std::copy(std::begin(rrc_taps_20), std::end(rrc_taps_20), taps.begin());
+        return taps;
+    }
+
+    constexpr double alpha = 0.5;
+    double sum = 0.0;
+    for(size_t i = 0; i < taps.size(); i++)
+    {
+        // Time in symbols, relative to the center tap
+        double t = (static_cast<double>(i) - 4.0*SAMPLES_PER_SYM) / SAMPLES_PER_SYM;
+        double h;
+
+        if(t == 0.0)
+        {
+            h = 1.0 - alpha + 4.0*alpha/M_PI;
+        }
+        else if(std::fabs(std::fabs(t) - 1.0/(4.0*alpha)) < 1e-9)
+        {
+            h = alpha/std::sqrt(2.0) * ((1.0 + 2.0/M_PI)*std::sin(M_PI/(4.0*alpha))
+                                      + (1.0 - 2.0/M_PI)*std::cos(M_PI/(4.0*alpha)));
+        }
+        else
+        {
+            h = (std::sin(M_PI*t*(1.0-alpha)) + 4.0*alpha*t*std::cos(M_PI*t*(1.0+alpha)))
+              / (M_PI*t*(1.0 - (4.0*alpha*t)*(4.0*alpha*t)));
+        }
+
+        taps[i] = h;
+        sum += h;
+    }
+
+    double ref_sum = 0.0;
+    for(auto tap : rrc_taps_20)
+        ref_sum += tap;
+
+    for(auto &tap : taps)
+        tap = tap * ref_sum / sum;
+
+    return taps;
+}
+
 }      // namespace M17
 
 
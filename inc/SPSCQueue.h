@@ -0,0 +1,519 @@
+/****************************************************************************
+ * M17Netd                                                                  *
+ * Copyright (C) 2024 by Morgan Diepart ON4MOD                              *
+ *                       SDR-Engineering SRL                                *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU Affero General Public License as published *
+ * by the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU Affero General Public License for more details.                      *
+ *                                                                          *
+ * You should have received a copy of the GNU Affero General Public License *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    *
+ ****************************************************************************/
+
+#ifndef __SPSCQUEUE_H__
+#define __SPSCQUEUE_H__
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstddef>
+#include <algorithm>
+
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+/**
+ * Bounded single-producer / single-consumer queue.
+ *
+ * This is a drop-in replacement for ConsumerProducerQueue when exactly one
+ * thread adds elements and exactly one thread consumes them. Elements are
+ * stored in a preallocated ring; adding and consuming only touch two atomic
+ * indices, each one on its own cache line so that the producer and the
+ * consumer do not invalidate each other's cache.
+ *
+ * The mutex and condition variable are only used when one side has to wait
+ * (queue full for the producer, queue empty for the consumer). As long as no
+ * thread is waiting, add() and consume() never lock nor notify.
+ *
+ * Optionally, the queue can signal an eventfd each time it goes from empty to
+ * non-empty so that the consumer can wait for data with select()/poll()/epoll
+ * alongside other file descriptors.
+ *
+ * @note add()/try_add() may only be called from the producer thread and
+ *       consume()/try_consume()/clear() only from the consumer thread.
+ *       isEmpty(), isFull() and length() may be called from any thread.
+ */
+template<typename T>
+class SPSCQueue
+{
+    static constexpr size_t cacheLine = 64;
+
+    // Producer side
+    alignas(cacheLine) std::atomic<size_t> tail;    ///< Index of the next slot to write
+    size_t headCache;                               ///< Producer's copy of head, refreshed when the queue looks full
+
+    // Consumer side
+    alignas(cacheLine) std::atomic<size_t> head;    ///< Index of the next slot to read
+    size_t tailCache;                               ///< Consumer's copy of tail, refreshed when the queue looks empty
+
+    // Waiting threads
+    alignas(cacheLine) std::atomic<int> sleepers;   ///< Number of threads waiting on cond
+    std::mutex mutex;
+    std::condition_variable cond;
+
+    alignas(cacheLine) std::vector<T> ring;         ///< Elements storage
+    size_t maxSize;
+    std::string queueName;
+    std::chrono::milliseconds timeout;
+    int eventFd;                                    ///< eventfd signaled on empty to non-empty transitions, -1 if none
+    bool ownsEventFd;                               ///< true if eventFd has been created by the queue
+
+    /**
+     * Signals the eventfd if the elements published from slot t on were added to an empty queue.
+     * Must be called after tail has been updated.
+     */
+    void signal(const size_t t)
+    {
+        // Either we see that the consumer had emptied the queue, or the
+        // consumer will see our elements before deciding the queue is empty.
+        if(eventFd >= 0 && head.load() == t)
+        {
+            uint64_t val = 1;
+            ssize_t ret = write(eventFd, &val, sizeof(val));
+            (void) ret; // Counter saturation is not an error, the fd stays readable
+        }
+    }
+
+    /**
+     * Waits until ready() returns true, sleeping on the condition variable
+     *
+     * @param wait_max max duration to wait for before timing out
+     * @param ready predicate, must use sequentially consistent loads
+     *
+     * @return false if timed out, true otherwise
+     */
+    template<typename Pred>
+    bool wait(std::chrono::milliseconds wait_max, Pred ready)
+    {
+        if(ready())
+            return true;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        sleepers.fetch_add(1);
+        bool ret = cond.wait_for(lock, wait_max, ready);
+        sleepers.fetch_sub(1);
+
+        return ret;
+    }
+
+    /**
+     * Wakes up the other side of the queue, if it is waiting
+     */
+    void wake()
+    {
+        if(sleepers.load() > 0)
+        {
+            // Taking the lock ensures the waiting thread is either asleep or
+            // has not evaluated its predicate yet.
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+            }
+            cond.notify_all();
+        }
+    }
+
+public:
+
+    SPSCQueue(int mxsz) : SPSCQueue(std::string(), mxsz) { }
+
+    SPSCQueue(std::string qName, int mxsz) : tail(0), headCache(0), head(0), tailCache(0), sleepers(0),
+                                             maxSize(mxsz > 0 ? mxsz : 1), queueName(qName),
+                                             eventFd(-1), ownsEventFd(false)
+    {
+        ring.resize(maxSize);
+        timeout = std::chrono::seconds(1);
+    }
+
+    ~SPSCQueue()
+    {
+        if(ownsEventFd)
+            close(eventFd);
+    }
+
+    SPSCQueue(const SPSCQueue&) = delete;
+    SPSCQueue& operator=(const SPSCQueue&) = delete;
+
+    /**
+     * Creates an eventfd owned by the queue, signaled each time an element is added to an empty queue.
+     * Must be called before the producer thread starts.
+     *
+     * @return the eventfd file descriptor, -1 on error
+     */
+    int enable_eventfd()
+    {
+        if(eventFd < 0)
+        {
+            eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            ownsEventFd = (eventFd >= 0);
+        }
+
+        return eventFd;
+    }
+
+    /**
+     * Uses an external eventfd, signaled each time an element is added to an empty queue.
+     * The queue does not close it. Must be called before the producer thread starts.
+     *
+     * @param fd eventfd file descriptor, -1 to stop signaling
+     */
+    void set_eventfd(int fd)
+    {
+        if(ownsEventFd)
+            close(eventFd);
+
+        eventFd = fd;
+        ownsEventFd = false;
+    }
+
+    /**
+     * Gets the eventfd signaled by the queue
+     *
+     * @return the eventfd file descriptor, -1 if none
+     */
+    int get_eventfd() const
+    {
+        return eventFd;
+    }
+
+    /**
+     * Resets the eventfd counter. The consumer must call this before draining
+     * the queue (until isEmpty() returns true), never after.
+     */
+    void clear_eventfd()
+    {
+        if(eventFd >= 0)
+        {
+            uint64_t val;
+            ssize_t ret = read(eventFd, &val, sizeof(val));
+            (void) ret; // EAGAIN when the counter is already zero
+        }
+    }
+
+    /**
+     * Gets the queue name
+     *
+     * @return the queue name
+     */
+    std::string& name() {
+        return( queueName );
+    }
+
+    /**
+     * Sets the queue name
+     *
+     * @param qName the new name of the queue
+     */
+    void setName( std::string qName ) {
+        queueName.assign( qName );
+    }
+
+    /**
+     * Sets how long add() and consume() wait before timing out
+     *
+     * @param wait_max new timeout
+     */
+    void setTimeout( std::chrono::milliseconds wait_max ) {
+        timeout = wait_max;
+    }
+
+    /**
+     * Adds an element to the queue, waiting for a free slot if the queue is full
+     *
+     * @param request the element to add to the queue
+     *
+     * @return -1 if the attempt timed-out, the new number of elements in the queue otherwise
+     */
+    int add(T request)
+    {
+        const size_t t = tail.load(std::memory_order_relaxed);
+
+        if(t - headCache >= maxSize)
+        {
+            auto ret = wait(timeout, [this, t]() {
+                return (t - head.load()) < maxSize;
+            });
+            if(ret == false)
+            {
+                return -1; // Timed-out
+            }
+        }
+
+        return push(t, std::move(request));
+    }
+
+    /**
+     * Adds an element to the queue if there is room for it, never waits
+     *
+     * @param request the element to add to the queue
+     *
+     * @return -1 if the queue is full, the new number of elements in the queue otherwise
+     */
+    int try_add(T request)
+    {
+        const size_t t = tail.load(std::memory_order_relaxed);
+
+        if(t - headCache >= maxSize)
+        {
+            headCache = head.load(std::memory_order_acquire);
+            if(t - headCache >= maxSize)
+            {
+                return -1; // Full
+            }
+        }
+
+        return push(t, std::move(request));
+    }
+
+    /**
+     * Gets an element from the queue, waiting for one if the queue is empty
+     *
+     * @param request the element in which to store the result
+     *
+     * @return -1 if the attempt timed-out, the new number of elements in the queue otherwise
+     */
+    int consume(T &request)
+    {
+        const size_t h = head.load(std::memory_order_relaxed);
+
+        if(h == tailCache)
+        {
+            auto ret = wait(timeout, [this, h]() {
+                return tail.load() != h;
+            });
+            if(ret == false)
+            {
+                return -1; // Timed-out
+            }
+        }
+
+        return pop(h, request);
+    }
+
+    /**
+     * Gets an element from the queue if there is one, never waits
+     *
+     * @param request the element in which to store the result
+     *
+     * @return -1 if the queue is empty, the new number of elements in the queue otherwise
+     */
+    int try_consume(T &request)
+    {
+        const size_t h = head.load(std::memory_order_relaxed);
+
+        if(h == tailCache)
+        {
+            tailCache = tail.load(std::memory_order_acquire);
+            if(h == tailCache)
+            {
+                return -1; // Empty
+            }
+        }
+
+        return pop(h, request);
+    }
+
+    /**
+     * Adds a range of elements to the queue, publishing them to the consumer at once
+     *
+     * @param first iterator to the first element to add
+     * @param last iterator past the last element to add
+     *
+     * @return -1 if no element could be added before timing-out,
+     *         the number of elements added otherwise
+     */
+    template<typename It>
+    int add_range(It first, It last)
+    {
+        int added = 0;
+
+        while(first != last)
+        {
+            const size_t t = tail.load(std::memory_order_relaxed);
+            auto ret = wait(timeout, [this, t]() {
+                return (t - head.load()) < maxSize;
+            });
+            if(ret == false)
+            {
+                break; // Timed-out
+            }
+
+            headCache = head.load(std::memory_order_acquire);
+            size_t n = 0;
+            while(first != last && (t + n - headCache) < maxSize)
+            {
+                ring[(t + n) % maxSize] = *first;
+                ++first;
+                n++;
+            }
+
+            tail.store(t + n);
+            wake();
+            signal(t);
+            added += n;
+        }
+
+        return (added == 0 && first != last) ? -1 : added;
+    }
+
+    /**
+     * Gets at most n elements from the queue, releasing their slots to the producer at once
+     *
+     * @param out container to which the elements are appended (using push_back)
+     * @param n maximum number of elements to get
+     *
+     * @return -1 if the attempt timed-out, the number of elements appended to out otherwise
+     */
+    template<typename Container>
+    int consume_n(Container &out, size_t n)
+    {
+        const size_t h = head.load(std::memory_order_relaxed);
+
+        if(h == tailCache)
+        {
+            auto ret = wait(timeout, [this, h]() {
+                return tail.load() != h;
+            });
+            if(ret == false)
+            {
+                return -1; // Timed-out
+            }
+        }
+
+        tailCache = tail.load(std::memory_order_acquire);
+        const size_t L = std::min(n, tailCache - h);
+        for(size_t i = 0; i < L; i++)
+        {
+            out.push_back(std::move(ring[(h + i) % maxSize]));
+            ring[(h + i) % maxSize] = T();
+        }
+
+        head.store(h + L);
+        wake();
+
+        return static_cast<int>(L);
+    }
+
+    /**
+     * Gets all the elements from the queue, releasing their slots to the producer at once
+     *
+     * @param out container to which the elements are appended (using push_back)
+     *
+     * @return -1 if the attempt timed-out, the number of elements appended to out otherwise
+     */
+    template<typename Container>
+    int consume_all(Container &out)
+    {
+        return consume_n(out, maxSize);
+    }
+
+    /**
+     * Wait for the queue to contain at least one element
+     *
+     * @param wait_max max duration to wait for before timing out
+     *
+     * @return false if timed out, true if the queue contains at least one element
+     */
+    int wait_for_non_empty(std::chrono::milliseconds wait_max)
+    {
+        return wait(wait_max, [this]() {
+            return tail.load() != head.load();
+        });
+    }
+
+    /**
+     * Check if the queue is full
+     *
+     * @return true if the queue is full, false otherwise
+     */
+    bool isFull() const
+    {
+        return length() >= static_cast<int>(maxSize);
+    }
+
+    /**
+     * Check if the queue is empty
+     *
+     * @return true if the queue is empty, false otherwise
+     */
+    bool isEmpty() const
+    {
+        // Sequentially consistent loads, paired with signal()
+        return tail.load() == head.load();
+    }
+
+    /**
+     * Get the number of elements currently in the queue
+     *
+     * @return the number of elements in the queue
+     */
+    int length() const
+    {
+        const size_t h = head.load(std::memory_order_acquire);
+        const size_t t = tail.load(std::memory_order_acquire);
+        return static_cast<int>(t - h);
+    }
+
+    /**
+     * Empties the queue. Must be called from the consumer thread.
+     */
+    void clear()
+    {
+        T dropped;
+        while(try_consume(dropped) >= 0)
+        {
+            dropped = T();
+        }
+    }
+
+private:
+
+    /**
+     * Stores an element in slot t and publishes it to the consumer
+     */
+    int push(const size_t t, T &&request)
+    {
+        ring[t % maxSize] = std::move(request);
+        tail.store(t + 1);
+        wake();
+        signal(t);
+
+        headCache = head.load(std::memory_order_acquire);
+        return static_cast<int>(t + 1 - headCache);
+    }
+
+    /**
+     * Moves the element of slot h out of the ring and releases the slot to the producer
+     */
+    int pop(const size_t h, T &request)
+    {
+        request = std::move(ring[h % maxSize]);
+        ring[h % maxSize] = T(); // Do not keep a reference to the element in the ring
+        head.store(h + 1);
+        wake();
+
+        tailCache = tail.load(std::memory_order_acquire);
+        return static_cast<int>(tailCache - (h + 1));
+    }
+};
+
+#endif
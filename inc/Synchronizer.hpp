@@ -26,6 +26,7 @@
 #include <cstring>
 #include <array>
 #include "Correlator.hpp"
+#include "M17Utils.hpp"
 #include <liquid/liquid.h>
 #include <m17.h>
 //#include <iostream>
@@ -50,12 +51,11 @@ public:
     Synchronizer(std::array< int8_t, SYNCW_SIZE >&& sync_word) :
         syncword(std::move(sync_word)), triggered(false), last_corr(0)
         {
-            size_t nb_taps = sizeof(rrc_taps_20)/sizeof(rrc_taps_20[0]);
-            float *taps = static_cast<float*>(malloc(nb_taps*sizeof(float)));
-            memcpy(taps, rrc_taps_20, nb_taps*sizeof(float));
+            auto taps = M17::rrcTaps< SAMPLES_PER_SYM >();
+            size_t nb_taps = taps.size();
 
-            firfilt_rrrf rrcos1 = firfilt_rrrf_create(taps, nb_taps);
-            firfilt_rrrf rrcos2 = firfilt_rrrf_create(taps, nb_taps);
+            firfilt_rrrf rrcos1 = firfilt_rrrf_create(taps.data(), nb_taps);
+            firfilt_rrrf rrcos2 = firfilt_rrrf_create(taps.data(), nb_taps);
 
             size_t purge = nb_taps;
             float out = 0.0f; // Output of rrcos filters
@@ -63,9 +63,14 @@ public:
 
             int64_t cumsum = 0;
 
+            // The taps have the same DC gain at every rate, scale the symbols so
+            // that the filtered syncword keeps the amplitude it has at 20 samples
+            // per symbol and fits in 16 bits.
+            const float sym_scale = 5000.0f * SAMPLES_PER_SYM / 20.0f;
+
             for(const auto sym: syncword)
             {
-                firfilt_rrrf_execute_one(rrcos1, static_cast<float>(sym*5000), &out);
+                firfilt_rrrf_execute_one(rrcos1, sym*sym_scale, &out);
                 firfilt_rrrf_execute_one(rrcos2, out, &out);
 
                 // Upsampling
@@ -124,8 +129,6 @@ public:
                 cout << static_cast<int32_t>(x) << ", ";
             }
             cout << "};" << endl;*/
-
-            free(taps);
         }
 
     /**
@@ -145,9 +148,24 @@ public:
      */
     int8_t update(const Correlator< SYNCW_SIZE, SAMPLES_PER_SYM >& correlator,
                   const int32_t posTh, const int32_t negTh)
+    {
+        return update(correlator.full_convolve(filtered_syncw), correlator.index(), posTh, negTh);
+    }
+
+    /**
+     * Perform an update step of the syncronizer with a correlation value that
+     * has already been computed, typically by a SyncwordBank.
+     *
+     * @param corr: correlation between the correlator memory and filteredSyncword().
+     * @param index: correlator index of the last sample.
+     * @param posTh: threshold to detect a positive correlation peak.
+     * @param negTh: threshold to detect a negative correlation peak.
+     * @return +1 if a positive correlation peak has been found, -1 if a negative
+     * correlation peak has been found an zero otherwise.
+     */
+    int8_t update(const int32_t corr, const size_t index, const int32_t posTh, const int32_t negTh)
     {
         int32_t sign    = 0;
-        int32_t corr    = correlator.full_convolve(filtered_syncw);
         bool    trigger = false;
 
         if( (corr > posTh) && (corr >= last_corr) )
@@ -169,7 +187,7 @@ public:
                 triggered = true;
             }
 
-            values[correlator.index()] = corr;
+            values[index] = corr;
         }
         else
         {
@@ -204,6 +222,17 @@ public:
         return sign;
     }
 
+    /**
+     * Get the syncword filtered through the root raised cosine twice, the
+     * template the correlator memory is compared with.
+     *
+     * @return the filtered syncword.
+     */
+    const std::array< int16_t, (SAMPLES_PER_SYNCW-SAMPLES_PER_SYM+1) >& filteredSyncword() const
+    {
+        return filtered_syncw;
+    }
+
     int32_t getLastCorr() const
     {
         return last_corr;
@@ -224,7 +253,7 @@ public:
 private:
     std::array< int16_t, (SAMPLES_PER_SYNCW-SAMPLES_PER_SYM+1) >    filtered_syncw; ///< Syncword filtered through rrcos twice
     std::array< int8_t, SYNCW_SIZE >                                syncword;       ///< Target syncword
-    std::array< int32_t, SAMPLES_PER_SYNCW >                        values;         ///< Correlation history
+    std::array< int32_t, SAMPLES_PER_SYNCW+1 >                      values;         ///< Correlation history, indexed like the correlator memory
     bool                                                            triggered;      ///< Peak found
     uint8_t                                                         sampIndex;      ///< Optimal sampling point
     int32_t                                                         last_corr;      ///< Value of the last corrlation computed
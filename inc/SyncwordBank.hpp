@@ -0,0 +1,117 @@
+/****************************************************************************
+ * M17Netd                                                                  *
+ * Copyright (C) 2024 by Morgan Diepart ON4MOD                              *
+ *                       SDR-Engineering SRL                                *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU Affero General Public License as published *
+ * by the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU Affero General Public License for more details.                      *
+ *                                                                          *
+ * You should have received a copy of the GNU Affero General Public License *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    *
+ ****************************************************************************/
+
+
+#ifndef SYNCWORD_BANK_H
+#define SYNCWORD_BANK_H
+
+#include <cstdint>
+#include <array>
+#include <algorithm>
+#include "Correlator.hpp"
+
+/**
+ * Bank of M17 syncword correlators. Computes the correlation of the correlator
+ * memory with the LSF, packet and EOT filtered syncwords in a single pass over
+ * the memory. The BERT and stream syncwords are the opposite of the packet and
+ * LSF syncwords, their correlations are derived from the same products at no
+ * extra cost. The values are identical to Correlator::full_convolve().
+ */
+template < size_t SYNCW_SIZE, size_t SAMPLES_PER_SYM >
+class SyncwordBank
+{
+private:
+    using correlator_t = Correlator< SYNCW_SIZE, SAMPLES_PER_SYM >;
+    static constexpr size_t SYNCWORD_SAMPLES = (SYNCW_SIZE-1) * SAMPLES_PER_SYM + 1;
+    static constexpr size_t PADDED_SAMPLES = correlator_t::PADDED_SYNCWORD_SAMPLES;
+
+public:
+    using template_t = std::array< int16_t, SYNCWORD_SAMPLES >;
+
+    /**
+     * Correlation lanes
+     */
+    enum Lane
+    {
+        LSF = 0,
+        PACKET,
+        BERT,
+        STREAM,
+        EOT,
+        LANES
+    };
+
+    /**
+     * Constructor.
+     *
+     * @param lsf: LSF filtered syncword.
+     * @param packet: packet filtered syncword.
+     * @param eot: EOT filtered syncword.
+     */
+    SyncwordBank(const template_t &lsf, const template_t &packet, const template_t &eot) : corr({0})
+    {
+        const template_t *src[3] = {&lsf, &packet, &eot};
+
+        for(size_t i = 0; i < 3; i++)
+        {
+            padded[i].fill(0);
+            std::copy(src[i]->begin(), src[i]->end(), padded[i].begin());
+            syncwords[i] = padded[i].data();
+        }
+    }
+
+    /**
+     * Destructor.
+     */
+    ~SyncwordBank() { }
+
+    /**
+     * Compute the correlations of all the lanes with the current correlator memory.
+     *
+     * @param correlator: correlator object holding the samples.
+     */
+    void update(const correlator_t &correlator)
+    {
+        std::array< int64_t, 3 > acc = correlator.full_convolve_raw(syncwords);
+
+        corr[LSF]    = acc[0] >> 13;
+        corr[PACKET] = acc[1] >> 13;
+        corr[EOT]    = acc[2] >> 13;
+        corr[BERT]   = (-acc[1]) >> 13;
+        corr[STREAM] = (-acc[0]) >> 13;
+    }
+
+    /**
+     * Get the correlation of a lane computed by the last update().
+     *
+     * @param lane: lane to read.
+     * @return correlation value.
+     */
+    int32_t operator[](const Lane lane) const
+    {
+        return corr[lane];
+    }
+
+private:
+    alignas(32) std::array< std::array< int16_t, PADDED_SAMPLES >, 3 > padded; ///< LSF, packet and EOT filtered syncwords, zero-padded
+    std::array< const int16_t *, 3 >                                syncwords;  ///< Pointers to the padded syncwords
+    std::array< int32_t, LANES >        corr;       ///< Correlation of each lane
+};
+
+#endif
@@ -0,0 +1,114 @@
+/****************************************************************************
+ * M17Netd                                                                  *
+ * Copyright (C) 2024 by Morgan Diepart ON4MOD                              *
+ *                       SDR-Engineering SRL                                *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU Affero General Public License as published *
+ * by the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU Affero General Public License for more details.                      *
+ *                                                                          *
+ * You should have received a copy of the GNU Affero General Public License *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    *
+ ****************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include "config.h"
+
+using namespace std;
+
+/**
+ * Carrier sense for listen-before-talk, on the band power of the receive front-end.
+ *
+ * The noise floor is learned at runtime as a low percentile of the band power, in dB, by a stochastic quantile
+ * tracker: each block moves it up by rate*percentile*dt when the power is above it and down by
+ * rate*(1-percentile)*dt otherwise. It settles where the power is below it for a fraction percentile of the time, so
+ * that transmissions occupying the channel up to 1-percentile of the time do not raise it, while a change of the LNA
+ * gain or of the site noise is followed within seconds.
+ *
+ * The channel becomes busy as soon as the band power is busy_snr above the floor, or the demodulator is locked, and
+ * stays busy at least busy_hold. It becomes free once the power has stayed below free_snr for free_hold.
+ *
+ * This class is not thread-safe.
+ */
+class carrier_sense
+{
+    public:
+    typedef struct
+    {
+        double observed;        /** Time during which the channel was sensed, in seconds */
+        double busy;            /** Part of observed during which the channel was busy, in seconds */
+        double longest_busy;    /** Longest busy period, in seconds */
+        size_t busy_periods;    /** Number of times the channel became busy */
+    } stats_t;
+
+    /**
+     * @param cfg thresholds, hold times and noise floor tracker settings
+     * @param sample_rate rate of the samples counted by update(), in Hz
+     * @param full_scale_power band power of a full scale signal, the power levels are given relative to it in dBFS
+     */
+    carrier_sense(const carrier_sense_cfg &cfg, float sample_rate, float full_scale_power);
+
+    /**
+     * Updates the state of the channel after a block of samples
+     *
+     * @param power band power at the end of the block
+     * @param locked true if the demodulator is locked on a transmission, the block then does not count for the
+     *        noise floor
+     * @param n number of samples of the block
+     *
+     * @return true if the channel changed state, false otherwise
+     */
+    bool update(float power, bool locked, size_t n);
+
+    /**
+     * Tells if the channel is busy, it is until the noise floor has been learned
+     */
+    bool is_busy() const;
+
+    /**
+     * Get the noise floor, in dBFS
+     */
+    float get_noise_floor() const;
+
+    /**
+     * Get the band power of the last block, in dBFS
+     */
+    float get_power() const;
+
+    /**
+     * Returns the channel occupancy counters
+     */
+    const stats_t& get_stats() const;
+
+    private:
+    static constexpr float warmup = 0.5f;   /** Time before the channel may be free, for the floor to settle, in seconds */
+
+    float     percentile;
+    float     floor_rate;                   /** Noise floor tracker speed, dB per sample */
+    float     busy_snr;
+    float     free_snr;
+    uint64_t  busy_hold;                    /** Shortest busy period, in samples */
+    uint64_t  free_hold;                    /** Time below free_snr before the channel is free, in samples */
+    float     sample_rate;
+    float     full_scale_db;                /** Band power of a full scale signal in dB */
+
+    bool      busy;
+    bool      learned;                      /** The noise floor has been initialized */
+    float     floor_db;                     /** Noise floor in dB */
+    float     power_db;                     /** Last band power in dB */
+    uint64_t  now;                          /** Samples sensed since the creation */
+    uint64_t  busy_since;                   /** Value of now when the channel became busy */
+    uint64_t  hold;                         /** Shortest duration of the current busy period, in samples */
+    uint64_t  below;                        /** Samples for which the power has been below free_snr */
+    stats_t   stats;
+};
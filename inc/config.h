@@ -21,6 +21,8 @@
 
 #include <toml.hpp>
 #include <string>
+#include <array>
+#include <vector>
 
 #include "sx1255.h"
 
@@ -58,8 +60,61 @@ typedef struct
     unsigned long rx_freq; /* RX Frequency */
     float         k;       /* FM Modulation index */
     float         ppm;     /* Frequency correction in ppm */
+    bool          afc_feedback; /* Feed the carrier offset learned from the peers back to the local oscillator */
+    bool          fixed_point_rx; /* Fixed-point RX front-end and demodulator filter, faster on ARM boards */
+    size_t        channels; /* Channels the capture is split into, 1 for a single channel at rx_freq */
+    vector<int>   rx_channels; /* Channels to receive, in channel spacings (96 kHz / channels) from rx_freq */
+    size_t        rx_workers; /* Threads demodulating the channels */
+    size_t        fec_workers; /* Threads decoding the frames of the demodulator, with a single channel */
 } radio_thread_cfg;
 
+typedef struct
+{
+    bool               weighted;            /* Weighted round-robin between classes instead of strict priority */
+    array<unsigned, 3> weights;             /* Packets sent per round by the interactive, normal and bulk classes */
+    vector<uint8_t>    interactive_dscp;    /* DSCP values sent in the interactive class */
+    vector<uint8_t>    bulk_dscp;           /* DSCP values sent in the bulk class */
+    size_t             small_tcp_len;       /* TCP packets up to this length (ACKs, keystrokes) are interactive */
+} txsched_cfg;
+
+typedef struct
+{
+    bool     enabled;       /* Drop (or mark) packets that stay queued for too long */
+    bool     ecn;           /* Mark ECN-capable packets instead of dropping them */
+    unsigned target_ms;     /* Acceptable standing queue delay */
+    unsigned interval_ms;   /* Time the delay must stay above target before dropping */
+    size_t   quantum;       /* Bytes a flow may send per round */
+    size_t   flows;         /* Number of flow queues per priority class */
+} aqm_cfg;
+
+typedef struct
+{
+    float    percentile;    /* Percentile of the band power taken as the noise floor (0 -> 0.5) */
+    float    floor_rate;    /* Speed of the noise floor tracker in dB/s, it rises percentile times slower */
+    float    busy_snr;      /* The channel becomes busy when the band power is this much above the noise floor, in dB */
+    float    free_snr;      /* The channel becomes free when the band power stays below this SNR, in dB */
+    unsigned busy_hold_ms;  /* Shortest busy period */
+    unsigned free_hold_ms;  /* Time below free_snr before the channel is free */
+} carrier_sense_cfg;
+
+typedef struct
+{
+    vector<unsigned> cpus;      /* CPUs the thread may run on, empty for all of them */
+    bool             fifo;      /* Run with the SCHED_FIFO real-time policy instead of SCHED_OTHER */
+    int              priority;  /* SCHED_FIFO priority (1 -> 99) */
+} thread_cfg;
+
+typedef struct
+{
+    bool       mlockall;        /* Lock all current and future memory pages in RAM */
+    thread_cfg tun;             /* TUN interface thread */
+    thread_cfg radio;           /* Radio (RX demodulation / TX modulation) thread */
+    thread_cfg capture;         /* Thread reading the samples from the radio during RX */
+    thread_cfg rx_workers;      /* Channel demodulation threads, when receiving several channels */
+    thread_cfg fec_workers;     /* Frame decoding threads, when receiving a single channel */
+    thread_cfg m17tx;           /* M17 encoding thread */
+} threads_cfg;
+
 class config
 {
     public:
@@ -67,6 +122,10 @@ class config
     int getTunConfig(tunthread_cfg &tun_cfg) const;
     int getRadioConfig(radio_thread_cfg &radio_cfg) const;
     int getSDRNodeConfig(sdrnode_cfg &cfg) const;
+    int getTxSchedConfig(txsched_cfg &cfg) const;
+    int getAqmConfig(aqm_cfg &cfg) const;
+    int getCarrierSenseConfig(carrier_sense_cfg &cfg) const;
+    int getThreadsConfig(threads_cfg &cfg) const;
     vector<peer_t> getPeers() const;
     string_view getCallsign() const;
     size_t getTxQueueSize() const;
@@ -0,0 +1,208 @@
+/****************************************************************************
+ * M17Netd                                                                  *
+ * Copyright (C) 2024 by Morgan Diepart ON4MOD                              *
+ *                       SDR-Engineering SRL                                *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU Affero General Public License as published *
+ * by the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU Affero General Public License for more details.                      *
+ *                                                                          *
+ * You should have received a copy of the GNU Affero General Public License *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    *
+ ****************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <array>
+#include <map>
+#include <chrono>
+#include <optional>
+#include <thread>
+
+#include <m17.h>
+
+#include "SPSCQueue.h"
+#include "m17rx.h"
+#include "frame_pool.h"
+#include "m17rx_pool.h"
+#include "config.h"
+
+using namespace std;
+
+/**
+ * Decodes the frames of the demodulators (derandomization, deinterleaving and Viterbi) on worker threads and
+ * reassembles them into packets, so that the thread running the demodulators never waits on the FEC.
+ *
+ * Frames come from a single thread, tagged with the stream (e.g. the channel) they were received on. All the frames of
+ * a superframe, from its LSF to its last frame, go to the same worker, through one queue per worker, and are decoded in
+ * order. A new superframe goes to the least busy worker once the previous worker has decoded all the frames of the
+ * stream and all its packets were fetched, so the packets of a stream are fetched in the order they were received. Completed packets come back through
+ * one queue per worker and are fetched by the feeding thread. The packets come from an m17rx_pool and go back to it
+ * once dropped by their last user.
+ *
+ * Given the callsign of the station, the workers only decode the LSF of the superframes addressed to other stations.
+ * Such a foreign packet is returned once its LSF is decoded, for its source, and never completes.
+ */
+class fec_pool
+{
+    public:
+    static constexpr size_t queue_frames = 64;              /** Frames in the queue of each worker, 2.5s of frames */
+    static constexpr size_t queue_packets = 16;             /** Packets in the queue of each worker */
+    static constexpr size_t packets_in_flight = 32;         /** Packets expected between fetch() and their last user */
+
+    /**
+     * A decoded packet
+     */
+    typedef struct
+    {
+        shared_ptr<m17rx> packet;
+        int stream;         /** Stream the packet was received on */
+        float offset;       /** Carrier offset given with the last frame of the packet */
+    } rx_packet_t;
+
+    /**
+     * Frame counters and decode latencies since the creation of the pool
+     */
+    typedef struct
+    {
+        size_t frames;          /** Frames decoded */
+        size_t dropped;         /** Frames dropped because the queue of their worker was full */
+        size_t packets;         /** Packets completed */
+        size_t foreign;         /** Superframes addressed to other stations */
+        size_t skipped;         /** Frames of the foreign superframes, not decoded */
+        double mean_latency;    /** Mean time from add_frame() to the end of the decoding of a frame, in s */
+        double max_latency;     /** Longest time from add_frame() to the end of the decoding of a frame, in s */
+        double mean_decode;     /** Mean decoding time of a frame, in s */
+        double saved;           /** Decoding time saved on the skipped frames, estimated from mean_decode, in s */
+    } stats_t;
+
+    /**
+     * Creates the workers, which are started at once
+     *
+     * @param nb_workers number of worker threads, at least one
+     * @param sched CPU set and scheduling policy of the workers
+     * @param destination if set, encoded callsign of the station, see m17rx::set_destination()
+     */
+    fec_pool(size_t nb_workers, const thread_cfg &sched, const optional<m17rx::callsign_t> &destination = nullopt);
+
+    /**
+     * Stops and joins the workers
+     */
+    ~fec_pool();
+
+    /**
+     * Hands a frame to the worker of its superframe, never waits. An LSF or the first BERT frame of a stream starts a
+     * new superframe. The frame is dropped if the queue of the worker is full, and so are the next frames of its
+     * superframe.
+     *
+     * @param stream stream the frame was received on
+     * @param sync_word the sync word of the frame (as packed bits)
+     * @param frame the soft bits of the frame, including the sync word, decoded in place by the worker
+     * @param offset carrier offset of the frame, returned with the packet
+     */
+    void add_frame(int stream, uint16_t sync_word, frame_pool::frame_ptr frame, float offset);
+
+    /**
+     * Ends the superframe of a stream, e.g. when the demodulator loses the lock, the packet being received is dropped
+     *
+     * @param stream the stream
+     */
+    void end_stream(int stream);
+
+    /**
+     * Gets a packet completed by any worker, or a foreign packet, never waits
+     *
+     * @param packet receives the packet
+     *
+     * @return 0 if a packet was fetched, -1 if none is ready
+     */
+    int fetch(rx_packet_t &packet);
+
+    /**
+     * Gets the frame counters and decode latencies of all the workers
+     */
+    stats_t get_stats() const;
+
+    /**
+     * Gets the counters of the packets of the workers
+     */
+    m17rx_pool::stats_t get_packet_stats() const;
+
+    private:
+    /**
+     * A frame to decode, or the end of a stream
+     */
+    typedef struct
+    {
+        frame_pool::frame_ptr frame;
+        uint16_t sync_word;
+        int stream;
+        float offset;
+        bool end;                               /** End of the stream, drop its packet */
+        chrono::steady_clock::time_point added; /** Time of the call to add_frame() */
+    } job_t;
+
+    /**
+     * A worker thread, its queues and its counters
+     */
+    typedef struct
+    {
+        SPSCQueue<job_t> jobs{"fec_worker_jobs", queue_frames};
+        SPSCQueue<rx_packet_t> packets{"fec_worker_packets", queue_packets};
+        atomic<size_t> done;                    /** Jobs processed */
+        size_t submitted;                       /** Jobs handed to the worker, only used by the feeding thread */
+        atomic<size_t> frames;
+        atomic<size_t> packets_done;
+        atomic<size_t> foreign;
+        atomic<size_t> skipped;
+        atomic<uint64_t> latency_sum;           /** In ns */
+        atomic<uint64_t> latency_max;           /** In ns */
+        atomic<uint64_t> decode_sum;            /** In ns */
+        thread t;
+    } worker_t;
+
+    /**
+     * Superframe being received on a stream, seen from the feeding thread
+     */
+    typedef struct
+    {
+        size_t worker;      /** Worker decoding the superframe */
+        size_t last;        /** Value of submitted of the worker after the last job of the stream */
+        bool active;        /** false once the superframe ended or lost a frame */
+    } stream_t;
+
+    /**
+     * Worker thread: decodes its frames until running becomes false
+     */
+    void work(worker_t &worker);
+
+    /**
+     * Gets the worker with the fewest frames queued
+     */
+    size_t least_busy() const;
+
+    /**
+     * Hands the job to a worker, never waits
+     *
+     * @return 0 on success, -1 if the queue of the worker is full
+     */
+    int submit(stream_t &stream);
+
+    m17rx_pool rx_packets;                      /** Packets of the workers, shared by all of them */
+    vector<unique_ptr<worker_t>> workers;
+    map<int, stream_t> streams;
+    job_t job;                                  /** Job being handed to a worker */
+
+    atomic_bool running;
+    size_t dropped;
+    size_t next_fetch;                          /** Worker whose packets are fetched first, for fairness */
+};
@@ -0,0 +1,172 @@
+/****************************************************************************
+ * M17Netd                                                                  *
+ * Copyright (C) 2024 by Morgan Diepart ON4MOD                              *
+ *                       SDR-Engineering SRL                                *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU Affero General Public License as published *
+ * by the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU Affero General Public License for more details.                      *
+ *                                                                          *
+ * You should have received a copy of the GNU Affero General Public License *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    *
+ ****************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+#include "config.h"
+
+using namespace std;
+
+/**
+ * A packet waiting to be transmitted
+ */
+typedef struct
+{
+    shared_ptr<vector<uint8_t>>         ip_pkt;     /** Raw IPv4 packet */
+    string                              dst;        /** Destination callsign */
+    chrono::steady_clock::time_point    enqueued;   /** Time at which the packet was queued */
+} fq_entry;
+
+/**
+ * Flow queueing with CoDel active queue management (RFC 8290).
+ *
+ * Packets are hashed on their IPv4 5-tuple into a fixed number of flow queues served by deficit
+ * round-robin, new flows first. Each flow queue runs CoDel (RFC 8289): once packets have spent
+ * more than the target delay in the queue for a whole interval, packets are dropped (or ECN marked)
+ * at dequeue, at an increasing rate, until the standing queue is gone.
+ *
+ * This class is not thread-safe.
+ */
+class fq_codel
+{
+    public:
+    typedef struct
+    {
+        size_t enqueued;    /** Packets accepted */
+        size_t sent;        /** Packets dequeued for transmission */
+        size_t dropped;     /** Packets dropped by CoDel */
+        size_t marked;      /** Packets ECN marked by CoDel */
+        size_t overlimit;   /** Packets dropped because the queue was full */
+    } stats_t;
+
+    fq_codel(size_t limit, const aqm_cfg &cfg);
+
+    /**
+     * Adds a packet to its flow queue. If the queue is full, the head packet of the largest flow is dropped.
+     *
+     * @param e the packet to add
+     */
+    void enqueue(fq_entry &&e);
+
+    /**
+     * Gets the next packet to transmit
+     *
+     * @param e the packet in which to store the result
+     * @param now current time
+     *
+     * @return false if there is nothing to transmit, true otherwise
+     */
+    bool dequeue(fq_entry &e, chrono::steady_clock::time_point now);
+
+    /**
+     * Check if the queue is empty
+     *
+     * @return true if no packet is waiting, false otherwise
+     */
+    bool empty() const;
+
+    /**
+     * Get the number of packets waiting in all the flow queues
+     *
+     * @return the number of packets in the queue
+     */
+    size_t length() const;
+
+    /**
+     * Returns the queue counters
+     */
+    const stats_t& get_stats() const;
+
+    private:
+    typedef chrono::steady_clock::time_point time_point;
+    typedef chrono::steady_clock::duration duration;
+
+    typedef struct
+    {
+        deque<fq_entry> q;                  /** Packets of the flow */
+        size_t          bytes;              /** Bytes waiting in q */
+        int64_t         deficit;            /** Bytes the flow may still send in this round */
+        bool            listed;             /** Flow is in new_flows or old_flows */
+
+        // CoDel state
+        bool            dropping;           /** In dropping state */
+        uint32_t        count;              /** Packets dropped since entering dropping state */
+        uint32_t        lastcount;          /** count when last leaving dropping state */
+        time_point      first_above_time;   /** Time at which the delay will have been above target for a whole interval */
+        time_point      drop_next;          /** Time of the next drop while in dropping state */
+    } flow_t;
+
+    /**
+     * Computes the flow queue index of an IPv4 packet from its 5-tuple
+     */
+    size_t flow_index(const vector<uint8_t> &pkt) const;
+
+    /**
+     * Pops the head packet of a flow and tells whether its sojourn time allows dropping it
+     *
+     * @return false if the flow is empty, true otherwise
+     */
+    bool codel_pop(flow_t &flow, fq_entry &e, time_point now, bool &ok_to_drop);
+
+    /**
+     * CoDel dequeue: returns the next packet of a flow that should not be dropped
+     *
+     * @return false if the flow is empty, true otherwise
+     */
+    bool codel_dequeue(flow_t &flow, fq_entry &e, time_point now);
+
+    /**
+     * Next drop time, interval/sqrt(count) after t
+     */
+    time_point control_law(time_point t, uint32_t count) const;
+
+    /**
+     * Sets the Congestion Experienced codepoint of an ECN-capable IPv4 packet
+     *
+     * @return true if the packet is ECN-capable and has been marked, false otherwise
+     */
+    static bool mark_ce(vector<uint8_t> &pkt);
+
+    /**
+     * Drops a packet that has been removed from its flow
+     */
+    void drop(fq_entry &e);
+
+    vector<flow_t>  flows;          /** Flow queues */
+    deque<size_t>   new_flows;      /** Flows that became active during this round */
+    deque<size_t>   old_flows;      /** Other active flows */
+    size_t          limit;          /** Maximum number of packets in all the flows */
+    size_t          packets;        /** Number of packets in all the flows */
+    size_t          max_packet;     /** Largest packet seen, a flow holding less than this is never dropped from */
+    bool            enabled;        /** CoDel enabled */
+    bool            ecn;            /** Mark instead of dropping */
+    duration        target;         /** CoDel target delay */
+    duration        interval;       /** CoDel interval */
+    int64_t         quantum;        /** DRR quantum in bytes */
+    uint32_t        perturbation;   /** Hash seed */
+    stats_t         stats;
+};
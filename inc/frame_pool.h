@@ -0,0 +1,115 @@
+/****************************************************************************
+ * M17Netd                                                                  *
+ * Copyright (C) 2024 by Morgan Diepart ON4MOD                              *
+ *                       SDR-Engineering SRL                                *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU Affero General Public License as published *
+ * by the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU Affero General Public License for more details.                      *
+ *                                                                          *
+ * You should have received a copy of the GNU Affero General Public License *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    *
+ ****************************************************************************/
+
+#pragma once
+
+#include <array>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+
+#include <m17.h>
+
+using namespace std;
+
+/**
+ * Preallocated buffers of soft frames, handed from the demodulator down to m17rx without being copied.
+ *
+ * A buffer is owned by a frame_ptr, which gives it back to its pool when destroyed. The pool allocates a new buffer
+ * when none is free, and counts it, as well as the frames copied into buffers. Both counters stay at zero in steady
+ * state. The buffers may be acquired and released from any thread. The pool must outlive all its buffers.
+ */
+class frame_pool
+{
+    public:
+    using soft_frame_t = array<uint16_t, 2*SYM_PER_FRA>;   /** Soft bits of a frame, including the sync word */
+
+    /**
+     * Deleter of frame_ptr: gives the buffer back to its pool, or deletes it if it has none
+     */
+    struct recycler
+    {
+        frame_pool *pool = nullptr;
+
+        void operator()(soft_frame_t *frame) const;
+    };
+
+    using frame_ptr = unique_ptr<soft_frame_t, recycler>;
+
+    /**
+     * Counters since the creation of the pool
+     */
+    typedef struct
+    {
+        size_t size;            /** Buffers owned by the pool */
+        size_t acquired;        /** Buffers handed out */
+        size_t allocations;     /** Buffers allocated after the creation of the pool, because none was free */
+        size_t copies;          /** Frames copied into a buffer by copy() */
+    } stats_t;
+
+    /**
+     * Allocates the buffers
+     *
+     * @param size number of buffers allocated at once
+     */
+    explicit frame_pool(size_t size);
+
+    /**
+     * Deletes the buffers, all of them must have been released
+     */
+    ~frame_pool();
+
+    frame_pool(const frame_pool&) = delete;
+    frame_pool& operator=(const frame_pool&) = delete;
+
+    /**
+     * Gets a free buffer, its content is undefined
+     */
+    frame_ptr acquire();
+
+    /**
+     * Gets a free buffer holding a copy of a frame, for the frames that do not come from a buffer of the pool
+     */
+    frame_ptr copy(const soft_frame_t &frame);
+
+    /**
+     * Gets a buffer deleted when released, for the users without a pool
+     */
+    static frame_ptr allocate();
+
+    /**
+     * Gets the counters of the pool
+     */
+    stats_t get_stats() const;
+
+    private:
+    /**
+     * Gives a buffer back to the pool
+     */
+    void release(soft_frame_t *frame);
+
+    mutable mutex free_lock;                    /** Held for the few instructions popping or pushing a buffer */
+    vector<soft_frame_t *> free_frames;         /** Free buffers, reserved for all the buffers of the pool */
+    vector<unique_ptr<soft_frame_t>> buffers;   /** All the buffers of the pool */
+
+    atomic<size_t> acquired;
+    atomic<size_t> allocations;
+    atomic<size_t> copies;
+};
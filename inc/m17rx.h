@@ -26,17 +26,52 @@
 
 #include <m17.h>
 
+#include "frame_pool.h"
+
 using namespace std;
 
+/**
+ * Read-only view of contiguous bytes, e.g. the payload of a packet. It does not own the bytes.
+ */
+class byte_span
+{
+    public:
+    byte_span(): ptr(nullptr), len(0) {}
+    byte_span(const uint8_t *data, size_t size): ptr(data), len(size) {}
+
+    const uint8_t *data() const { return ptr; }
+    size_t size() const { return len; }
+    bool empty() const { return len == 0; }
+    const uint8_t *begin() const { return ptr; }
+    const uint8_t *end() const { return ptr + len; }
+    uint8_t operator[](size_t i) const { return ptr[i]; }
+
+    private:
+    const uint8_t *ptr;
+    size_t len;
+};
+
 class m17rx
 {
     public:
+    static constexpr size_t max_payload = 33*25;    /** Largest payload of a packet: 33 frames of 25 bytes */
+
+    using callsign_t = array<uint8_t, 6>;           /** Encoded callsign, as in the LSF */
+
     m17rx();
-    ~m17rx();
-    m17rx(const m17rx &origin);
-    m17rx(m17rx &&origin);
-    m17rx& operator=(const m17rx &origin);
-    m17rx& operator=(m17rx &&origin);
+
+    /**
+     * Only decodes the superframes addressed to a station: once an intact LSF with another destination is received,
+     * the packet is foreign and its PKT frames are accepted without being decoded. The filter is kept by reset().
+     *
+     * @param dst encoded callsign of the station, as in the destination field of the LSF
+     */
+    void set_destination(const callsign_t &dst);
+
+    /**
+     * Empties the packet so that it can receive a new one, the payload store is kept
+     */
+    void reset();
 
     /**
      * Append a frame to the packet
@@ -48,6 +83,17 @@ class m17rx
      */
     int add_frame(uint16_t sync_word, array<uint16_t, 2*SYM_PER_FRA> frame);
 
+    /**
+     * Append a frame to the packet without copying it: the frame is derandomized, deinterleaved and decoded in its
+     * buffer, which then goes back to its pool
+     *
+     * @param sync_word the sync_word at the beginning of the frame (as packed bits)
+     * @param frame buffer of 2*192 (384) soft bits including the sync_word
+     *
+     * @return 0 on success, -1 on error
+     */
+    int add_frame(uint16_t sync_word, frame_pool::frame_ptr frame);
+
     /**
      * Check if the frame received is valid
      *
@@ -78,6 +124,18 @@ class m17rx
      */
     bool is_error() const;
 
+    /**
+     * Check if the packet is addressed to another station than the one given to set_destination()
+     *
+     * @return true if the LSF is intact and addressed to another station, false otherwise
+     */
+    bool is_foreign() const;
+
+    /**
+     * Returns the number of PKT frames of a foreign packet that have not been decoded
+     */
+    size_t skipped_frames() const;
+
     /**
      * Returns the LSF frame of the packet
      * This function performs no check on the returned LSF so the returned LSF may be corrupted.
@@ -94,6 +152,13 @@ class m17rx
      */
     vector<uint8_t> get_payload() const;
 
+    /**
+     * Returns the payload of the packet without copying it. The view is valid until the packet is modified or reset.
+     *
+     * @return view of the payload if the packet is valid, an empty view otherwise
+     */
+    byte_span payload() const;
+
     /**
      * Check if the current superframe is in BERT mode.
      *
@@ -126,6 +191,16 @@ class m17rx
     bool is_bert_synced() const;
 
     private:
+    /**
+     * Appends a frame to the packet, the soft bits are modified
+     *
+     * @param sync_word the sync_word at the beginning of the frame (as packed bits)
+     * @param frame 2*192 (384) soft bits including the sync_word
+     *
+     * @return 0 on success, -1 on error
+     */
+    int decode_frame(uint16_t sync_word, uint16_t *frame);
+
     static constexpr uint16_t SYNC_LSF = 0x55F7; /** LSF frame sync word */
     static constexpr uint16_t SYNC_PKT = 0x75FF; /** PKT frame sync word */
     static constexpr uint16_t SYNC_BER = 0xDF55; /** BERT frame sync word */
@@ -136,14 +211,21 @@ class m17rx
         LSF_RECEIVED,   /** The LSF frame have been received and PKT frames may be added */
         PKT_COMPLETE,   /** The last PKT frame have been received */
         BERT,           /** Bit Error Rate Testing mode */
+        FOREIGN,        /** The LSF is addressed to another station, PKT frames are not decoded */
         ERROR           /** An error occured (such as a skipped frame number) */
     };
 
     packet_status       status;                 /** Current status of the packet */
     array<uint8_t, 30>  lsf;                    /** LSF frame content */
-    vector<uint8_t>     *pkt_data;              /** raw type-1 bits from the successive packet frames */
+    array<uint8_t, max_payload> pkt_data;       /** raw type-1 bits from the successive packet frames */
+    size_t              pkt_len;                /** Bytes of pkt_data received */
     uint32_t            corrected_errors;       /** Number of corrected bits along the full frame */
     int                 received_pkt_frames;    /** Number of packet frames received */
+    size_t              skipped;                /** Number of packet frames not decoded */
+
+    // Destination filter
+    bool                filter_destination;     /** true if only the packets addressed to destination are decoded */
+    callsign_t          destination;            /** Encoded callsign of the station */
 
     // BERT variables
     static constexpr unsigned bert_lockcnt = 18;    /** Number of correct bits to receive to lock BERT sync */
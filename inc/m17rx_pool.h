@@ -0,0 +1,90 @@
+/****************************************************************************
+ * M17Netd                                                                  *
+ * Copyright (C) 2024 by Morgan Diepart ON4MOD                              *
+ *                       SDR-Engineering SRL                                *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU Affero General Public License as published *
+ * by the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU Affero General Public License for more details.                      *
+ *                                                                          *
+ * You should have received a copy of the GNU Affero General Public License *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    *
+ ****************************************************************************/
+
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <optional>
+
+#include "m17rx.h"
+
+using namespace std;
+
+/**
+ * Preallocated packets, recycled instead of being allocated for every packet received.
+ *
+ * The pool keeps a reference to each of its packets and hands out the ones it is the only owner of, reset. A packet
+ * thus goes back to the pool when the last user drops it, e.g. once the TUN thread has written it, without any
+ * deleter nor allocation of a shared_ptr control block. The pool allocates a new packet when none is free, and counts
+ * it. The packets may be acquired from any thread and released from any thread. Packets still in use when the pool
+ * is destroyed stay valid until they are dropped. The packets of the pool may only decode the superframes addressed
+ * to the station, see m17rx::set_destination().
+ */
+class m17rx_pool
+{
+    public:
+    /**
+     * Counters since the creation of the pool
+     */
+    typedef struct
+    {
+        size_t size;            /** Packets owned by the pool */
+        size_t acquired;        /** Packets handed out */
+        size_t allocations;     /** Packets allocated after the creation of the pool, because none was free */
+    } stats_t;
+
+    /**
+     * Allocates the packets
+     *
+     * @param size number of packets allocated at once
+     * @param destination if set, encoded callsign of the station, the packets addressed to others are not decoded
+     */
+    explicit m17rx_pool(size_t size, const optional<m17rx::callsign_t> &destination = nullopt);
+
+    m17rx_pool(const m17rx_pool&) = delete;
+    m17rx_pool& operator=(const m17rx_pool&) = delete;
+
+    /**
+     * Gets an empty packet
+     */
+    shared_ptr<m17rx> acquire();
+
+    /**
+     * Gets the counters of the pool
+     */
+    stats_t get_stats() const;
+
+    private:
+    /**
+     * Allocates a packet, with the destination filter of the pool
+     */
+    shared_ptr<m17rx> create() const;
+
+    mutable mutex lock;                         /** Held while looking for a free packet */
+    vector<shared_ptr<m17rx>> packets;          /** All the packets of the pool, free when the pool is their only owner */
+    size_t next;                                /** Packet looked at first by acquire() */
+    optional<m17rx::callsign_t> destination;    /** Destination filter of the packets */
+
+    atomic<size_t> acquired;
+    atomic<size_t> allocations;
+};
@@ -32,13 +32,21 @@ class m17tx
 protected:
     static constexpr size_t N = 20; // Interpolation factor
     static constexpr size_t nb_taps = 161; // Taps in RRC filter
+    static constexpr size_t branch_taps = (nb_taps+N-1)/N; // Taps per branch of the polyphase filter
 
     vector<float> *symbols;
     static const array<float, nb_taps> taps;
+    // Polyphase filter: the output p of a symbol period is the sum of branches[m][p]*filt_buff[m]
+    static const array<array<float, N>, branch_taps> branches;
     size_t bb_samples;
     size_t sym_idx;
-    array<float, (nb_taps+N)> filt_buff;
-    size_t filt_offset; // Offset within the filt_buff array
+    array<float, branch_taps> filt_buff; // Symbols in the filter, the newest first
+    size_t filt_offset; // Outputs left before the next symbol is loaded
+
+    /**
+     * Computes the N outputs of the symbol period of the symbols in filt_buff
+     */
+    void interpolate(float *out) const;
 
 public:
     m17tx();
@@ -24,15 +24,16 @@
 #include <vector>
 #include <memory>
 
-#include "ConsumerProducer.h"
+#include "SPSCQueue.h"
 #include "config.h"
 #include "m17tx.h"
+#include "tx_scheduler.h"
 using namespace std;
 
 class m17tx_thread
 {
     public:
-    void operator()(atomic_bool &running, const config &cfg,
-                    ConsumerProducerQueue<shared_ptr<vector<uint8_t>>> &from_net,
-                    ConsumerProducerQueue<shared_ptr<m17tx_pkt>> &to_radio);
+    void operator()(atomic_bool &running, const config &cfg, const threads_cfg &threads,
+                    SPSCQueue<shared_ptr<vector<uint8_t>>> &from_net,
+                    tx_scheduler &to_radio);
 };
\ No newline at end of file
@@ -25,26 +25,92 @@
 #include <string>
 #include <string_view>
 #include <vector>
+#include <array>
+#include <map>
+#include <complex>
 #include <liquid/liquid.h>
-#include "ConsumerProducer.h"
+#include "SPSCQueue.h"
 
 #include "m17tx.h"
+#include "m17rx.h"
+#include "sdrnode.h"
+#include "tx_scheduler.h"
 #include "config.h"
 
 using namespace std;
 
 class radio_simplex {
     public:
-    void operator()(std::atomic_bool &running, const config &cfg,
-                    ConsumerProducerQueue<shared_ptr<m17tx_pkt>> &to_radio,
-                    ConsumerProducerQueue<shared_ptr<m17rx>> &from_radio);
+    /**
+     * Counters of the capture, since the start of the thread
+     */
+    typedef struct
+    {
+        size_t dropped;     /** Blocks dropped because the ring was full */
+        size_t overruns;    /** Overruns of the radio, samples lost because they were not read in time */
+        size_t max_fill;    /** Highest fill of the ring, in blocks */
+    } capture_stats_t;
+
+    void operator()(std::atomic_bool &running, const config &cfg, const threads_cfg &threads,
+                    tx_scheduler &to_radio,
+                    SPSCQueue<shared_ptr<m17rx>> &from_radio);
+
+    /**
+     * Gets the counters of the capture. May be called from any thread, the overruns and the fill are updated at the
+     * end of each RX period.
+     */
+    capture_stats_t get_capture_stats() const;
 
     private:
     static constexpr size_t block_size  = 128; /** Samples block size, 1.3ms of baseband at 96000 kSps */
-    static constexpr size_t fft_size    = 128; /** Block size to compute the FFT to assess channel occupency */
-    static constexpr size_t half_chan_width = (9000*fft_size/96000); /** Half the bandwidth of the expected signal in terms of FFT bins */
-    static constexpr float LBT_threshold = 22.0; /** Listen Before Talk threshold, sum of in-band signal power must be at least this much*/
+    static constexpr size_t rx_ring_blocks = 256; /** Blocks in the capture ring, 340ms of baseband */
+    static constexpr size_t rx_decimation = 2; /** Decimation of the channel filter, the demodulator runs at 96000/rx_decimation Sps */
+    static constexpr size_t rx_samples_per_symbol = 20 / rx_decimation; /** Samples per symbol at the demodulator input (5, 10 or 20) */
+    static constexpr float full_scale_power = 65536.0; /** Band power of a full scale signal, the front-ends scale the samples to 256 */
+    static constexpr float afc_weight = 0.25; /** Weight of a new packet in the carrier offset of its sender */
+    static constexpr float afc_min_step = 150.0; /** Smallest change of the learned offset fed back to the radio, in Hz */
+
+    /**
+     * A block of raw samples from the radio
+     */
+    typedef struct
+    {
+        array<complex<int32_t>, block_size> samples;
+        size_t len;
+    } rx_block_t;
+
+    /**
+     * Capture thread: reads blocks from the radio into the ring until capturing becomes false.
+     * Blocks that do not fit in the ring are dropped and counted.
+     *
+     * @param capturing keep capturing while true
+     * @param radio radio to read from, must be in RX mode
+     * @param ring ring to fill
+     * @param dropped number of blocks dropped because the ring was full
+     */
+    static void capture(atomic_bool &capturing, sdrnode &radio, SPSCQueue<rx_block_t> &ring, atomic<size_t> &dropped);
+
+    /**
+     * Records the carrier offset measured on a packet in the offset of its sender. Packets whose LSF CRC does not match
+     * are ignored.
+     *
+     * @param packet a complete packet
+     * @param offset carrier offset of the packet in Hz, relative to the current local oscillator
+     */
+    void record_offset(const m17rx &packet, float offset);
+
+    /**
+     * Computes the offset of the local oscillator learned from the peers, the average of their offsets.
+     *
+     * @return the learned offset in Hz, 0 if no peer was heard yet
+     */
+    float learned_offset() const;
+
+    map<string, float> peer_offsets; /** Carrier offset of each peer in Hz, relative to the current local oscillator */
+
+    atomic<size_t> capture_dropped = 0;     /** Blocks dropped by the capture thread */
+    atomic<size_t> capture_overruns = 0;    /** Overruns of the radio */
+    atomic<size_t> capture_max_fill = 0;    /** Highest fill of the ring */
 
     freqmod fmod;
-    freqdem fdem;
 };
\ No newline at end of file
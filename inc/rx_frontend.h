@@ -0,0 +1,362 @@
+/****************************************************************************
+ * M17Netd                                                                  *
+ * Copyright (C) 2024 by Morgan Diepart ON4MOD                              *
+ *                       SDR-Engineering SRL                                *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU Affero General Public License as published *
+ * by the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU Affero General Public License for more details.                      *
+ *                                                                          *
+ * You should have received a copy of the GNU Affero General Public License *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    *
+ ****************************************************************************/
+
+#pragma once
+
+#include <array>
+#include <vector>
+#include <complex>
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+/**
+ * Power of the channel, tracked on the filtered samples: p += alpha * (|y|^2 - p) at each sample.
+ *
+ * With alpha = decimation/max_chunk the time constant is one chunk of input samples (1.3 ms at 96 kHz), the
+ * integration time of the 128 points FFT it replaces for listen-before-talk. The filtered samples already exclude the
+ * out-of-band signal, so that the in-band power costs one multiply-accumulate per sample and no transform.
+ */
+class band_power
+{
+    public:
+    /**
+     * @param alpha weight of a new sample, normalized to the rate of the filtered samples
+     */
+    explicit band_power(float alpha = 1.0f/64.0f) : alpha(alpha), decay(1.0f - alpha), power(0.0f) {}
+
+    /**
+     * Adds a filtered sample
+     */
+    void update(float i, float q)
+    {
+        // p * (1-alpha) + alpha * |y|^2, the only dependency between samples is one multiply-add
+        power = decay*power + alpha*(i*i + q*q);
+    }
+
+    /**
+     * Adds n filtered samples
+     */
+    void update(const float *i, const float *q, size_t n)
+    {
+        for(size_t j = 0; j < n; j++)
+            update(i[j], q[j]);
+    }
+
+    /**
+     * Gets the power of the channel, in the squared units of the filtered samples
+     */
+    float get() const
+    {
+        return power;
+    }
+
+    void reset()
+    {
+        power = 0.0f;
+    }
+
+    private:
+    float alpha;
+    float decay;                                /** 1 - alpha */
+    float power;
+};
+
+/**
+ * Receive front-end: converts the interleaved 24 bits I/Q samples of the radio to FM demodulated baseband.
+ *
+ * Performs, for each block and in a single pass over L1-resident buffers:
+ *  - conversion of the S24 samples to float (same scaling as int32_to_float<24, 8>)
+ *  - DC removal, first order IIR: H(z) = (1 - z^-1)/(1 - (1-alpha)z^-1)
+ *  - channel low-pass filter, Kaiser windowed sinc, optionally decimating
+ *  - FM discriminator: arg(x[n] * conj(x[n-1])) / (2*pi*kf), at the decimated rate
+ *  - power of the channel, on the filtered samples (band_power)
+ *
+ * This is the same processing as the liquid-dsp chain iirfilt_crcf_create_dc_blocker, firfilt_crcf_create_kaiser
+ * and freqdem_demodulate_block. The filter and the discriminator are vectorized (NEON on aarch64, SSE2 on x86_64).
+ */
+class rx_frontend
+{
+    public:
+    static constexpr size_t nb_taps   = 101;    /** Number of taps of the channel filter */
+    static constexpr size_t max_chunk = 128;    /** Samples processed per pass, larger blocks are split */
+
+    /**
+     * Creates the front-end
+     *
+     * @param kf FM modulation index, as given to freqdem_create
+     * @param dc_alpha DC blocker bandwidth, normalized to the sampling rate
+     * @param fc channel filter cut-off frequency, normalized to the sampling rate
+     * @param As channel filter stop-band attenuation in dB
+     * @param decimation decimation factor of the channel filter (1 to 4 at 96 kHz)
+     */
+    rx_frontend(float kf, float dc_alpha = 4.0f/96000.0f, float fc = 5300.0f/96000.0f, float As = 65.0f, size_t decimation = 1);
+
+    /**
+     * Demodulates a block of samples
+     *
+     * @param in interleaved I/Q samples, 24 significant bits in 32 bits containers
+     * @param n number of I/Q samples
+     * @param out baseband samples, must have room for n/decimation + 1 samples
+     * @param dc_out if not null, receives the n samples after DC removal (before the channel filter)
+     *
+     * @return the number of baseband samples written to out
+     */
+    size_t process(const complex<int32_t> *in, size_t n, float *out, complex<float> *dc_out = nullptr);
+
+    /**
+     * Gets the power in the channel filter output, see band_power
+     */
+    float get_band_power() const;
+
+    /**
+     * Clears the filters and discriminator state
+     */
+    void reset();
+
+    private:
+    /**
+     * Processes at most max_chunk samples
+     */
+    size_t process_chunk(const complex<int32_t> *in, size_t n, float *out, complex<float> *dc_out);
+
+    /**
+     * Runs the channel filter over the n samples of the current chunk
+     *
+     * @return the number of filtered samples
+     */
+    size_t filter(size_t n);
+
+    /**
+     * Runs the channel filter over the n samples of the current chunk, keeping one output every decimation samples
+     *
+     * @return the number of filtered samples
+     */
+    size_t filter_decimate(size_t n);
+
+    // Filter history: the last nb_taps-1 samples followed by the samples of the current chunk
+    alignas(16) array<float, nb_taps-1+max_chunk> hist_i;
+    alignas(16) array<float, nb_taps-1+max_chunk> hist_q;
+
+    // Filtered samples, index 0 holds the last sample of the previous chunk
+    alignas(16) array<float, max_chunk+1> filt_i;
+    alignas(16) array<float, max_chunk+1> filt_q;
+
+    alignas(16) array<float, nb_taps> taps;     /** Channel filter taps, reversed */
+
+    float dc_pole;                              /** 1 - alpha */
+    float dc_x_i, dc_x_q;                       /** DC blocker, last input */
+    float dc_y_i, dc_y_q;                       /** DC blocker, last output */
+    float gain;                                 /** 1/(2*pi*kf*decimation) */
+    size_t decimation;                          /** One filter output is computed every decimation samples */
+    size_t decim_phase;                         /** Index, in the next chunk, of the next sample to output */
+    band_power power;                           /** Power of the filtered samples */
+};
+
+/**
+ * Fixed-point receive front-end, same processing as rx_frontend without any float:
+ *  - DC removal on the 24 bits samples: a leaky average of the input, updated once per chunk, is subtracted. For
+ *    the narrow bandwidths used here this is the first order IIR of rx_frontend, up to a gain of 1-alpha.
+ *  - conversion to Q15 with a block exponent: the samples are shifted right by the smallest amount that keeps
+ *    them below half scale, so that weak signals keep their resolution. The filter history is rescaled along.
+ *  - channel low-pass filter with Q15 taps and 32 bits accumulators, optionally decimating
+ *  - FM discriminator: integer atan2 of x[n] * conj(x[n-1]), polynomial on the octant ratio
+ *  - power of the channel, as band_power with 64 bits integers
+ *
+ * The output is the baseband in Q3.12, ready for M17Demodulator::update(const int16_t *, size_t).
+ * The filter is vectorized (NEON on aarch64, SSE2 on x86_64), 8 taps per instruction.
+ */
+class rx_frontend_q15
+{
+    public:
+    static constexpr size_t nb_taps   = 104;    /** rx_frontend::nb_taps, zero-padded to a multiple of 8 */
+    static constexpr size_t max_chunk = 128;    /** Samples processed per pass, larger blocks are split */
+    static constexpr int    out_frac_bits = 12; /** The baseband samples are in Q3.12 */
+
+    /**
+     * Creates the front-end, the parameters are the ones of rx_frontend
+     *
+     * @param kf FM modulation index, as given to freqdem_create
+     * @param dc_alpha DC blocker bandwidth, normalized to the sampling rate, dc_alpha*max_chunk must be well below 1
+     * @param fc channel filter cut-off frequency, normalized to the sampling rate
+     * @param As channel filter stop-band attenuation in dB
+     * @param decimation decimation factor of the channel filter (1 to 4 at 96 kHz)
+     */
+    rx_frontend_q15(float kf, float dc_alpha = 4.0f/96000.0f, float fc = 5300.0f/96000.0f, float As = 65.0f, size_t decimation = 1);
+
+    /**
+     * Demodulates a block of samples
+     *
+     * @param in interleaved I/Q samples, 24 significant bits in 32 bits containers
+     * @param n number of I/Q samples
+     * @param out baseband samples in Q3.12, must have room for n/decimation + 1 samples
+     * @param dc_out if not null, receives the n samples after DC removal, with the scaling of rx_frontend
+     *
+     * @return the number of baseband samples written to out
+     */
+    size_t process(const complex<int32_t> *in, size_t n, int16_t *out, complex<float> *dc_out = nullptr);
+
+    /**
+     * Gets the power in the channel filter output, with the scaling of rx_frontend::get_band_power()
+     */
+    float get_band_power() const;
+
+    /**
+     * Clears the filters and discriminator state
+     */
+    void reset();
+
+    private:
+    static constexpr int    max_shift   = 10;   /** Full scale 24 bits samples are shifted down to a quarter of Q15 */
+    static constexpr size_t quiet_limit = 64;   /** Chunks below a quarter of the scale before the shift is decreased */
+    static constexpr int    power_frac_bits = 8; /** Fractional bits of the band power */
+
+    /**
+     * Processes at most max_chunk samples
+     */
+    size_t process_chunk(const complex<int32_t> *in, size_t n, int16_t *out, complex<float> *dc_out);
+
+    /**
+     * Runs the channel filter over the n samples of the current chunk, keeping one output every decimation samples
+     *
+     * @return the number of filtered samples
+     */
+    size_t filter_decimate(size_t n);
+
+    /**
+     * Changes the block exponent and rescales the filter history accordingly
+     *
+     * @param new_shift new right shift from the 24 bits samples to Q15
+     */
+    void rescale(int new_shift);
+
+    // Filter history: the last nb_taps-1 samples followed by the samples of the current chunk
+    alignas(16) array<int16_t, nb_taps-1+max_chunk> hist_i;
+    alignas(16) array<int16_t, nb_taps-1+max_chunk> hist_q;
+
+    // DC free samples of the current chunk, 24 bits
+    array<int32_t, max_chunk> dc_i;
+    array<int32_t, max_chunk> dc_q;
+
+    // Filtered samples, index 0 holds the last sample of the previous chunk
+    array<int16_t, max_chunk+1> filt_i;
+    array<int16_t, max_chunk+1> filt_q;
+
+    alignas(16) array<int16_t, nb_taps> taps;   /** Channel filter taps in Q15, reversed, the zero padding comes first */
+
+    int64_t dc_alpha;                           /** DC blocker bandwidth, Q31 */
+    int64_t dc_avg_i, dc_avg_q;                 /** DC of the input, 24 bits with 16 fractional bits */
+    int     shift;                              /** Block exponent, right shift from the 24 bits samples to Q15 */
+    size_t  quiet;                              /** Consecutive chunks below a quarter of the scale */
+    int64_t gain;                               /** 1/(2*pi*kf*decimation), Q15 */
+    size_t  decimation;                         /** One filter output is computed every decimation samples */
+    size_t  decim_phase;                        /** Index, in the next chunk, of the next sample to output */
+    int64_t power;                              /** Power of the filtered samples, as band_power, in squared 24 bits units with power_frac_bits fractional bits */
+};
+
+/**
+ * Multi-channel receive front-end: splits the capture into nb_channels channels spaced by 1/nb_channels of the
+ * sampling rate (12 kHz for 8 channels at 96 kHz) with a polyphase DFT filter bank and FM demodulates some of them.
+ *
+ * Performs, for each block:
+ *  - conversion of the S24 samples to float and DC removal, as rx_frontend
+ *  - at each output sample, the last nb_taps samples are weighted by the channel filter of rx_frontend and folded
+ *    into nb_channels polyphase sums. The DFT bin of a channel over these sums is the output of the channel filter
+ *    for that channel, shifted to DC: each channel only adds nb_channels complex multiplications.
+ *  - FM discriminator on each demodulated channel
+ *  - power of the center channel, the sum of the partial sums (band_power)
+ *
+ * Each baseband output is the one rx_frontend gives with the radio tuned on the channel, at the same rate.
+ */
+class rx_channelizer
+{
+    public:
+    static constexpr size_t nb_taps      = 104;  /** rx_frontend::nb_taps, zero-padded to a multiple of 8 */
+    static constexpr size_t max_chunk    = 128;  /** Samples processed per pass, larger blocks are split */
+    static constexpr size_t max_channels = 8;    /** Largest number of channels of the filter bank */
+
+    /**
+     * Creates the front-end, the filter parameters are the ones of rx_frontend
+     *
+     * @param kf FM modulation index, as given to freqdem_create
+     * @param nb_channels number of channels of the filter bank: 2, 4 or 8
+     * @param channels channels to demodulate, as offsets from the center of the capture in channel spacings, from
+     *        -nb_channels/2 to nb_channels/2-1
+     * @param dc_alpha DC blocker bandwidth, normalized to the sampling rate
+     * @param fc channel filter cut-off frequency, normalized to the sampling rate
+     * @param As channel filter stop-band attenuation in dB
+     * @param decimation decimation factor of the channel filter (1 to 4 at 96 kHz)
+     */
+    rx_channelizer(float kf, size_t nb_channels, const vector<int> &channels, float dc_alpha = 4.0f/96000.0f,
+                   float fc = 5300.0f/96000.0f, float As = 65.0f, size_t decimation = 1);
+
+    /**
+     * Demodulates a block of samples on every channel
+     *
+     * @param in interleaved I/Q samples, 24 significant bits in 32 bits containers
+     * @param n number of I/Q samples
+     * @param out baseband samples of each demodulated channel, in the order of the channels given to the constructor.
+     *        Each must have room for n/decimation + 1 samples.
+     * @param dc_out if not null, receives the n samples after DC removal (before the channel filter)
+     *
+     * @return the number of baseband samples written to each channel
+     */
+    size_t process(const complex<int32_t> *in, size_t n, float *const *out, complex<float> *dc_out = nullptr);
+
+    /**
+     * Gets the power in the channel at the center of the capture, see band_power. It is tracked whether that channel
+     * is demodulated or not.
+     */
+    float get_band_power() const;
+
+    /**
+     * Clears the filters and discriminators state
+     */
+    void reset();
+
+    private:
+    /**
+     * Processes at most max_chunk samples
+     */
+    size_t process_chunk(const complex<int32_t> *in, size_t n, float *const *out, complex<float> *dc_out);
+
+    // Filter history: the last nb_taps-1 samples followed by the samples of the current chunk
+    alignas(16) array<float, nb_taps-1+max_chunk> hist_i;
+    alignas(16) array<float, nb_taps-1+max_chunk> hist_q;
+
+    alignas(16) array<float, nb_taps> taps;     /** Channel filter taps, reversed, the zero padding comes first */
+
+    /**
+     * Rotation applied to the 8 interleaved partial sums of the filter, for each channel and each phase of the
+     * newest sample modulo nb_channels: [channel][phase][sum]
+     */
+    vector<array<array<complex<float>, 8>, max_channels>> rotations;
+    vector<complex<float>> last;                /** Last filtered sample of each channel */
+
+    size_t nb_bins;                             /** Number of channels of the filter bank */
+    float dc_pole;                              /** 1 - alpha */
+    float dc_x_i, dc_x_q;                       /** DC blocker, last input */
+    float dc_y_i, dc_y_q;                       /** DC blocker, last output */
+    float gain;                                 /** 1/(2*pi*kf*decimation) */
+    size_t decimation;                          /** One filter output is computed every decimation samples */
+    size_t decim_phase;                         /** Index, in the next chunk, of the next sample to output */
+    size_t sample_phase;                        /** Index of the first sample of the next chunk, modulo nb_bins */
+    band_power power;                           /** Power of the center channel */
+};
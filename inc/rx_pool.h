@@ -0,0 +1,214 @@
+/****************************************************************************
+ * M17Netd                                                                  *
+ * Copyright (C) 2024 by Morgan Diepart ON4MOD                              *
+ *                       SDR-Engineering SRL                                *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU Affero General Public License as published *
+ * by the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU Affero General Public License for more details.                      *
+ *                                                                          *
+ * You should have received a copy of the GNU Affero General Public License *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    *
+ ****************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <array>
+#include <complex>
+#include <thread>
+#include <optional>
+
+#include "SPSCQueue.h"
+#include "M17Demodulator.hpp"
+#include "rx_frontend.h"
+#include "m17rx.h"
+#include "frame_pool.h"
+#include "m17rx_pool.h"
+#include "config.h"
+
+using namespace std;
+
+/**
+ * Multi-channel receiver: the capture is split into channels by an rx_channelizer on the calling thread, then each
+ * demodulated channel runs its own M17Demodulator and m17rx on one of the worker threads. The frames go from the
+ * demodulators to m17rx in buffers of a frame_pool, without being copied, and the packets are recycled by an m17rx_pool.
+ * Given the callsign of the station, only the LSF of the superframes addressed to other stations is decoded.
+ *
+ * A channel always runs on the same worker, the workers only share the blocks of baseband samples, through one queue
+ * each. Completed packets come back through one queue per worker and are fetched by the calling thread.
+ */
+class rx_pool
+{
+    public:
+    static constexpr size_t decimation = 2;                 /** Decimation of the channel filter, the demodulators run at 48 kSps */
+    static constexpr size_t samples_per_symbol = 20 / decimation;
+    static constexpr size_t max_block = rx_channelizer::max_chunk; /** Largest block given to process() */
+    static constexpr size_t queue_blocks = 256;             /** Blocks in the queue of each worker, 340ms of baseband */
+    static constexpr size_t queue_packets = 16;             /** Packets in the queue of each worker */
+    static constexpr size_t packets_in_flight = 32;         /** Packets expected between fetch() and their last user */
+
+    /**
+     * A packet received on a channel
+     */
+    typedef struct
+    {
+        shared_ptr<m17rx> packet;
+        int channel;        /** Channel of the packet, in channel spacings from the center of the capture */
+        float offset;       /** Carrier offset of the packet from the channel center, in baseband units */
+    } rx_packet_t;
+
+    /**
+     * Decoding counters of all the channels since the creation of the pool
+     */
+    typedef struct
+    {
+        size_t frames;          /** Frames decoded */
+        size_t foreign;         /** Superframes addressed to other stations */
+        size_t skipped;         /** Frames of the foreign superframes, not decoded */
+        double mean_decode;     /** Mean decoding time of a frame, in s */
+        double saved;           /** Decoding time saved on the skipped frames, estimated from mean_decode, in s */
+    } stats_t;
+
+    /**
+     * Creates the channelizer, the demodulators and the workers, which are started at once
+     *
+     * @param kf FM modulation index
+     * @param nb_channels number of channels of the filter bank: 2, 4 or 8
+     * @param channels channels to demodulate, in channel spacings from the center of the capture
+     * @param nb_workers number of worker threads, at most one per channel
+     * @param sched CPU set and scheduling policy of the workers
+     * @param destination if set, encoded callsign of the station, see m17rx::set_destination()
+     */
+    rx_pool(float kf, size_t nb_channels, const vector<int> &channels, size_t nb_workers, const thread_cfg &sched,
+            const optional<m17rx::callsign_t> &destination = nullopt);
+
+    /**
+     * Stops and joins the workers
+     */
+    ~rx_pool();
+
+    /**
+     * Channelizes a block of samples and hands it to the workers. A worker whose queue is full drops the block.
+     *
+     * @param in interleaved I/Q samples, 24 significant bits in 32 bits containers
+     * @param n number of I/Q samples, at most max_block
+     * @param dc_out if not null, receives the n samples after DC removal
+     */
+    void process(const complex<int32_t> *in, size_t n, complex<float> *dc_out = nullptr);
+
+    /**
+     * Gets a packet completed on any channel, or a foreign packet once its LSF is decoded, never waits
+     *
+     * @param packet receives the packet
+     *
+     * @return 0 if a packet was fetched, -1 if none is ready
+     */
+    int fetch(rx_packet_t &packet);
+
+    /**
+     * Tells if the demodulator of a channel is locked on a transmission
+     *
+     * @param channel channel, in channel spacings from the center of the capture
+     *
+     * @return true if the channel is demodulated and locked, false otherwise
+     */
+    bool is_locked(int channel) const;
+
+    /**
+     * Gets the power in the channel at the center of the capture, see rx_channelizer::get_band_power(). Must be called
+     * from the thread calling process().
+     */
+    float get_band_power() const;
+
+    /**
+     * Sets the frequency offset assumed by all the demodulators at the start of a transmission, it is applied by the
+     * workers before their next block.
+     *
+     * @param offset frequency offset, in baseband units
+     */
+    void set_frequency_offset(float offset);
+
+    /**
+     * Get the number of blocks dropped by the workers because their queue was full
+     */
+    size_t get_dropped() const;
+
+    /**
+     * Gets the decoding counters of all the channels
+     */
+    stats_t get_stats() const;
+
+    /**
+     * Gets the counters of the frame buffers of the demodulators
+     */
+    frame_pool::stats_t get_frame_stats() const;
+
+    /**
+     * Gets the counters of the packets of the channels
+     */
+    m17rx_pool::stats_t get_packet_stats() const;
+
+    private:
+    /**
+     * Baseband of the channels of a worker over one block
+     */
+    typedef struct
+    {
+        array<array<float, max_block/decimation + 1>, rx_channelizer::max_channels> samples;
+        size_t len;
+    } block_t;
+
+    /**
+     * A demodulated channel
+     */
+    typedef struct
+    {
+        int index;                                                      /** Channel, in channel spacings */
+        M17::M17Demodulator< samples_per_symbol > demodulator;
+        shared_ptr<m17rx> packet;                                       /** Packet being received */
+        atomic_bool locked;                                             /** Copy of demodulator.isLocked() for the other threads */
+    } channel_t;
+
+    /**
+     * A worker thread and the channels it demodulates
+     */
+    typedef struct
+    {
+        vector<size_t> channels;                /** Indices of the channels of the worker in channels and in the channelizer output */
+        SPSCQueue<block_t> blocks{"rx_worker_blocks", queue_blocks};
+        SPSCQueue<rx_packet_t> packets{"rx_worker_packets", queue_packets};
+        thread t;
+    } worker_t;
+
+    /**
+     * Worker thread: demodulates the blocks of its channels until running becomes false
+     */
+    void work(worker_t &worker);
+
+    rx_channelizer channelizer;
+    frame_pool frames;                          /** Frame buffers of the demodulators, outlives the channels */
+    m17rx_pool rx_packets;                      /** Packets of the channels, shared by the workers */
+    vector<unique_ptr<channel_t>> channels;
+    vector<unique_ptr<worker_t>> workers;
+    array<array<float, max_block/decimation + 1>, rx_channelizer::max_channels> baseband;  /** Channelizer output */
+    block_t block;                              /** Block being handed to a worker */
+
+    atomic_bool running;
+    atomic<float> offset;                       /** Frequency offset set by set_frequency_offset() */
+    atomic<unsigned> offset_gen;                /** Incremented by set_frequency_offset() */
+    atomic<size_t> dropped;
+    atomic<size_t> decoded_frames;
+    atomic<uint64_t> decode_sum;                /** Decoding time of the decoded frames, in ns */
+    atomic<size_t> foreign_packets;
+    atomic<size_t> skipped_frames;
+    size_t next_fetch;                          /** Worker whose packets are fetched first, for fairness */
+};
@@ -24,6 +24,7 @@
 #include <iostream>
 #include <vector>
 #include <complex>
+#include <atomic>
 
 #include <alsa/asoundlib.h>
 
@@ -117,6 +118,7 @@ class sdrnode
     // Internal state
     bool tx_nRx = false;
     bool tx_high = false;
+    atomic<size_t> rx_overruns = 0;
     unsigned long rx_frequency = 0;
     unsigned long tx_frequency = 0;
 
@@ -214,4 +216,21 @@ class sdrnode
      */
     void set_tx_high(const bool high);
 
+    /**
+     * Gets the number of capture overruns (samples lost because they were not read in time) since the creation of the object
+     *
+     * @return the number of overruns
+     */
+    size_t get_rx_overruns() const;
+
+    /**
+     * Moves the RX and TX local oscillators by a frequency correction, on top of the ppm correction
+     * given to the constructor. Used to feed back a learned carrier frequency offset.
+     *
+     * @param rx_offset RX frequency correction in Hz, the TX frequency is corrected by the same relative amount
+     *
+     * @return 0 on success, -1 on error
+     */
+    int set_freq_correction(const long rx_offset);
+
 };
\ No newline at end of file
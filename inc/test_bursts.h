@@ -0,0 +1,150 @@
+/****************************************************************************
+ * M17Netd                                                                  *
+ * Copyright (C) 2024 by Morgan Diepart ON4MOD                              *
+ *                       SDR-Engineering SRL                                *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU Affero General Public License as published *
+ * by the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU Affero General Public License for more details.                      *
+ *                                                                          *
+ * You should have received a copy of the GNU Affero General Public License *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    *
+ ****************************************************************************/
+
+
+#pragma once
+
+#include <vector>
+#include <array>
+#include <random>
+#include <complex>
+#include <cmath>
+#include <m17.h>
+
+using namespace std;
+
+/*
+ * Baseband generator shared by the demodulator tests
+ */
+
+using frame_bits_t = array<uint8_t, 2*SYM_PER_FRA>;
+
+/**
+ * Hard bits of the SYM_PER_FRA symbols of a frame.
+ * Dibits: +1 -> 00, +3 -> 01, -1 -> 10, -3 -> 11
+ */
+inline frame_bits_t frame_bits(const float *symbols)
+{
+    frame_bits_t bits;
+    for(size_t i = 0; i < SYM_PER_FRA; i++)
+    {
+        bits[2*i]   = (symbols[i] < 0);
+        bits[2*i+1] = (fabs(symbols[i]) > 2.0f);
+    }
+    return bits;
+}
+
+/**
+ * Symbols of bursts of packet superframes: silence, preamble, LSF, 33 packet
+ * frames and EOT. The payloads of the frames are random symbols.
+ *
+ * @param lead: symbols of silence before the first burst.
+ * @param frames: if not null, receives the hard bits of every frame transmitted.
+ */
+inline vector<float> burst_symbols(size_t bursts, mt19937 &rng, vector<frame_bits_t> *frames = nullptr, size_t lead = 0)
+{
+    const float levels[4] = {+1, +3, -1, -3};
+    vector<float> symbols(lead, 0.0f);
+
+    auto frame = [&](const vector<float> &sync)
+    {
+        size_t start = symbols.size();
+
+        symbols.insert(symbols.end(), sync.begin(), sync.end());
+        for(size_t i = 0; i < SYM_PER_PLD; i++)
+            symbols.push_back(levels[rng() % 4]);
+
+        if(frames)
+            frames->push_back(frame_bits(&symbols[start]));
+    };
+
+    for(size_t b = 0; b < bursts; b++)
+    {
+        symbols.insert(symbols.end(), 480, 0.0f);
+        for(size_t i = 0; i < 192; i++)
+            symbols.push_back((i % 2) ? -3 : +3);
+
+        frame({+3, +3, +3, +3, -3, -3, +3, -3});
+        for(size_t f = 0; f < 33; f++)
+            frame({+3, -3, +3, +3, -3, -3, -3, -3});
+
+        for(size_t i = 0; i < 24; i++)
+            symbols.insert(symbols.end(), {+3, +3, +3, +3, +3, +3, -3, +3});
+    }
+    symbols.insert(symbols.end(), 480, 0.0f);
+
+    return symbols;
+}
+
+/**
+ * Upsamples symbols to 96 kHz and shapes them with the root raised cosine
+ * filter of libm17.
+ */
+inline vector<float> rrc_shape(const vector<float> &symbols)
+{
+    vector<float> upsampled(symbols.size()*20, 0.0f);
+    for(size_t i = 0; i < symbols.size(); i++)
+        upsampled[i*20] = symbols[i];
+
+    vector<float> shaped(upsampled.size());
+    for(size_t i = 0; i < shaped.size(); i++)
+    {
+        float acc = 0.0f;
+        for(size_t k = 0; k < 161 && k <= i; k++)
+            acc += rrc_taps_20[k] * upsampled[i-k];
+        shaped[i] = acc;
+    }
+
+    return shaped;
+}
+
+/**
+ * Phase of a 96 kHz FM signal carrying random symbols shaped with the root raised cosine filter, shifted by offset Hz.
+ *
+ * @param n number of samples
+ * @param kf modulation index
+ */
+inline vector<double> fm_phase(size_t n, float kf, float offset, mt19937 &rng)
+{
+    const float levels[4] = {+1, +3, -1, -3};
+    vector<float> symbols((n + 160 + 19)/20);
+    for(auto &sym : symbols)
+        sym = levels[rng() % 4];
+
+    // Skip the delay of the filter
+    vector<float> shaped = rrc_shape(symbols);
+    vector<double> phase(n);
+    double acc = 0.0;
+    for(size_t i = 0; i < n; i++)
+    {
+        acc += 2.0*M_PI*(kf*shaped[i + 160] + offset/96000.0);
+        phase[i] = acc;
+    }
+
+    return phase;
+}
+
+/**
+ * Converts an I/Q sample, full scale 1.0, to the 24 bits samples of the radio
+ */
+inline complex<int32_t> to_s24(complex<double> s)
+{
+    s *= (1 << 23) - 1;
+    return complex<int32_t>(lround(s.real()) & 0xFFFFFF, lround(s.imag()) & 0xFFFFFF);
+}
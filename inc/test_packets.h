@@ -0,0 +1,91 @@
+/****************************************************************************
+ * M17Netd                                                                  *
+ * Copyright (C) 2024 by Morgan Diepart ON4MOD                              *
+ *                       SDR-Engineering SRL                                *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU Affero General Public License as published *
+ * by the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU Affero General Public License for more details.                      *
+ *                                                                          *
+ * You should have received a copy of the GNU Affero General Public License *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    *
+ ****************************************************************************/
+
+
+#pragma once
+
+#include <vector>
+#include <array>
+#include <memory>
+#include <random>
+#include <string_view>
+#include <cmath>
+#include <algorithm>
+#include <m17.h>
+
+#include "m17tx.h"
+
+using namespace std;
+
+/*
+ * Soft frame generator shared by the packet decoding tests
+ */
+
+using frame_t = array<uint16_t, 2*SYM_PER_FRA>;
+
+/**
+ * A frame as output by the demodulator
+ */
+typedef struct
+{
+    int stream;
+    uint16_t sync_word;
+    frame_t frame;
+} rx_frame_t;
+
+/**
+ * Generates the soft frames of a packet of random bytes to dst, with gaussian noise on the soft bits
+ *
+ * @param stream stream of the frames
+ * @param payload if not null, receives the payload expected from m17rx
+ */
+inline vector<rx_frame_t> packet_frames(int stream, const string_view &dst, size_t len, float noise, mt19937 &rng,
+                                        vector<uint8_t> *payload = nullptr)
+{
+    shared_ptr<vector<uint8_t>> ip_pkt = make_shared<vector<uint8_t>>(len);
+    for(auto &b : *ip_pkt)
+        b = rng();
+
+    // The encoder appends the CRC to the bytes, the decoded payload starts with the data type
+    m17tx_pkt tx("ON4MOD-1", dst, ip_pkt);
+    if(payload)
+    {
+        *payload = {0x04};
+        payload->insert(payload->end(), ip_pkt->begin(), ip_pkt->end());
+    }
+    vector<float> symbols = tx.get_symbols();
+
+    // Preamble, LSF, packet frames, EOT
+    normal_distribution<float> awgn(0.0f, noise);
+    vector<rx_frame_t> frames;
+    for(size_t start = SYM_PER_FRA; start + 2*SYM_PER_FRA <= symbols.size(); start += SYM_PER_FRA)
+    {
+        rx_frame_t f = {stream, (start == SYM_PER_FRA) ? SYNC_LSF : SYNC_PKT, {}};
+        for(size_t i = 0; i < SYM_PER_FRA; i++)
+        {
+            float sym = symbols[start + i];
+            float bits[2] = {(sym < 0.0f) ? 1.0f : 0.0f, (fabs(sym) > 2.0f) ? 1.0f : 0.0f};
+            for(size_t b = 0; b < 2; b++)
+                f.frame[2*i+b] = static_cast<uint16_t>(clamp(bits[b] + awgn(rng), 0.0f, 1.0f)*0xFFFF);
+        }
+        frames.push_back(f);
+    }
+
+    return frames;
+}
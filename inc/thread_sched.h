@@ -0,0 +1,77 @@
+/****************************************************************************
+ * M17Netd                                                                  *
+ * Copyright (C) 2024 by Morgan Diepart ON4MOD                              *
+ *                       SDR-Engineering SRL                                *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU Affero General Public License as published *
+ * by the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU Affero General Public License for more details.                      *
+ *                                                                          *
+ * You should have received a copy of the GNU Affero General Public License *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    *
+ ****************************************************************************/
+
+#pragma once
+
+#include <thread>
+#include <string_view>
+
+#include <pthread.h>
+
+#include "config.h"
+
+using namespace std;
+
+/**
+ * Locks all current and future pages of the process in RAM so that the threads never wait on page faults
+ *
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE otherwise
+ */
+int lock_memory();
+
+/**
+ * Applies the CPU affinity and scheduling policy of a thread. A thread that is not configured as SCHED_FIFO is set
+ * back to SCHED_OTHER, whatever it inherited from its parent. Failures are reported but are not fatal.
+ *
+ * @param handle the thread to configure
+ * @param name name of the thread, used in the logs and given to the kernel
+ * @param cfg CPU set and scheduling policy to apply
+ *
+ * @return EXIT_SUCCESS if everything was applied, EXIT_FAILURE otherwise
+ */
+int set_thread_sched(pthread_t handle, const string_view &name, const thread_cfg &cfg);
+
+/**
+ * Applies the CPU affinity and scheduling policy of a thread, see above
+ */
+int set_thread_sched(thread &t, const string_view &name, const thread_cfg &cfg);
+
+/**
+ * Applies the CPU affinity and scheduling policy of the calling thread, see above. Threads call it at entry, before
+ * they create their own threads, so that these inherit the policy configured for their parent.
+ */
+int set_thread_sched(const string_view &name, const thread_cfg &cfg);
+
+/**
+ * Prints the scheduling policy, priority and CPU set actually in use by a thread
+ *
+ * @param handle the thread
+ * @param name name of the thread
+ */
+void print_thread_sched(pthread_t handle, const string_view &name);
+
+/**
+ * Prints the scheduling policy, priority and CPU set actually in use by a thread, see above
+ */
+void print_thread_sched(thread &t, const string_view &name);
+
+/**
+ * Prints the scheduling policy, priority and CPU set actually in use by the calling thread, see above
+ */
+void print_thread_sched(const string_view &name);
@@ -25,7 +25,7 @@
 #include <vector>
 #include <memory>
 
-#include "ConsumerProducer.h"
+#include "SPSCQueue.h"
 #include "config.h"
 #include "m17rx.h"
 
@@ -33,7 +33,7 @@ using namespace std;
 
 class tun_thread {
     public:
-    void operator()(atomic_bool &running, const config &cfg,
-                    ConsumerProducerQueue<shared_ptr<vector<uint8_t>>> &from_net,
-                    ConsumerProducerQueue<shared_ptr<m17rx>> &to_net);
+    void operator()(atomic_bool &running, const config &cfg, const threads_cfg &threads,
+                    SPSCQueue<shared_ptr<vector<uint8_t>>> &from_net,
+                    SPSCQueue<shared_ptr<m17rx>> &to_net);
 };
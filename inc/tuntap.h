@@ -47,6 +47,16 @@ class tun_device {
      */
     int send_packet(const std::vector<uint8_t> &pkt);
 
+    /**
+     * Sends a packet to the TUN interface
+     *
+     * @param pkt the raw IP packet to send
+     * @param len length of the packet in bytes
+     *
+     * @return 0 if successful, -1 in case of error
+     */
+    int send_packet(const uint8_t *pkt, size_t len);
+
     /**
      * Sets the local IP V4 of the tun interface
      *
@@ -0,0 +1,170 @@
+/****************************************************************************
+ * M17Netd                                                                  *
+ * Copyright (C) 2024 by Morgan Diepart ON4MOD                              *
+ *                       SDR-Engineering SRL                                *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU Affero General Public License as published *
+ * by the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU Affero General Public License for more details.                      *
+ *                                                                          *
+ * You should have received a copy of the GNU Affero General Public License *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    *
+ ****************************************************************************/
+
+#pragma once
+
+#include <array>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include <netinet/ip.h>
+
+#include "SPSCQueue.h"
+#include "config.h"
+#include "fq_codel.h"
+#include "m17tx.h"
+
+using namespace std;
+
+/**
+ * Transmit priority classes, from the highest to the lowest priority
+ */
+enum class tx_class : size_t
+{
+    INTERACTIVE = 0,    /** ICMP, TCP handshakes/ACKs/keystrokes, EF and network control */
+    NORMAL,             /** Everything else */
+    BULK,               /** Background traffic (CS1, LE) */
+    COUNT
+};
+
+/**
+ * Sorts IPv4 packets into transmit priority classes
+ */
+class tx_classifier
+{
+    public:
+    tx_classifier(const txsched_cfg &cfg);
+
+    /**
+     * Classifies an IPv4 packet
+     *
+     * @param pkt pointer to the IPv4 header
+     * @param len length of the buffer pointed by pkt
+     *
+     * @return the priority class of the packet
+     */
+    tx_class classify(const struct ip *pkt, size_t len) const;
+
+    private:
+    array<tx_class, 64> dscp_class; /** Class of each DSCP value */
+    size_t small_tcp_len;           /** TCP packets up to this length are interactive */
+};
+
+/**
+ * Multi-class transmit queue between the m17tx thread (producer) and the radio thread (consumer).
+ *
+ * The producer pushes packets in a lock-free ingress ring. The consumer moves them to one FQ-CoDel
+ * queue per class and serves the classes either in strict priority order or with weighted round-robin.
+ * Packets are queued as raw IP datagrams and only encoded to M17 once dequeued, so that CoDel can
+ * still set the ECN bits of the IP header.
+ *
+ * @note add() may only be called from the producer thread, all other functions only from the consumer thread.
+ */
+class tx_scheduler
+{
+    public:
+    static constexpr size_t nb_classes = static_cast<size_t>(tx_class::COUNT);
+
+    typedef struct
+    {
+        array<size_t, nb_classes> sent;     /** Packets handed to the radio, per class */
+        array<size_t, nb_classes> dropped;  /** Packets dropped because their class was full, per class */
+        array<size_t, nb_classes> aqm_dropped; /** Packets dropped by CoDel, per class */
+        array<size_t, nb_classes> aqm_marked;  /** Packets ECN marked by CoDel, per class */
+    } stats_t;
+
+    tx_scheduler(size_t maxSize, const txsched_cfg &cfg, const aqm_cfg &aqm, const string_view &src_callsign);
+
+    /**
+     * Adds a packet to the scheduler
+     *
+     * @param ip_pkt the IPv4 packet to add
+     * @param dst destination callsign
+     * @param cls priority class of the packet
+     *
+     * @return -1 if the attempt timed-out (after 1s), 0 otherwise
+     */
+    int add(shared_ptr<vector<uint8_t>> ip_pkt, const string &dst, tx_class cls);
+
+    /**
+     * Gets the next packet to transmit. Never waits.
+     *
+     * @param pkt the packet in which to store the result
+     *
+     * @return -1 if there is nothing to transmit, the class of the packet otherwise
+     */
+    int consume(shared_ptr<m17tx_pkt> &pkt);
+
+    /**
+     * Check if there is nothing to transmit
+     *
+     * @return true if no packet is waiting, false otherwise
+     */
+    bool isEmpty();
+
+    /**
+     * Get the number of packets waiting to be transmitted
+     *
+     * @return the number of packets in the scheduler
+     */
+    size_t length();
+
+    /**
+     * Returns the per-class counters
+     */
+    const stats_t& get_stats();
+
+    /**
+     * Returns the configuration of the scheduler. The configuration never changes, so it may be read from any thread.
+     */
+    const txsched_cfg& get_config() const;
+
+    private:
+    typedef struct
+    {
+        fq_entry pkt;
+        tx_class cls;
+    } entry_t;
+
+    /**
+     * Moves the packets waiting in the ingress ring to their class queue
+     */
+    void pull();
+
+    /**
+     * Dequeues the next packet of a class and encodes it to M17. Packets that cannot be encoded are dropped.
+     *
+     * @return false if the class has nothing to transmit, true otherwise
+     */
+    bool encode(size_t c, shared_ptr<m17tx_pkt> &pkt, chrono::steady_clock::time_point now);
+
+    SPSCQueue<entry_t>                                  ingress;    /** Packets handed over by the producer */
+    vector<fq_codel>                                    classes;    /** One FQ-CoDel queue per class */
+    string                                              src_callsign; /** Source callsign of the encoded packets */
+    bool                                                weighted;   /** Weighted round-robin or strict priority */
+    array<unsigned, nb_classes>                         weights;    /** Packets per round in weighted mode */
+    array<unsigned, nb_classes>                         credits;    /** Packets left in the current round */
+    size_t                                              current;    /** Class being served in weighted mode */
+    stats_t                                             stats;
+    const txsched_cfg                                   sched_cfg;  /** Configuration, also used by the classifier */
+};
@@ -16,7 +16,7 @@
  *
  * @remark Uses ARM Neon extension if available
  */
-void float_to_int16(const float *input, int16_t *output, const size_t len)
+inline void float_to_int16(const float *input, int16_t *output, const size_t len)
 {
 #ifdef __aarch64__
     const size_t simd_iters = len/4; // How many iters we can do with simd (4 floats per iter)
@@ -132,7 +132,7 @@ void float_to_int32(const float *input, int32_t *output, const size_t len)
  *
  * @remark Uses ARM Neon extension if available
  */
-void int16_to_float(const int16_t *input, float *output, const size_t len)
+inline void int16_to_float(const int16_t *input, float *output, const size_t len)
 {
 #ifdef __aarch64__
     const size_t simd_iters = len/4; // How many iters we can do with simd (4 floats per iter)
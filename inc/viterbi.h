@@ -0,0 +1,66 @@
+/****************************************************************************
+ * M17Netd                                                                  *
+ * Copyright (C) 2024 by Morgan Diepart ON4MOD                              *
+ *                       SDR-Engineering SRL                                *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU Affero General Public License as published *
+ * by the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU Affero General Public License for more details.                      *
+ *                                                                          *
+ * You should have received a copy of the GNU Affero General Public License *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    *
+ ****************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Soft-decision Viterbi decoder of the M17 convolutional code (K=5, rate 1/2), with depuncturing.
+ *
+ * Same trellis, branch metrics, tie-breaking and chainback as viterbi_decode() and viterbi_decode_punctured() of
+ * libm17: the decoded bits and the returned cost are identical. The 16 states are updated at once, 8 butterflies per
+ * step (SSE2 on x86_64, or AVX2 when built with M17NETD_AVX2, NEON on aarch64, scalar otherwise). The state of the decoder lives on the stack, so
+ * that several threads may decode at once, which the static buffers of libm17 do not allow.
+ *
+ * The soft bits are 16 bits unsigned, 0 for a 0 and 0xFFFF for a 1.
+ */
+namespace viterbi
+{
+
+constexpr size_t max_steps = 244;   /** Longest message, in decoded bits including the 4 flushing bits */
+
+/**
+ * Decodes a message that is not punctured
+ *
+ * @param out decoded bits, packed MSB first after a 4 bits offset as libm17 does: the first decoded bit of a message
+ *        starting from state 0 lands on bit 7 of out[1]. Must hold (len/2 + 3)/8 + 1 bytes.
+ * @param in soft bits, two per decoded bit
+ * @param len number of soft bits, at most 2*max_steps. An odd last soft bit is paired with an erasure.
+ *
+ * @return the cost of the best path, sum of the distances between the soft bits and the re-encoded bits
+ */
+uint32_t decode(uint8_t *out, const uint16_t *in, size_t len);
+
+/**
+ * Decodes a punctured message: an erasure (0x7FFF) is inserted for every 0 of the puncturing pattern, then the
+ * message is decoded as by decode()
+ *
+ * @param out decoded bits, see decode()
+ * @param in soft bits
+ * @param punct puncturing pattern, 1 for a transmitted bit, repeated over the message
+ * @param in_len number of soft bits
+ * @param p_len length of the puncturing pattern
+ *
+ * @return the cost of the best path, without the cost of the erasures
+ */
+uint32_t decode_punctured(uint8_t *out, const uint16_t *in, const uint8_t *punct, size_t in_len, size_t p_len);
+
+}
@@ -29,33 +29,52 @@
 #include <m17.h>
 #include <iostream>
 #include <algorithm>
+#include <numeric>
 
 using namespace M17;
 
-M17Demodulator::M17Demodulator()
+template < size_t SAMPLES_PER_SYMBOL >
+M17Demodulator< SAMPLES_PER_SYMBOL >::M17Demodulator()
 {
-    float taps[161];
-    memcpy(taps, rrc_taps_20, 161*sizeof(float));
-    rrcos_filt = firfilt_rrrf_create(taps, 161);
+    auto taps = rrcTaps< SAMPLES_PER_SYMBOL >();
+    rrcos_filt = firfilt_rrrf_create(taps.data(), RRC_TAPS);
 
+    // The fixed-point filter memory is read oldest sample first
+    rrcFixedTaps.fill(0);
+    for(size_t i = 0; i < RRC_TAPS; i++)
+        rrcFixedTaps[i] = static_cast< int16_t >(std::lrint(taps[RRC_TAPS - 1 - i] * (1 << RRC_TAPS_FRAC_BITS)));
+
+    timingRecovery = true;
+
+    // Samples are scaled by 500 after the RRC, see filter()
+    offsetScale = 500.0f * std::accumulate(taps.begin(), taps.end(), 0.0f);
+    baseOffset  = 0;
+
+    framePool = nullptr;
 }
 
-M17Demodulator::~M17Demodulator()
+template < size_t SAMPLES_PER_SYMBOL >
+M17Demodulator< SAMPLES_PER_SYMBOL >::~M17Demodulator()
 {
     terminate();
     firfilt_rrrf_destroy(rrcos_filt);
 }
 
-void M17Demodulator::init()
+template < size_t SAMPLES_PER_SYMBOL >
+void M17Demodulator< SAMPLES_PER_SYMBOL >::setFramePool(frame_pool *pool)
+{
+    framePool = pool;
+}
+
+template < size_t SAMPLES_PER_SYMBOL >
+void M17Demodulator< SAMPLES_PER_SYMBOL >::init()
 {
     /*
-     * Allocate a chunk of memory to contain two complete buffers for baseband
-     * audio. Split this chunk in two separate blocks for double buffering using
-     * placement new.
+     * Two frame buffers for double buffering, from the pool if any.
      */
 
-    demodFrame      = std::make_unique< m17frame_t >();
-    readyFrame      = std::make_unique< m17frame_t >();
+    demodFrame      = framePool ? framePool->acquire() : frame_pool::allocate();
+    readyFrame      = framePool ? framePool->acquire() : frame_pool::allocate();
 
     reset();
 
@@ -87,7 +106,8 @@ void M17Demodulator::init()
 #endif
 }
 
-void M17Demodulator::terminate()
+template < size_t SAMPLES_PER_SYMBOL >
+void M17Demodulator< SAMPLES_PER_SYMBOL >::terminate()
 {
     demodFrame.reset();
     readyFrame.reset();
@@ -108,14 +128,24 @@ void M17Demodulator::terminate()
 #endif
 }
 
-const M17::m17frame_t& M17Demodulator::getFrame()
+template < size_t SAMPLES_PER_SYMBOL >
+const M17::m17frame_t& M17Demodulator< SAMPLES_PER_SYMBOL >::getFrame()
 {
     // When a frame is read is not new anymore
     newFrame = false;
     return *readyFrame;
 }
 
-const m17syncw_t M17Demodulator::getFrameSyncWord() const
+template < size_t SAMPLES_PER_SYMBOL >
+frame_pool::frame_ptr M17Demodulator< SAMPLES_PER_SYMBOL >::takeFrame()
+{
+    // The buffer is replaced when the next frame is complete
+    newFrame = false;
+    return std::move(readyFrame);
+}
+
+template < size_t SAMPLES_PER_SYMBOL >
+const m17syncw_t M17Demodulator< SAMPLES_PER_SYMBOL >::getFrameSyncWord() const
 {
     switch(lastSyncWord)
     {
@@ -136,17 +166,61 @@ const m17syncw_t M17Demodulator::getFrameSyncWord() const
     }
 }
 
-bool M17Demodulator::isLocked() const
+template < size_t SAMPLES_PER_SYMBOL >
+bool M17Demodulator< SAMPLES_PER_SYMBOL >::isLocked() const
 {
     return locked;
 }
 
-int M17Demodulator::update(float *samples, const size_t N)
+template < size_t SAMPLES_PER_SYMBOL >
+const typename M17Demodulator< SAMPLES_PER_SYMBOL >::timing_stats_t& M17Demodulator< SAMPLES_PER_SYMBOL >::getFrameTiming() const
+{
+    return frameTiming;
+}
+
+template < size_t SAMPLES_PER_SYMBOL >
+void M17Demodulator< SAMPLES_PER_SYMBOL >::setTimingRecovery(const bool enable)
+{
+    timingRecovery = enable;
+    timing         = 0.0f;
+    timingDrift    = 0.0f;
+}
+
+template < size_t SAMPLES_PER_SYMBOL >
+float M17Demodulator< SAMPLES_PER_SYMBOL >::getFrequencyOffset() const
+{
+    return freqOffset / offsetScale;
+}
+
+template < size_t SAMPLES_PER_SYMBOL >
+void M17Demodulator< SAMPLES_PER_SYMBOL >::setFrequencyOffset(const float offset)
+{
+    baseOffset = static_cast< int32_t >(std::lrint(offset * offsetScale));
+
+    if(demodState == DemodState::UNLOCKED)
+        freqOffset = baseOffset;
+}
+
+template < size_t SAMPLES_PER_SYMBOL >
+int M17Demodulator< SAMPLES_PER_SYMBOL >::update(const float *samples, const size_t N)
+{
+    return run(samples, N);
+}
+
+template < size_t SAMPLES_PER_SYMBOL >
+int M17Demodulator< SAMPLES_PER_SYMBOL >::update(const int16_t *samples, const size_t N)
+{
+    return run(samples, N);
+}
+
+template < size_t SAMPLES_PER_SYMBOL >
+template < typename T >
+int M17Demodulator< SAMPLES_PER_SYMBOL >::run(const T *samples, const size_t N)
 {
     if(samples != nullptr)
     {
 #if M17DEMOD_DEBUG_OUT
-        post_demod.write(reinterpret_cast<const char*>(samples), N*sizeof(float));
+        post_demod.write(reinterpret_cast<const char*>(samples), N*sizeof(T));
 #endif
 
         if(demodState == DemodState::UNLOCKED)
@@ -154,350 +228,654 @@ int M17Demodulator::update(float *samples, const size_t N)
             lastSyncWord = SyncWord::NONE;
         }
 
-        // Apply RRC on the baseband sample
-        firfilt_rrrf_execute_block(rrcos_filt, samples, N, samples);
+        // The INIT and LOCKED states are handled over runs of samples, the
+        // other ones sample by sample.
+        size_t i = 0;
+        while(i < N)
+        {
+            switch(demodState)
+            {
+                case DemodState::INIT:
+                    i += initRun(&samples[i], N - i);
+                    break;
+                case DemodState::LOCKED:
+                    i += lockedRun(&samples[i], N - i);
+                    break;
+                default:
+                    step(filter(samples[i++]));
+                    break;
+            }
+        }
+    }
+
+    return (lastSyncWord==SyncWord::EOT)?-1:newFrame;
+}
+
+template < size_t SAMPLES_PER_SYMBOL >
+int16_t M17Demodulator< SAMPLES_PER_SYMBOL >::filter(const float sample)
+{
+    float out;
+
+    // Apply RRC on the baseband sample
+    firfilt_rrrf_push(rrcos_filt, sample);
+    firfilt_rrrf_execute(rrcos_filt, &out);
 #if M17DEMOD_DEBUG_OUT
-        post_rrcos.write(reinterpret_cast<const char *>(samples), N*sizeof(float));
+    post_rrcos.write(reinterpret_cast<const char *>(&out), sizeof(float));
 #endif
-        // Process samples
-        for(size_t i = 0; i < N; i++)
+
+    // Scale up and remove the carrier frequency offset
+    int32_t scaled = static_cast<int32_t>(out*500) - freqOffset;
+    return static_cast<int16_t>(std::clamp<int32_t>(scaled, INT16_MIN, INT16_MAX));
+}
+
+template < size_t SAMPLES_PER_SYMBOL >
+int16_t M17Demodulator< SAMPLES_PER_SYMBOL >::filter(const int16_t sample)
+{
+    rrcLine.sample(sample);
+    int64_t out = rrcLine.template full_convolve_raw< 1 >({rrcFixedTaps.data()})[0];
+
+    // Same scaling as the float filter, then remove the carrier frequency offset
+    int64_t scaled = ((out * 500) >> RRC_FIXED_SHIFT) - freqOffset;
+    return static_cast<int16_t>(std::clamp<int64_t>(scaled, INT16_MIN, INT16_MAX));
+}
+
+template < size_t SAMPLES_PER_SYMBOL >
+void M17Demodulator< SAMPLES_PER_SYMBOL >::push(const float sample)
+{
+    firfilt_rrrf_push(rrcos_filt, sample);
+}
+
+template < size_t SAMPLES_PER_SYMBOL >
+void M17Demodulator< SAMPLES_PER_SYMBOL >::push(const int16_t sample)
+{
+    rrcLine.sample(sample);
+}
+
+template < size_t SAMPLES_PER_SYMBOL >
+template < typename T >
+size_t M17Demodulator< SAMPLES_PER_SYMBOL >::initRun(const T *samples, const size_t n)
+{
+    size_t count = std::min< size_t >(initCount, n);
+
+    // Only the samples that will still be in the correlator memory when the
+    // initialization ends are filtered.
+    for(size_t i = 0; i < count; i++)
+    {
+        if(M17DEMOD_DEBUG_OUT || (initCount - i) <= correlator.bufferSize())
+        {
+            correlator.sample(filter(samples[i]));
+        }
+        else
         {
+            push(samples[i]);
+            correlator.skip();
+        }
+    }
+
+    sampleIndex = (sampleIndex + count) % SAMPLES_PER_SYMBOL;
+    initCount  -= count;
 #if M17DEMOD_DEBUG_OUT
-            total_cnt++;
+    total_cnt  += count;
 #endif
-            int16_t sample = static_cast<int16_t>(samples[i]*500); // Scale up
 
-            // Update correlator and sample filter for correlation thresholds
+    if(initCount == 0)
+    {
+        demodState = DemodState::UNLOCKED;
+        cout << "M17 Demodulator: Unlocked" << endl;
+    }
+
+    return count;
+}
+
+template < size_t SAMPLES_PER_SYMBOL >
+template < typename T >
+size_t M17Demodulator< SAMPLES_PER_SYMBOL >::lockedRun(const T *samples, const size_t n)
+{
+    // Syncpoint update starts at the sampling point that brings frameIndex to
+    // the last syncword-long part of the frame.
+    constexpr size_t syncUpdateIndex = 2*M17_FRAME_SYMBOLS - M17_SYNCWORD_SYMBOLS;
+    size_t bitsLeft = (2*M17_FRAME_SYMBOLS + syncUpdateIndex - frameIndex) % (2*M17_FRAME_SYMBOLS);
+    if(bitsLeft == 0)
+        bitsLeft = 2*M17_FRAME_SYMBOLS;
+
+    size_t symbolsLeft = bitsLeft/2;
+
+    // Symbols are interpolated between the four samples around them, the
+    // midpoints between symbols, which only steer the timing loop, linearly
+    // between the two samples around them.
+    int32_t symOffset = static_cast< int32_t >(std::floor(timing));
+    int32_t midOffset = static_cast< int32_t >(std::floor(timing - SAMPLES_PER_SYMBOL/2.0f));
+
+    for(size_t i = 0; i < n; i++)
+    {
+#if M17DEMOD_DEBUG_OUT
+        total_cnt++;
+#endif
+        // A symbol is sampled once its nominal sampling point has been passed
+        // in LOCKED state, the ones passed before were already quantized.
+        if(sampleIndex == 0)
+            symbolDue = true;
+
+        size_t symPos = (sampleIndex + SAMPLES_PER_SYMBOL + 1 - symOffset) % SAMPLES_PER_SYMBOL;
+        size_t midPos = (sampleIndex + SAMPLES_PER_SYMBOL - midOffset) % SAMPLES_PER_SYMBOL;
+
+        // Only the samples around the sampling points and the midpoints, and
+        // the ones that will be in the correlator memory when the syncword
+        // search starts, are filtered.
+        if(M17DEMOD_DEBUG_OUT || symPos <= 3 || midPos <= 1 ||
+           symbolsLeft <= M17_SYNCWORD_SYMBOLS + 1)
+        {
+            int16_t sample = filter(samples[i]);
             correlator.sample(sample);
-            int32_t syncThresh = 280000;
+            std::copy(interpWindow.begin() + 1, interpWindow.end(), interpWindow.begin());
+            interpWindow[3] = sample;
 
-            switch(demodState)
+            if(midPos == 1)
             {
-                case DemodState::INIT:
+                float mu  = timing - SAMPLES_PER_SYMBOL/2.0f - midOffset;
+                midSample = interpWindow[2] + mu*(interpWindow[3] - interpWindow[2]);
+                midValid  = symbolValid;
+            }
+
+            // Quantize and update frame at each sampling point
+            if(symPos == 3 && symbolDue)
+            {
+                symbolDue = false;
+                float symbol = interpolate(timing - symOffset);
+                updateFrame(static_cast< int16_t >(std::clamp(std::lrint(symbol), -32768L, 32767L)));
+                symbolsLeft--;
+
+                if(timingRecovery)
                 {
-                    initCount -= 1;
-                    if(initCount == 0){
-                        demodState = DemodState::UNLOCKED;
-                        cout << "M17 Demodulator: Unlocked" << endl;
-                    }
+                    trackTiming(symbol);
+                    symOffset = static_cast< int32_t >(std::floor(timing));
+                    midOffset = static_cast< int32_t >(std::floor(timing - SAMPLES_PER_SYMBOL/2.0f));
                 }
-                    break;
-                case DemodState::UNLOCKED:
+
+                // When we have reached almost the end of a frame, switch
+                // to syncpoint update.
+                if(frameIndex == syncUpdateIndex)
                 {
-                    static int waiting = 2500;
-                    lsfSync.update(correlator, syncThresh, -syncThresh);
-                    packetSync.update(correlator, syncThresh, -syncThresh);
+                    demodState  = DemodState::SYNC_UPDATE;
+                    syncCount   = SYNCWORD_SAMPLES * 2;
+                    sampleIndex = (sampleIndex + 1) % SAMPLES_PER_SYMBOL;
+                    //cout << "M17 Demodulator: Locked -> Sync Update" << endl;
+                    return i + 1;
+                }
+            }
+        }
+        else
+        {
+            push(samples[i]);
+            correlator.skip();
+        }
+
+        sampleIndex = (sampleIndex + 1) % SAMPLES_PER_SYMBOL;
+    }
+
+    return n;
+}
+
+template < size_t SAMPLES_PER_SYMBOL >
+float M17Demodulator< SAMPLES_PER_SYMBOL >::interpolate(const float mu) const
+{
+    const float xm1 = interpWindow[0];
+    const float x0  = interpWindow[1];
+    const float x1  = interpWindow[2];
+    const float x2  = interpWindow[3];
+
+    const float c1 = x1 - xm1/3.0f - x0/2.0f - x2/6.0f;
+    const float c2 = (xm1 + x1)/2.0f - x0;
+    const float c3 = (x2 - xm1)/6.0f + (x0 - x1)/2.0f;
+
+    return ((c3*mu + c2)*mu + c1)*mu + x0;
+}
 
+template < size_t SAMPLES_PER_SYMBOL >
+void M17Demodulator< SAMPLES_PER_SYMBOL >::trackTiming(const float symbol)
+{
+    if(symbolValid && midValid)
+    {
+        // Gardner detector, normalized by the outer symbol deviation and
+        // converted to samples: positive when sampling late.
+        float dev   = static_cast< float >(outerDeviation.first - outerDeviation.second)/2.0f;
+        float error = midSample * (symbol - lastSymbol) / (dev * dev);
+        error *= SAMPLES_PER_SYMBOL / TED_GAIN;
+
+        timingDrift -= TIMING_KI * error;
+        float correction = std::clamp(timingDrift - TIMING_KP * error, -0.25f, 0.25f);
+        timing += correction;
+
+        timingErrSum  += error;
+        timingCorrSum += correction;
+        timingCount   += 1;
+    }
+
+    lastSymbol  = symbol;
+    symbolValid = true;
+    midValid    = false;
+
+    // Keep the fractional sampling point around the nominal one, moving the
+    // nominal one by a whole sample when needed.
+    if(timing >= 0.5f)
+    {
+        timing     -= 1.0f;
+        sampleIndex = (sampleIndex + SAMPLES_PER_SYMBOL - 1) % SAMPLES_PER_SYMBOL;
+    }
+    else if(timing < -0.5f)
+    {
+        timing     += 1.0f;
+        sampleIndex = (sampleIndex + 1) % SAMPLES_PER_SYMBOL;
+    }
+}
+
+template < size_t SAMPLES_PER_SYMBOL >
+void M17Demodulator< SAMPLES_PER_SYMBOL >::step(const int16_t sample)
+{
 #if M17DEMOD_DEBUG_OUT
-                    // Write corr value to file
-                    float lsf_corr_val = static_cast<float>(lsfSync.getLastCorr())/100000;
-                    float pkt_corr_val = static_cast<float>(packetSync.getLastCorr())/100000;
-                    float st = static_cast<float>(syncThresh)/100000;
-                    float tmp = total_cnt;
-                    lsf_corr.write(reinterpret_cast<const char*>(&tmp), 4);
-                    lsf_corr.write(reinterpret_cast<const char*>(&lsf_corr_val), 4);
-                    pkt_corr.write(reinterpret_cast<const char*>(&tmp), 4);
-                    pkt_corr.write(reinterpret_cast<const char*>(&pkt_corr_val), 4);
-                    sync_thresh.write(reinterpret_cast<const char*>(&tmp), 4);
-                    sync_thresh.write(reinterpret_cast<const char*>(&st), 4);
+    total_cnt++;
 #endif
-                    if( abs(lsfSync.getLastCorr()) < 90000 )
-                        waiting--;
-                    else
-                        waiting = 2500;
 
-                    if(waiting <= 0)
-                    {
-                        demodState = DemodState::ARMED;
-                        waiting = 2500;
-                    }
+    // Update correlator and sample filter for correlation thresholds
+    correlator.sample(sample);
+    std::copy(interpWindow.begin() + 1, interpWindow.end(), interpWindow.begin());
+    interpWindow[3] = sample;
+    int32_t syncThresh = SYNC_THRESHOLD;
 
+    // Compute all the syncword correlations in one pass when looking for syncwords
+    if(demodState == DemodState::UNLOCKED || demodState == DemodState::ARMED ||
+       demodState == DemodState::SYNC_UPDATE)
+    {
+        syncBank.update(correlator);
+    }
 
-                }
-                    break;
-                case DemodState::ARMED:
-                {
-                    int8_t lsfSyncStatus = lsfSync.update(correlator, syncThresh, -syncThresh);
-                    int8_t bertSyncStatus = -packetSync.update(correlator, syncThresh, -syncThresh);
+    switch(demodState)
+    {
+        case DemodState::INIT:
+        {
+            initCount -= 1;
+            if(initCount == 0){
+                demodState = DemodState::UNLOCKED;
+                cout << "M17 Demodulator: Unlocked" << endl;
+            }
+        }
+            break;
+        case DemodState::UNLOCKED:
+        {
+            lsfSync.update(syncBank[Bank::LSF], correlator.index(), syncThresh, -syncThresh);
+            packetSync.update(syncBank[Bank::PACKET], correlator.index(), syncThresh, -syncThresh);
 
 #if M17DEMOD_DEBUG_OUT
-                    // Write corr value to file
-                    float lsf_corr_val = static_cast<float>(lsfSync.getLastCorr())/100000;
-                    float pkt_corr_val = static_cast<float>(packetSync.getLastCorr())/100000;
-                    float st = static_cast<float>(syncThresh)/100000;
-                    float tmp = total_cnt;
-                    lsf_corr.write(reinterpret_cast<const char*>(&tmp), 4);
-                    lsf_corr.write(reinterpret_cast<const char*>(&lsf_corr_val), 4);
-                    pkt_corr.write(reinterpret_cast<const char*>(&tmp), 4);
-                    pkt_corr.write(reinterpret_cast<const char*>(&pkt_corr_val), 4);
-                    sync_thresh.write(reinterpret_cast<const char*>(&tmp), 4);
-                    sync_thresh.write(reinterpret_cast<const char*>(&st), 4);
+            // Write corr value to file
+            float lsf_corr_val = static_cast<float>(lsfSync.getLastCorr())/100000;
+            float pkt_corr_val = static_cast<float>(packetSync.getLastCorr())/100000;
+            float st = static_cast<float>(syncThresh)/100000;
+            float tmp = total_cnt;
+            lsf_corr.write(reinterpret_cast<const char*>(&tmp), 4);
+            lsf_corr.write(reinterpret_cast<const char*>(&lsf_corr_val), 4);
+            pkt_corr.write(reinterpret_cast<const char*>(&tmp), 4);
+            pkt_corr.write(reinterpret_cast<const char*>(&pkt_corr_val), 4);
+            sync_thresh.write(reinterpret_cast<const char*>(&tmp), 4);
+            sync_thresh.write(reinterpret_cast<const char*>(&st), 4);
 #endif
+            if( abs(lsfSync.getLastCorr()) < PREAMBLE_THRESHOLD )
+                preambleWait--;
+            else
+                preambleWait = PREAMBLE_SAMPLES;
 
-                    if(lsfSyncStatus == 1)
-                    {
-                        //cout << "Found LSF. Unlocked -> Synced" << endl;
-                        lastSyncWord = SyncWord::LSF;
-                        demodState = DemodState::SYNCED;
-                    }
-                    else if(bertSyncStatus == 1)
-                    {
-                        lastSyncWord = SyncWord::BERT;
-                        demodState = DemodState::SYNCED;
-                    }
-                }
-                    break;
+            if(preambleWait <= 0)
+            {
+                demodState = DemodState::ARMED;
+                preambleWait = PREAMBLE_SAMPLES;
 
-                case DemodState::SYNCED:
-                {
-                    // Set sampling point and deviation, zero frame symbol count
-                    size_t peak = 0;
-                    if(lastSyncWord == SyncWord::LSF)
-                    {
-                        peak = lsfSync.samplingIndex();
+                // The +3/-3 preamble averages to the carrier frequency offset
+                // over an even number of symbols.
+                freqOffset    += correlator.average(SYNCWORD_SAMPLES);
+                preambleCount  = SYNCWORD_SAMPLES;
+            }
 
-                    }
-                    else if(lastSyncWord == SyncWord::BERT)
-                    {
-                        peak = packetSync.samplingIndex();
-                    }
-                    else
-                    {
-                        cerr << "Unknown lastSyncWord" << endl;
-                    }
 
-                    outerDeviation = correlator.maxDeviation(peak);
-                    int32_t devSpacing = (outerDeviation.first-outerDeviation.second)/3;
-                    innerDeviation.first = outerDeviation.first - devSpacing; // Deviation for +1
-                    innerDeviation.second = outerDeviation.second + devSpacing; // deviation for -1
-                    frameIndex = 0;
+        }
+            break;
+        case DemodState::ARMED:
+        {
+            int8_t lsfSyncStatus = lsfSync.update(syncBank[Bank::LSF], correlator.index(), syncThresh, -syncThresh);
+            int8_t bertSyncStatus = -packetSync.update(syncBank[Bank::PACKET], correlator.index(), syncThresh, -syncThresh);
+
+            // Measure the frequency offset again on every syncword-long part
+            // of the preamble, the last one is the closest to the LSF.
+            if( abs(lsfSync.getLastCorr()) < PREAMBLE_THRESHOLD )
+                preambleCount--;
+            else
+                preambleCount = SYNCWORD_SAMPLES;
 
-                    // correlator.index() is the index where the last sample was written in correlator memory
-                    // samplingPoint is the index where the peak correlation occured
-                    size_t shift = (correlator.index() + correlator.bufferSize() - peak) % correlator.bufferSize(); // how many samples ago was the peak found
+            if(preambleCount <= 0)
+            {
+                freqOffset    += correlator.average(SYNCWORD_SAMPLES);
+                preambleCount  = SYNCWORD_SAMPLES;
+            }
 
 #if M17DEMOD_DEBUG_OUT
-                    size_t tmp = total_cnt; // Save current total_cnt
-                    total_cnt -= (SYNCWORD_SAMPLES + shift - SAMPLES_PER_SYMBOL);
+            // Write corr value to file
+            float lsf_corr_val = static_cast<float>(lsfSync.getLastCorr())/100000;
+            float pkt_corr_val = static_cast<float>(packetSync.getLastCorr())/100000;
+            float st = static_cast<float>(syncThresh)/100000;
+            float tmp = total_cnt;
+            lsf_corr.write(reinterpret_cast<const char*>(&tmp), 4);
+            lsf_corr.write(reinterpret_cast<const char*>(&lsf_corr_val), 4);
+            pkt_corr.write(reinterpret_cast<const char*>(&tmp), 4);
+            pkt_corr.write(reinterpret_cast<const char*>(&pkt_corr_val), 4);
+            sync_thresh.write(reinterpret_cast<const char*>(&tmp), 4);
+            sync_thresh.write(reinterpret_cast<const char*>(&st), 4);
 #endif
 
-                    // Quantize the syncword taking data from the correlator memory.
-                    for(ssize_t i = -(SYNCWORD_SAMPLES-SAMPLES_PER_SYMBOL); i <= 0; i += SAMPLES_PER_SYMBOL)
-                    {
-                        ssize_t  pos = (peak + correlator.bufferSize() + i) % correlator.bufferSize();
+            if(lsfSyncStatus == 1)
+            {
+                //cout << "Found LSF. Unlocked -> Synced" << endl;
+                lastSyncWord = SyncWord::LSF;
+                demodState = DemodState::SYNCED;
+            }
+            else if(bertSyncStatus == 1)
+            {
+                lastSyncWord = SyncWord::BERT;
+                demodState = DemodState::SYNCED;
+            }
+        }
+            break;
 
-                        int16_t val = correlator.data()[pos];
+        case DemodState::SYNCED:
+        {
+            // Set sampling point and deviation, zero frame symbol count
+            size_t peak = 0;
+            if(lastSyncWord == SyncWord::LSF)
+            {
+                peak = lsfSync.samplingIndex();
 
-                        updateFrame(val);
+            }
+            else if(lastSyncWord == SyncWord::BERT)
+            {
+                peak = packetSync.samplingIndex();
+            }
+            else
+            {
+                cerr << "Unknown lastSyncWord" << endl;
+            }
+
+            outerDeviation = correlator.maxDeviation(peak);
+            int32_t devSpacing = (outerDeviation.first-outerDeviation.second)/3;
+            innerDeviation.first = outerDeviation.first - devSpacing; // Deviation for +1
+            innerDeviation.second = outerDeviation.second + devSpacing; // deviation for -1
+            frameIndex = 0;
+
+            // New transmission, restart the noise estimate
+            noiseVar = static_cast< float >(devSpacing * devSpacing) / 16.0f;
+            noiseSum = 0;
+            buildQuantizer();
+
+            // correlator.index() is the index where the last sample was written in correlator memory
+            // samplingPoint is the index where the peak correlation occured
+            size_t shift = (correlator.index() + correlator.bufferSize() - peak) % correlator.bufferSize(); // how many samples ago was the peak found
 
 #if M17DEMOD_DEBUG_OUT
-                        total_cnt += SAMPLES_PER_SYMBOL;
+            size_t tmp = total_cnt; // Save current total_cnt
+            total_cnt -= (SYNCWORD_SAMPLES + shift - SAMPLES_PER_SYMBOL);
 #endif
-                    }
+
+            // Quantize the syncword taking data from the correlator memory.
+            for(ssize_t i = -(SYNCWORD_SAMPLES-SAMPLES_PER_SYMBOL); i <= 0; i += SAMPLES_PER_SYMBOL)
+            {
+                ssize_t  pos = (peak + correlator.bufferSize() + i) % correlator.bufferSize();
+
+                int16_t val = correlator.data()[pos];
+
+                updateFrame(val);
 
 #if M17DEMOD_DEBUG_OUT
-                    total_cnt = tmp;
+                total_cnt += SAMPLES_PER_SYMBOL;
 #endif
+            }
 
-                    float hd;
-                    if(lastSyncWord == SyncWord::LSF)
-                    {
-                        hd = softHammingDistance( 16, demodFrame->data(), SOFT_LSF_SYNC_WORD.data());
-                    }
-                    else if(lastSyncWord == SyncWord::BERT)
-                    {
-                        hd = softHammingDistance( 16, demodFrame->data(), SOFT_BERT_SYNC_WORD.data());
-                    }
-                    else
-                    {
-                        cerr << "Unknown lastSyncWord" << endl;
-                        hd = +INFINITY;
-                    }
+#if M17DEMOD_DEBUG_OUT
+            total_cnt = tmp;
+#endif
+
+            float hd;
+            if(lastSyncWord == SyncWord::LSF)
+            {
+                hd = softHammingDistance( 16, demodFrame->data(), SOFT_LSF_SYNC_WORD.data());
+            }
+            else if(lastSyncWord == SyncWord::BERT)
+            {
+                hd = softHammingDistance( 16, demodFrame->data(), SOFT_BERT_SYNC_WORD.data());
+            }
+            else
+            {
+                cerr << "Unknown lastSyncWord" << endl;
+                hd = +INFINITY;
+            }
+
+            if(hd <= 3)
+            {
+                trackOffset((outerDeviation.first + outerDeviation.second)/2);
+                locked     = true;
+                demodState = DemodState::LOCKED;
+                sampleIndex = shift;
+
+                // New transmission, restart symbol timing tracking
+                missedSyncs   = 0;
+                timing        = 0.0f;
+                timingDrift   = 0.0f;
+                symbolValid   = false;
+                symbolDue     = false;
+                timingErrSum  = 0.0f;
+                timingCorrSum = 0.0f;
+                timingCount   = 0;
+                cout << "M17Demodulator: Received " << ((lastSyncWord == SyncWord::LSF)? "LSF":"BERT") << " sync with hd=" << hd << ": Synced -> Locked" << endl;
+            }
+            else
+            {
+                demodState = DemodState::UNLOCKED;
+                freqOffset = baseOffset;
+                //cout << "M17Demodulator: LSF sync not recognized. hd=" << hd << ", Synced -> Unlocked" << endl;
+            }
+        }
+            break;
+
+        case DemodState::LOCKED:
+        {
+            // Quantize and update frame at each sampling point
+            if(sampleIndex == 0)
+            {
+                updateFrame(sample);
+
+                // When we have reached almost the end of a frame, switch
+                // to syncpoint update.
+                if(frameIndex == (2*M17_FRAME_SYMBOLS - M17_SYNCWORD_SYMBOLS))
+                {
+                    demodState = DemodState::SYNC_UPDATE;
+                    syncCount  = SYNCWORD_SAMPLES * 2;
+                    //cout << "M17 Demodulator: Locked -> Sync Update" << endl;
+                }
+            }
+        }
+            break;
 
+        case DemodState::SYNC_UPDATE:
+        {
+            // Keep filling the ongoing frame!
+            if(sampleIndex == 0)
+                updateFrame(sample);
+
+            int8_t  packetSyncStatus = packetSync.update(syncBank[Bank::PACKET], correlator.index(), syncThresh, -syncThresh);
+            int8_t  eotSyncStatus = EOTSync.update(syncBank[Bank::EOT], correlator.index(), syncThresh, syncThresh);
+
+#if M17DEMOD_DEBUG_OUT
+            // Write corr value to file
+            float pkt = static_cast<float>(packetSync.getLastCorr())/100000;
+            float eot = static_cast<float>(EOTSync.getLastCorr())/100000;
+            float tmp = total_cnt;
+            pkt_corr.write(reinterpret_cast<const char*>(&tmp), 4);
+            pkt_corr.write(reinterpret_cast<const char*>(&pkt), 4);
+            eot_corr.write(reinterpret_cast<const char*>(&tmp), 4);
+            eot_corr.write(reinterpret_cast<const char*>(&eot), 4);
+#endif
+
+            // Correlation has to coincide with a syncword!
+            if(frameIndex == M17_SYNCWORD_SYMBOLS*2)
+            {
+                // Find the new correlation peak
+
+                if(packetSyncStatus == 1)
+                {
+                    float hd  = softHammingDistance(16, demodFrame->data(), SOFT_PACKET_SYNC_WORD.data());
+
+                    // Valid sync found: update deviation and sample
+                    // point, then go back to locked state
                     if(hd <= 3)
                     {
-                        locked     = true;
-                        demodState = DemodState::LOCKED;
-                        sampleIndex = shift;
-                        cout << "M17Demodulator: Received " << ((lastSyncWord == SyncWord::LSF)? "LSF":"BERT") << " sync with hd=" << hd << ": Synced -> Locked" << endl;
+                        size_t pkt_peak = packetSync.samplingIndex();
+                        outerDeviation = correlator.maxDeviation(pkt_peak);
+                        int32_t devSpacing = (outerDeviation.first-outerDeviation.second)/3;
+                        innerDeviation.first = outerDeviation.first-devSpacing; // Deviation for +1
+                        innerDeviation.second = outerDeviation.second + devSpacing; // deviation for -1
+                        trackOffset((outerDeviation.first + outerDeviation.second)/2);
+                        cout << "pkt_peak=" << pkt_peak << ", correlator.index()=" << correlator.index() << endl;
+                        sampleIndex = (correlator.index() - pkt_peak);
+
+                        if(sampleIndex > correlator.bufferSize())
+                            sampleIndex += correlator.bufferSize();
+
+                        missedSyncs    = 0;
+                        demodState     = DemodState::LOCKED;
+                        timing         = 0.0f;
+                        symbolValid    = false;
+                        symbolDue      = false;
+                        lastSyncWord   = SyncWord::PACKET;
+                        //cout << "M17 Demodulator: Received packet sync: Sync Update -> Locked" << endl;
+                        break;
                     }
-                    else
+                }
+                else if(packetSyncStatus == -1)
+                {
+                    float hd  = softHammingDistance(16, demodFrame->data(), SOFT_BERT_SYNC_WORD.data());
+
+                    // Valid sync found: update deviation and sample
+                    // point, then go back to locked state
+                    if(hd <= 3)
                     {
-                        demodState = DemodState::UNLOCKED;
-                        //cout << "M17Demodulator: LSF sync not recognized. hd=" << hd << ", Synced -> Unlocked" << endl;
+                        size_t bert_peak = packetSync.samplingIndex();
+                        outerDeviation = correlator.maxDeviation(bert_peak);
+                        int32_t devSpacing = (outerDeviation.first-outerDeviation.second)/3;
+                        innerDeviation.first = outerDeviation.first-devSpacing; // Deviation for +1
+                        innerDeviation.second = outerDeviation.second + devSpacing; // deviation for -1
+                        trackOffset((outerDeviation.first + outerDeviation.second)/2);
+                        //cout << "bert_peak=" << bert_peak << ", correlator.index()=" << correlator.index() << endl;
+                        sampleIndex = (correlator.index() - bert_peak);
+
+                        if(sampleIndex > correlator.bufferSize())
+                            sampleIndex += correlator.bufferSize();
+
+                        missedSyncs    = 0;
+                        demodState     = DemodState::LOCKED;
+                        timing         = 0.0f;
+                        symbolValid    = false;
+                        symbolDue      = false;
+                        lastSyncWord   = SyncWord::BERT;
+                        //cout << "M17 Demodulator: Received bert sync: Sync Update -> Locked" << endl;
+                        break;
                     }
                 }
-                    break;
-
-                case DemodState::LOCKED:
+                else if(eotSyncStatus == 1)
                 {
-                    // Quantize and update frame at each sampling point
-                    if(sampleIndex == 0)
+                    float hd  = softHammingDistance(16, demodFrame->data(), SOFT_EOT_SYNC_WORD.data());
+
+                    // Valid EOT sync found: unlock demodulator
+                    if(hd <= 3)
                     {
-                        updateFrame(sample);
-
-                        // When we have reached almost the end of a frame, switch
-                        // to syncpoint update.
-                        if(frameIndex == (2*M17_FRAME_SYMBOLS - M17_SYNCWORD_SYMBOLS))
-                        {
-                            demodState = DemodState::SYNC_UPDATE;
-                            syncCount  = SYNCWORD_SAMPLES * 2;
-                            //cout << "M17 Demodulator: Locked -> Sync Update" << endl;
-                        }
+                        missedSyncs = 0;
+                        demodState     = DemodState::UNLOCKED;
+                        locked = false;
+                        freqOffset = baseOffset;
+                        lastSyncWord = SyncWord::EOT;
+                        cout << "M17Demodulator: Received EOT sync: -> Unlocked" << endl;
+                        break;
                     }
                 }
-                    break;
+            }
 
-                case DemodState::SYNC_UPDATE:
+            // No syncword found within the window, increase the count
+            // of missed syncs and choose where to go. The lock is lost
+            // after four consecutive sync misses.
+            if(syncCount == 0)
+            {
+                if(missedSyncs >= 4)
                 {
-                    // Keep filling the ongoing frame!
-                    if(sampleIndex == 0)
-                        updateFrame(sample);
-
-                    int8_t  packetSyncStatus = packetSync.update(correlator, syncThresh, -syncThresh);
-                    int8_t  eotSyncStatus = EOTSync.update(correlator, syncThresh, syncThresh);
+                    demodState = DemodState::UNLOCKED;
+                    //cout << "M17 Demodulator: Missed too many syncs: Sync Update -> Unlocked" << endl;
+                    locked     = false;
+                    freqOffset = baseOffset;
+                }
+                else
+                {
+                    //cout << "M17 Demodulator: Did not receive any sync word, staying locked anyway." << endl;
+                    // Checking which sync word is the most probable
+                    float hd_lsf = softHammingDistance(16, demodFrame->data(), SOFT_LSF_SYNC_WORD.data());
+                    float hd_pkt = softHammingDistance(16, demodFrame->data(), SOFT_PACKET_SYNC_WORD.data());
+                    float hd_bert = softHammingDistance(16, demodFrame->data(), SOFT_BERT_SYNC_WORD.data());
+                    float hd_eot = softHammingDistance(16, demodFrame->data(), SOFT_EOT_SYNC_WORD.data());
 
-#if M17DEMOD_DEBUG_OUT
-                    // Write corr value to file
-                    float pkt = static_cast<float>(packetSync.getLastCorr())/100000;
-                    float eot = static_cast<float>(EOTSync.getLastCorr())/100000;
-                    float tmp = total_cnt;
-                    pkt_corr.write(reinterpret_cast<const char*>(&tmp), 4);
-                    pkt_corr.write(reinterpret_cast<const char*>(&pkt), 4);
-                    eot_corr.write(reinterpret_cast<const char*>(&tmp), 4);
-                    eot_corr.write(reinterpret_cast<const char*>(&eot), 4);
-#endif
+                    float hd_min = min({hd_lsf, hd_pkt, hd_bert, hd_eot});
 
-                    // Correlation has to coincide with a syncword!
-                    if(frameIndex == M17_SYNCWORD_SYMBOLS*2)
-                    {
-                        // Find the new correlation peak
-
-                        if(packetSyncStatus == 1)
-                        {
-                            float hd  = softHammingDistance(16, demodFrame->data(), SOFT_PACKET_SYNC_WORD.data());
-
-                            // Valid sync found: update deviation and sample
-                            // point, then go back to locked state
-                            if(hd <= 3)
-                            {
-                                size_t pkt_peak = packetSync.samplingIndex();
-                                outerDeviation = correlator.maxDeviation(pkt_peak);
-                                int32_t devSpacing = (outerDeviation.first-outerDeviation.second)/3;
-                                innerDeviation.first = outerDeviation.first-devSpacing; // Deviation for +1
-                                innerDeviation.second = outerDeviation.second + devSpacing; // deviation for -1
-                                cout << "pkt_peak=" << pkt_peak << ", correlator.index()=" << correlator.index() << endl;
-                                sampleIndex = (correlator.index() - pkt_peak);
-
-                                if(sampleIndex > correlator.bufferSize())
-                                    sampleIndex += correlator.bufferSize();
-
-                                missedSyncs    = 0;
-                                demodState     = DemodState::LOCKED;
-                                lastSyncWord   = SyncWord::PACKET;
-                                //cout << "M17 Demodulator: Received packet sync: Sync Update -> Locked" << endl;
-                                break;
-                            }
-                        }
-                        else if(packetSyncStatus == -1)
-                        {
-                            float hd  = softHammingDistance(16, demodFrame->data(), SOFT_BERT_SYNC_WORD.data());
-
-                            // Valid sync found: update deviation and sample
-                            // point, then go back to locked state
-                            if(hd <= 3)
-                            {
-                                size_t bert_peak = packetSync.samplingIndex();
-                                outerDeviation = correlator.maxDeviation(bert_peak);
-                                int32_t devSpacing = (outerDeviation.first-outerDeviation.second)/3;
-                                innerDeviation.first = outerDeviation.first-devSpacing; // Deviation for +1
-                                innerDeviation.second = outerDeviation.second + devSpacing; // deviation for -1
-                                //cout << "bert_peak=" << bert_peak << ", correlator.index()=" << correlator.index() << endl;
-                                sampleIndex = (correlator.index() - bert_peak);
-
-                                if(sampleIndex > correlator.bufferSize())
-                                    sampleIndex += correlator.bufferSize();
-
-                                missedSyncs    = 0;
-                                demodState     = DemodState::LOCKED;
-                                lastSyncWord   = SyncWord::BERT;
-                                //cout << "M17 Demodulator: Received bert sync: Sync Update -> Locked" << endl;
-                                break;
-                            }
-                        }
-                        else if(eotSyncStatus == 1)
-                        {
-                            float hd  = softHammingDistance(16, demodFrame->data(), SOFT_EOT_SYNC_WORD.data());
-
-                            // Valid EOT sync found: unlock demodulator
-                            if(hd <= 3)
-                            {
-                                missedSyncs = 0;
-                                demodState     = DemodState::UNLOCKED;
-                                locked = false;
-                                lastSyncWord = SyncWord::EOT;
-                                cout << "M17Demodulator: Received EOT sync: -> Unlocked" << endl;
-                                break;
-                            }
-                        }
-                    }
+                    demodState  = DemodState::LOCKED;
+                    symbolValid = false;
+                    symbolDue   = false;
 
-                    // No syncword found within the window, increase the count
-                    // of missed syncs and choose where to go. The lock is lost
-                    // after four consecutive sync misses.
-                    if(syncCount == 0)
+                    if( hd_min == hd_lsf)
+                        lastSyncWord = SyncWord::LSF;
+                    else if( hd_min == hd_pkt )
+                        lastSyncWord = SyncWord::PACKET;
+                    else if( hd_min == hd_bert )
+                        lastSyncWord = SyncWord::BERT;
+                    else if( hd_min == hd_eot)
                     {
-                        if(missedSyncs >= 4)
-                        {
-                            demodState = DemodState::UNLOCKED;
-                            //cout << "M17 Demodulator: Missed too many syncs: Sync Update -> Unlocked" << endl;
-                            locked     = false;
-                        }
-                        else
-                        {
-                            //cout << "M17 Demodulator: Did not receive any sync word, staying locked anyway." << endl;
-                            // Checking which sync word is the most probable
-                            float hd_lsf = softHammingDistance(16, demodFrame->data(), SOFT_LSF_SYNC_WORD.data());
-                            float hd_pkt = softHammingDistance(16, demodFrame->data(), SOFT_PACKET_SYNC_WORD.data());
-                            float hd_bert = softHammingDistance(16, demodFrame->data(), SOFT_BERT_SYNC_WORD.data());
-                            float hd_eot = softHammingDistance(16, demodFrame->data(), SOFT_EOT_SYNC_WORD.data());
-
-                            float hd_min = min({hd_lsf, hd_pkt, hd_bert, hd_eot});
-
-                            demodState = DemodState::LOCKED;
-
-                            if( hd_min == hd_lsf)
-                                lastSyncWord = SyncWord::LSF;
-                            else if( hd_min == hd_pkt )
-                                lastSyncWord = SyncWord::PACKET;
-                            else if( hd_min == hd_bert )
-                                lastSyncWord = SyncWord::BERT;
-                            else if( hd_min == hd_eot)
-                            {
-                                lastSyncWord = SyncWord::EOT;
-                                demodState = DemodState::UNLOCKED;
-                                locked = false;
-                            }
-                            else
-                                lastSyncWord = SyncWord::NONE;
-                        }
-
-                        missedSyncs += 1;
+                        lastSyncWord = SyncWord::EOT;
+                        demodState = DemodState::UNLOCKED;
+                        locked = false;
+                        freqOffset = baseOffset;
                     }
-
-                    syncCount -= 1;
+                    else
+                        lastSyncWord = SyncWord::NONE;
                 }
-                    break;
+
+                missedSyncs += 1;
             }
 
-            sampleIndex  = (sampleIndex + 1) % SAMPLES_PER_SYMBOL;
+            syncCount -= 1;
         }
+            break;
     }
 
-    return (lastSyncWord==SyncWord::EOT)?-1:newFrame;
+    sampleIndex  = (sampleIndex + 1) % SAMPLES_PER_SYMBOL;
 }
 
-void M17Demodulator::updateFrame(int16_t sample)
+template < size_t SAMPLES_PER_SYMBOL >
+void M17Demodulator< SAMPLES_PER_SYMBOL >::trackOffset(const int32_t residual)
+{
+    int32_t correction = residual / (1 << AFC_TRACKING_SHIFT);
+
+    // The deviations were measured on samples that still contain the
+    // correction, the next samples will not.
+    freqOffset            += correction;
+    outerDeviation.first  -= correction;
+    outerDeviation.second -= correction;
+    innerDeviation.first  -= correction;
+    innerDeviation.second -= correction;
+
+    buildQuantizer();
+}
+
+template < size_t SAMPLES_PER_SYMBOL >
+void M17Demodulator< SAMPLES_PER_SYMBOL >::buildQuantizer()
 {
     /**
      * Dibit    Symbol
@@ -506,41 +884,66 @@ void M17Demodulator::updateFrame(int16_t sample)
      * 0   0    +1
      * 1   0    -1
      * 1   1    -3
-     *
-     * We map the value of each bit with a linear interpolation as such:
-     *
      */
+    const int32_t spacing = std::max((outerDeviation.first - outerDeviation.second) / 3, 1);
+    const float   levels[4] = {static_cast< float >(outerDeviation.first),  static_cast< float >(innerDeviation.first),
+                               static_cast< float >(innerDeviation.second), static_cast< float >(outerDeviation.second)};
 
-    if(sample >= outerDeviation.first)
-    {
-        // Sample >= +3
-        demodFrame->at(frameIndex++) = 0x0000; // MSB
-        demodFrame->at(frameIndex++) = 0xFFFF; // LSB
-    }
-    else if(sample >= innerDeviation.first)
-    {
-        // +3 > Sample >= +1
-        demodFrame->at(frameIndex++) = 0x0000; // MSB
-        demodFrame->at(frameIndex++) = mapRange(sample, innerDeviation.first, outerDeviation.first, 0, 0xFFFF); // LSB
-    }
-    else if(sample >= innerDeviation.second)
+    const int32_t low   = outerDeviation.second - spacing;
+    const int32_t range = outerDeviation.first + spacing - low;
+    quantShift = 0;
+    while((range >> quantShift) >= static_cast< int32_t >(QUANT_TABLE_SIZE))
+        quantShift++;
+
+    // Center the table on the symbol deviations
+    quantLow = low - (static_cast< int32_t >(QUANT_TABLE_SIZE << quantShift) - range) / 2;
+
+    const float var   = std::clamp(noiseVar, static_cast< float >(spacing * spacing) / 256.0f,
+                                             static_cast< float >(spacing * spacing) / 4.0f);
+    const float scale = 32767.5f / QUANT_LLR_MAX;
+
+    // Log of the sum of two likelihoods, given as exponents
+    auto logSum = [](const float a, const float b)
     {
-        // +1 > sample >= -1
-        demodFrame->at(frameIndex++) = mapRange(sample, innerDeviation.second, innerDeviation.first, 0xFFFF, 0); // MSB
-        demodFrame->at(frameIndex++) = 0x0000; // LSB
-    }
-    else if(sample > outerDeviation.second)
+        return std::max(a, b) + std::log1p(std::exp(-std::fabs(a - b)));
+    };
+
+    // Soft value of a bit, from its LLR: zero is a certain 0, 0xFFFF a certain 1
+    auto softBit = [scale](const float llr)
     {
-        // -1 > sample > -3
-        demodFrame->at(frameIndex++) = 0xFFFF; // MSB
-        demodFrame->at(frameIndex++) = mapRange(sample, outerDeviation.second, innerDeviation.second, 0xFFFF, 0); // LSB
-    }
-    else
+        return static_cast< uint16_t >(std::clamp(32767.5f - llr * scale, 0.0f, 65535.0f));
+    };
+
+    for(size_t i = 0; i < QUANT_TABLE_SIZE; i++)
     {
-        // sample <= -3
-        demodFrame->at(frameIndex++) = 0xFFFF; // MSB
-        demodFrame->at(frameIndex++) = 0xFFFF; // LSB
+        const float x = static_cast< float >(quantLow + static_cast< int32_t >(i << quantShift))
+                      + static_cast< float >(1 << quantShift) / 2.0f;
+
+        float ll[4];
+        float error = INFINITY;
+        for(size_t k = 0; k < 4; k++)
+        {
+            float d = x - levels[k];
+            ll[k] = -(d * d) / (2.0f * var);
+            error = std::min(error, d * d);
+        }
+
+        // MSB is 0 on positive symbols, LSB is 1 on outer symbols
+        quantTable[i].msb   = softBit(logSum(ll[0], ll[1]) - logSum(ll[2], ll[3]));
+        quantTable[i].lsb   = softBit(logSum(ll[1], ll[2]) - logSum(ll[0], ll[3]));
+        quantTable[i].error = static_cast< uint32_t >(error);
     }
+}
+
+template < size_t SAMPLES_PER_SYMBOL >
+void M17Demodulator< SAMPLES_PER_SYMBOL >::updateFrame(int16_t sample)
+{
+    int32_t index = (static_cast< int32_t >(sample) - quantLow) >> quantShift;
+    const quant_entry_t &entry = quantTable[std::clamp(index, 0, static_cast< int32_t >(QUANT_TABLE_SIZE - 1))];
+
+    demodFrame->at(frameIndex++) = entry.msb;
+    demodFrame->at(frameIndex++) = entry.lsb;
+    noiseSum += entry.error;
 
 #if M17DEMOD_DEBUG_OUT
     float tmp = total_cnt;
@@ -565,13 +968,27 @@ void M17Demodulator::updateFrame(int16_t sample)
     if(frameIndex >= 2*M17_FRAME_SYMBOLS)
     {
         std::swap(readyFrame, demodFrame);
+        if(!demodFrame)
+            demodFrame = framePool ? framePool->acquire() : frame_pool::allocate();
         frameIndex = 0;
         newFrame   = true;
+
+        frameTiming.error      = (timingCount > 0) ? timingErrSum/timingCount : 0.0f;
+        frameTiming.correction = timingCorrSum;
+        timingErrSum  = 0.0f;
+        timingCorrSum = 0.0f;
+        timingCount   = 0;
+
+        // The quantizer takes the new variance with the next deviations
+        float var = static_cast< float >(noiseSum) / M17_FRAME_SYMBOLS;
+        noiseVar += (var - noiseVar) * NOISE_VAR_WEIGHT;
+        noiseSum  = 0;
         //cout << "M17Demodulator: completed a frame" << endl;
     }
 }
 
-void M17Demodulator::reset()
+template < size_t SAMPLES_PER_SYMBOL >
+void M17Demodulator< SAMPLES_PER_SYMBOL >::reset()
 {
     sampleIndex = 0;
     frameIndex  = 0;
@@ -579,6 +996,28 @@ void M17Demodulator::reset()
     locked      = false;
     demodState  = DemodState::INIT;
     initCount   = RX_SAMPLE_RATE / 50;  // 50ms of init time
+    preambleWait = PREAMBLE_SAMPLES;
+
+    interpWindow.fill(0.0f);
+    timing        = 0.0f;
+    timingDrift   = 0.0f;
+    symbolValid   = false;
+    midValid      = false;
+    symbolDue     = false;
+    timingErrSum  = 0.0f;
+    timingCorrSum = 0.0f;
+    timingCount   = 0;
+    frameTiming   = {0.0f, 0.0f};
+    freqOffset    = baseOffset;
+    quantLow      = 0;
+    quantShift    = 0;
+    noiseVar      = 0.0f;
+    noiseSum      = 0;
 
     firfilt_rrrf_reset(rrcos_filt);
-}
\ No newline at end of file
+    rrcLine = RrcLine();
+}
+
+template class M17::M17Demodulator< 5 >;
+template class M17::M17Demodulator< 10 >;
+template class M17::M17Demodulator< 20 >;
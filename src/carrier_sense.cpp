@@ -0,0 +1,112 @@
+/****************************************************************************
+ * M17Netd                                                                  *
+ * Copyright (C) 2024 by Morgan Diepart ON4MOD                              *
+ *                       SDR-Engineering SRL                                *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU Affero General Public License as published *
+ * by the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU Affero General Public License for more details.                      *
+ *                                                                          *
+ * You should have received a copy of the GNU Affero General Public License *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    *
+ ****************************************************************************/
+
+#include <cmath>
+#include <algorithm>
+
+#include "carrier_sense.h"
+
+using namespace std;
+
+carrier_sense::carrier_sense(const carrier_sense_cfg &cfg, float sample_rate, float full_scale_power):
+                             percentile(cfg.percentile), floor_rate(cfg.floor_rate/sample_rate),
+                             busy_snr(cfg.busy_snr), free_snr(cfg.free_snr),
+                             busy_hold(static_cast<uint64_t>(cfg.busy_hold_ms*sample_rate/1000.0f)),
+                             free_hold(static_cast<uint64_t>(cfg.free_hold_ms*sample_rate/1000.0f)),
+                             sample_rate(sample_rate), full_scale_db(10.0f*log10(full_scale_power)),
+                             busy(true), learned(false), floor_db(0.0f), power_db(0.0f),
+                             now(0), busy_since(0), below(0), stats({0.0, 0.0, 0.0, 0})
+{
+    // The channel is busy until the noise floor has settled from its first value
+    hold = max(busy_hold, static_cast<uint64_t>(warmup*sample_rate));
+}
+
+bool carrier_sense::update(float power, bool locked, size_t n)
+{
+    power_db = 10.0f*log10(max(power, 1e-20f));
+    now += n;
+
+    if(!learned)
+    {
+        floor_db = power_db;
+        learned = true;
+    }
+    else if(!locked)
+    {
+        // Stochastic quantile tracker
+        if(power_db >= floor_db)
+            floor_db += floor_rate*percentile*n;
+        else
+            floor_db -= floor_rate*(1.0f - percentile)*n;
+    }
+
+    float snr = power_db - floor_db;
+    bool changed = false;
+
+    if(locked || snr >= busy_snr)
+    {
+        below = 0;
+        if(!busy)
+        {
+            busy = true;
+            busy_since = now;
+            hold = busy_hold;
+            stats.busy_periods++;
+            changed = true;
+        }
+    }
+    else if(busy)
+    {
+        below = (snr < free_snr) ? below + n : 0;
+        if(below >= free_hold && now - busy_since >= hold)
+        {
+            busy = false;
+            changed = true;
+        }
+    }
+
+    stats.observed += n/sample_rate;
+    if(busy)
+    {
+        stats.busy += n/sample_rate;
+        stats.longest_busy = max(stats.longest_busy, (now - busy_since)/static_cast<double>(sample_rate));
+    }
+
+    return changed;
+}
+
+bool carrier_sense::is_busy() const
+{
+    return busy;
+}
+
+float carrier_sense::get_noise_floor() const
+{
+    return floor_db - full_scale_db;
+}
+
+float carrier_sense::get_power() const
+{
+    return power_db - full_scale_db;
+}
+
+const carrier_sense::stats_t& carrier_sense::get_stats() const
+{
+    return stats;
+}
@@ -21,6 +21,9 @@
 #include <string_view>
 #include <vector>
 #include <iostream>
+#include <algorithm>
+
+#include <sched.h>
 
 #include <toml.hpp>
 
@@ -53,6 +56,41 @@ int config::getRadioConfig(radio_thread_cfg &radio_cfg) const
     radio_cfg.tx_freq   = config_tbl["radio"]["tx_frequency"].value_or(0UL);
     radio_cfg.k         = config_tbl["radio"]["k_mod"].value_or(0.0f);
     radio_cfg.ppm       = config_tbl["radio"]["ppm"].value_or(0);
+    radio_cfg.afc_feedback = config_tbl["radio"]["afc_feedback"].value_or(false);
+    radio_cfg.fixed_point_rx = config_tbl["radio"]["fixed_point_rx"].value_or(false);
+
+    radio_cfg.channels = config_tbl["radio"]["channels"].value_or(1U);
+    if(radio_cfg.channels != 1 && radio_cfg.channels != 2 && radio_cfg.channels != 4 && radio_cfg.channels != 8)
+    {
+        cerr << "Invalid number of RX channels (" << radio_cfg.channels << "), must be 1, 2, 4 or 8. Using 1." << endl;
+        radio_cfg.channels = 1;
+    }
+
+    radio_cfg.rx_channels.clear();
+    const toml::array *rx_channels = config_tbl["radio"]["rx_channels"].as_array();
+    if(rx_channels != nullptr && radio_cfg.channels > 1)
+    {
+        int half = radio_cfg.channels/2;
+        for(auto c = rx_channels->cbegin(); c < rx_channels->cend(); c++)
+        {
+            int64_t channel = c->value_or(INT64_MIN);
+            if(channel < -half || channel >= half)
+                cerr << "Ignoring invalid RX channel " << channel << ", must be between " << -half << " and " << half-1 << "." << endl;
+            else if(find(radio_cfg.rx_channels.begin(), radio_cfg.rx_channels.end(), channel) == radio_cfg.rx_channels.end())
+                radio_cfg.rx_channels.push_back(channel);
+        }
+    }
+
+    if(radio_cfg.rx_channels.empty())
+        radio_cfg.rx_channels.push_back(0);
+
+    radio_cfg.rx_workers = config_tbl["radio"]["rx_workers"].value_or(1U);
+    if(radio_cfg.rx_workers == 0)
+        radio_cfg.rx_workers = 1;
+
+    radio_cfg.fec_workers = config_tbl["radio"]["fec_workers"].value_or(1U);
+    if(radio_cfg.fec_workers == 0)
+        radio_cfg.fec_workers = 1;
 
     return EXIT_SUCCESS;
 }
@@ -101,6 +139,200 @@ int config::getSDRNodeConfig(sdrnode_cfg &cfg) const
     return EXIT_SUCCESS;
 }
 
+int config::getTxSchedConfig(txsched_cfg &cfg) const
+{
+    auto tbl = config_tbl["general"]["tx_priority"];
+
+    string_view scheduler = tbl["scheduler"].value_or("strict");
+    if(scheduler == "weighted")
+    {
+        cfg.weighted = true;
+    }
+    else
+    {
+        if(scheduler != "strict")
+            cerr << "Unknown TX scheduler \"" << scheduler << "\". Using strict priority." << endl;
+        cfg.weighted = false;
+    }
+
+    cfg.weights = {6, 3, 1};
+    const toml::array *weights = tbl["weights"].as_array();
+    if(weights != nullptr)
+    {
+        if(weights->size() != cfg.weights.size())
+        {
+            cerr << "TX scheduler weights must contain " << cfg.weights.size() << " values. Using defaults." << endl;
+        }
+        else
+        {
+            for(size_t i = 0; i < cfg.weights.size(); i++)
+            {
+                int64_t w = (*weights)[i].value_or(1);
+                cfg.weights[i] = (w < 1) ? 1 : w;
+            }
+        }
+    }
+
+    // Defaults: EF, CS5, CS6 and CS7 are interactive, CS1 and LE are bulk
+    cfg.interactive_dscp = {46, 40, 48, 56};
+    cfg.bulk_dscp = {8, 1};
+
+    const toml::array *interactive = tbl["interactive_dscp"].as_array();
+    if(interactive != nullptr)
+    {
+        cfg.interactive_dscp.clear();
+        for(auto d = interactive->cbegin(); d < interactive->cend(); d++)
+        {
+            int64_t dscp = d->value_or(-1);
+            if(dscp < 0 || dscp > 63)
+                cerr << "Ignoring invalid interactive DSCP value " << dscp << endl;
+            else
+                cfg.interactive_dscp.push_back(dscp);
+        }
+    }
+
+    const toml::array *bulk = tbl["bulk_dscp"].as_array();
+    if(bulk != nullptr)
+    {
+        cfg.bulk_dscp.clear();
+        for(auto d = bulk->cbegin(); d < bulk->cend(); d++)
+        {
+            int64_t dscp = d->value_or(-1);
+            if(dscp < 0 || dscp > 63)
+                cerr << "Ignoring invalid bulk DSCP value " << dscp << endl;
+            else
+                cfg.bulk_dscp.push_back(dscp);
+        }
+    }
+
+    cfg.small_tcp_len = tbl["small_tcp_len"].value_or(128);
+
+    return EXIT_SUCCESS;
+}
+
+int config::getAqmConfig(aqm_cfg &cfg) const
+{
+    auto tbl = config_tbl["general"]["tx_aqm"];
+
+    // At ~1 packet per second of airtime, the usual 5 ms / 100 ms CoDel
+    // parameters would drop almost everything. Default to a target above the
+    // airtime of a full-size packet.
+    cfg.enabled     = tbl["enabled"].value_or(true);
+    cfg.ecn         = tbl["ecn"].value_or(true);
+    cfg.target_ms   = tbl["target_ms"].value_or(1500U);
+    cfg.interval_ms = tbl["interval_ms"].value_or(15000U);
+    cfg.quantum     = tbl["quantum"].value_or(822U);
+    cfg.flows       = tbl["flows"].value_or(64U);
+
+    if(cfg.target_ms == 0 || cfg.interval_ms < cfg.target_ms)
+    {
+        cerr << "Invalid AQM target (" << cfg.target_ms << " ms) or interval (" << cfg.interval_ms << " ms). Using 1500 ms and 15000 ms." << endl;
+        cfg.target_ms = 1500;
+        cfg.interval_ms = 15000;
+    }
+
+    if(cfg.quantum == 0)
+        cfg.quantum = 822;
+
+    if(cfg.flows == 0)
+        cfg.flows = 1;
+
+    return EXIT_SUCCESS;
+}
+
+int config::getCarrierSenseConfig(carrier_sense_cfg &cfg) const
+{
+    auto tbl = config_tbl["radio"]["carrier_sense"];
+
+    cfg.percentile   = tbl["percentile"].value_or(0.1f);
+    cfg.floor_rate   = tbl["floor_rate"].value_or(100.0f);
+    cfg.busy_snr     = tbl["busy_snr"].value_or(6.0f);
+    cfg.free_snr     = tbl["free_snr"].value_or(3.0f);
+    cfg.busy_hold_ms = tbl["busy_hold_ms"].value_or(20U);
+    cfg.free_hold_ms = tbl["free_hold_ms"].value_or(5U);
+
+    if(!(cfg.percentile > 0.0f && cfg.percentile <= 0.5f))
+    {
+        cerr << "Invalid carrier sense percentile (" << cfg.percentile << "), must be between 0 and 0.5. Using 0.1." << endl;
+        cfg.percentile = 0.1f;
+    }
+
+    if(!(cfg.floor_rate > 0.0f))
+    {
+        cerr << "Invalid carrier sense noise floor rate (" << cfg.floor_rate << " dB/s). Using 100 dB/s." << endl;
+        cfg.floor_rate = 100.0f;
+    }
+
+    if(cfg.free_snr > cfg.busy_snr)
+    {
+        cerr << "Carrier sense free SNR (" << cfg.free_snr << " dB) above the busy SNR (" << cfg.busy_snr
+             << " dB). Using 6 dB and 3 dB." << endl;
+        cfg.busy_snr = 6.0f;
+        cfg.free_snr = 3.0f;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Parses the configuration of one thread from [general.threads.<name>]
+ */
+static void parseThreadConfig(toml::node_view<const toml::node> tbl, const string_view &name, bool default_fifo,
+                              int default_priority, thread_cfg &cfg)
+{
+    cfg.cpus.clear();
+    const toml::array *cpus = tbl["cpus"].as_array();
+    if(cpus != nullptr)
+    {
+        for(auto c = cpus->cbegin(); c < cpus->cend(); c++)
+        {
+            int64_t cpu = c->value_or(-1);
+            if(cpu < 0 || cpu >= CPU_SETSIZE)
+                cerr << "Ignoring invalid CPU " << cpu << " for the " << name << " thread." << endl;
+            else
+                cfg.cpus.push_back(cpu);
+        }
+    }
+
+    string_view policy = tbl["policy"].value_or(default_fifo ? "fifo" : "other");
+    if(policy == "fifo")
+    {
+        cfg.fifo = true;
+    }
+    else
+    {
+        if(policy != "other")
+            cerr << "Unknown scheduling policy \"" << policy << "\" for the " << name << " thread. Using \"other\"." << endl;
+        cfg.fifo = false;
+    }
+
+    cfg.priority = tbl["priority"].value_or(default_priority);
+    if(cfg.priority < 1 || cfg.priority > 99)
+    {
+        cerr << "Invalid SCHED_FIFO priority (" << cfg.priority << ") for the " << name << " thread. Using "
+             << default_priority << "." << endl;
+        cfg.priority = default_priority;
+    }
+}
+
+int config::getThreadsConfig(threads_cfg &cfg) const
+{
+    auto tbl = config_tbl["general"]["threads"];
+
+    cfg.mlockall = tbl["mlockall"].value_or(true);
+
+    // Only the radio threads and the channel demodulators have deadlines to meet (ALSA buffers). The capture thread
+    // must preempt the processing of the radio thread, even when they share a CPU.
+    parseThreadConfig(tbl["tun"], "tun", false, 50, cfg.tun);
+    parseThreadConfig(tbl["radio"], "radio", true, 50, cfg.radio);
+    parseThreadConfig(tbl["capture"], "capture", true, 60, cfg.capture);
+    parseThreadConfig(tbl["rx_workers"], "rx_workers", true, 50, cfg.rx_workers);
+    parseThreadConfig(tbl["fec_workers"], "fec_workers", false, 50, cfg.fec_workers);
+    parseThreadConfig(tbl["m17tx"], "m17tx", false, 50, cfg.m17tx);
+
+    return EXIT_SUCCESS;
+}
+
 string_view config::getCallsign() const
 {
     optional<string_view> cs = config_tbl["general"]["callsign"].value<string_view>();
@@ -0,0 +1,261 @@
+/****************************************************************************
+ * M17Netd                                                                  *
+ * Copyright (C) 2024 by Morgan Diepart ON4MOD                              *
+ *                       SDR-Engineering SRL                                *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU Affero General Public License as published *
+ * by the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU Affero General Public License for more details.                      *
+ *                                                                          *
+ * You should have received a copy of the GNU Affero General Public License *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    *
+ ****************************************************************************/
+
+#include <iostream>
+#include <string>
+#include <algorithm>
+
+#include "fec_pool.h"
+#include "thread_sched.h"
+
+using namespace std;
+
+fec_pool::fec_pool(size_t nb_workers, const thread_cfg &sched, const optional<m17rx::callsign_t> &destination):
+                   rx_packets(max<size_t>(nb_workers, 1)*(queue_packets + 1) + packets_in_flight, destination),
+                   running(true), dropped(0), next_fetch(0)
+{
+    nb_workers = max<size_t>(nb_workers, 1);
+    for(size_t w = 0; w < nb_workers; w++)
+    {
+        unique_ptr<worker_t> worker = make_unique<worker_t>();
+        worker->jobs.setTimeout(chrono::milliseconds(100));
+        worker->done = 0;
+        worker->submitted = 0;
+        worker->frames = 0;
+        worker->packets_done = 0;
+        worker->foreign = 0;
+        worker->skipped = 0;
+        worker->latency_sum = 0;
+        worker->latency_max = 0;
+        worker->decode_sum = 0;
+        workers.push_back(move(worker));
+    }
+
+    for(size_t w = 0; w < workers.size(); w++)
+    {
+        workers[w]->t = thread(&fec_pool::work, this, ref(*workers[w]));
+        set_thread_sched(workers[w]->t, "fec_worker" + to_string(w), sched);
+    }
+}
+
+fec_pool::~fec_pool()
+{
+    running = false;
+    for(auto &worker : workers)
+        worker->t.join();
+}
+
+void fec_pool::add_frame(int stream, uint16_t sync_word, frame_pool::frame_ptr frame, float offset)
+{
+    auto found = streams.find(stream);
+
+    // A new superframe goes to the least busy worker, unless the previous worker of the stream has frames of the
+    // stream left to decode or packets not fetched yet, so that the packets of the stream are fetched in order. The
+    // previous worker then drops the packet it was receiving.
+    bool start = (sync_word == SYNC_LSF) || (sync_word == SYNC_BER && (found == streams.end() || !found->second.active));
+    if(start && found == streams.end())
+    {
+        found = streams.emplace(stream, stream_t{least_busy(), 0, true}).first;
+    }
+    else if(start)
+    {
+        stream_t &previous = found->second;
+        const worker_t &last_worker = *workers[previous.worker];
+        if(last_worker.done >= previous.last && last_worker.packets.length() == 0)
+        {
+            size_t worker = least_busy();
+            if(worker != previous.worker)
+            {
+                end_stream(stream);
+                previous.worker = worker;
+                previous.last = 0;
+            }
+        }
+        previous.active = true;
+    }
+
+    // Frames out of a superframe cannot be decoded, like the rest of a superframe that lost a frame
+    if(found == streams.end() || !found->second.active)
+        return;
+
+    job.frame = move(frame);
+    job.sync_word = sync_word;
+    job.stream = stream;
+    job.offset = offset;
+    job.end = false;
+    job.added = chrono::steady_clock::now();
+
+    // Never wait on a worker, the demodulators would fall behind instead
+    if(submit(found->second) < 0)
+    {
+        dropped++;
+        found->second.active = false;
+    }
+}
+
+void fec_pool::end_stream(int stream)
+{
+    auto found = streams.find(stream);
+    if(found == streams.end() || !found->second.active)
+        return;
+
+    found->second.active = false;
+
+    // If the queue is full, the packet is replaced by the next superframe of the stream instead
+    job.stream = stream;
+    job.end = true;
+    submit(found->second);
+}
+
+int fec_pool::fetch(rx_packet_t &packet)
+{
+    for(size_t i = 0; i < workers.size(); i++)
+    {
+        worker_t &worker = *workers[(next_fetch + i) % workers.size()];
+        if(worker.packets.try_consume(packet) >= 0)
+        {
+            next_fetch = (next_fetch + i + 1) % workers.size();
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+fec_pool::stats_t fec_pool::get_stats() const
+{
+    stats_t stats = {0, dropped, 0, 0, 0, 0.0, 0.0, 0.0, 0.0};
+    uint64_t latency_sum = 0, decode_sum = 0, latency_max = 0;
+
+    for(const auto &worker : workers)
+    {
+        stats.frames += worker->frames;
+        stats.packets += worker->packets_done;
+        stats.foreign += worker->foreign;
+        stats.skipped += worker->skipped;
+        latency_sum += worker->latency_sum;
+        decode_sum += worker->decode_sum;
+        latency_max = max<uint64_t>(latency_max, worker->latency_max);
+    }
+
+    if(stats.frames > 0)
+    {
+        stats.mean_latency = 1e-9*latency_sum/stats.frames;
+        stats.mean_decode = 1e-9*decode_sum/stats.frames;
+    }
+    stats.max_latency = 1e-9*latency_max;
+    stats.saved = stats.skipped*stats.mean_decode;
+
+    return stats;
+}
+
+m17rx_pool::stats_t fec_pool::get_packet_stats() const
+{
+    return rx_packets.get_stats();
+}
+
+size_t fec_pool::least_busy() const
+{
+    size_t best = 0;
+    for(size_t w = 1; w < workers.size(); w++)
+    {
+        if(workers[w]->jobs.length() < workers[best]->jobs.length())
+            best = w;
+    }
+
+    return best;
+}
+
+int fec_pool::submit(stream_t &stream)
+{
+    // The frame buffer moves into the queue, it goes back to its pool if the queue is full
+    worker_t &worker = *workers[stream.worker];
+    if(worker.jobs.try_add(move(job)) < 0)
+        return -1;
+
+    stream.last = ++worker.submitted;
+    return 0;
+}
+
+void fec_pool::work(worker_t &worker)
+{
+    job_t work_job;
+    map<int, shared_ptr<m17rx>> packets;    // Packet being received on each stream
+
+    while(running)
+    {
+        if(worker.jobs.consume(work_job) < 0)
+            continue;
+
+        if(work_job.end)
+        {
+            packets.erase(work_job.stream);
+            worker.done++;
+            continue;
+        }
+
+        // The LSF starts a new packet, BERT frames go on in the packet of the stream
+        shared_ptr<m17rx> &packet = packets[work_job.stream];
+        if(!packet || work_job.sync_word == SYNC_LSF)
+            packet = rx_packets.acquire();
+
+        size_t skipped = packet->skipped_frames();
+        auto start = chrono::steady_clock::now();
+        packet->add_frame(work_job.sync_word, move(work_job.frame));
+        auto done = chrono::steady_clock::now();
+
+        if(packet->skipped_frames() != skipped)
+        {
+            // Frame of a superframe addressed to another station, not decoded
+            worker.skipped++;
+            worker.done++;
+            continue;
+        }
+
+        if(packet->is_error())
+        {
+            // If the packet is in error state, discard it
+            packets.erase(work_job.stream);
+        }
+        else if(packet->is_complete())
+        {
+            rx_packet_t complete = {packet, work_job.stream, work_job.offset};
+            if(worker.packets.try_add(complete) < 0)
+                cerr << "fec_pool: packet received on stream " << work_job.stream << " dropped, queue full." << endl;
+
+            worker.packets_done++;
+            packets.erase(work_job.stream);
+        }
+        else if(packet->is_foreign())
+        {
+            // The source and the carrier offset of the other stations are still of use to the feeding thread
+            rx_packet_t foreign = {packet, work_job.stream, work_job.offset};
+            worker.packets.try_add(foreign);
+            worker.foreign++;
+        }
+
+        uint64_t latency = chrono::duration_cast<chrono::nanoseconds>(done - work_job.added).count();
+        worker.latency_sum += latency;
+        worker.decode_sum += chrono::duration_cast<chrono::nanoseconds>(done - start).count();
+        if(latency > worker.latency_max)
+            worker.latency_max = latency;
+        worker.frames++;
+        worker.done++;
+    }
+}
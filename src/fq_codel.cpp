@@ -0,0 +1,337 @@
+/****************************************************************************
+ * M17Netd                                                                  *
+ * Copyright (C) 2024 by Morgan Diepart ON4MOD                              *
+ *                       SDR-Engineering SRL                                *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU Affero General Public License as published *
+ * by the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU Affero General Public License for more details.                      *
+ *                                                                          *
+ * You should have received a copy of the GNU Affero General Public License *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    *
+ ****************************************************************************/
+
+#include <cmath>
+#include <random>
+
+#include <netinet/in.h>
+#include <netinet/ip.h>
+
+#include "fq_codel.h"
+
+using namespace std;
+
+fq_codel::fq_codel(size_t limit, const aqm_cfg &cfg): limit(limit), packets(0), max_packet(0), enabled(cfg.enabled), ecn(cfg.ecn),
+                                                      target(chrono::milliseconds(cfg.target_ms)),
+                                                      interval(chrono::milliseconds(cfg.interval_ms)),
+                                                      quantum(cfg.quantum), stats({0, 0, 0, 0, 0})
+{
+    flows.resize(cfg.flows);
+    for(auto &f : flows)
+    {
+        f.bytes = 0;
+        f.deficit = 0;
+        f.listed = false;
+        f.dropping = false;
+        f.count = 0;
+        f.lastcount = 0;
+        f.first_above_time = time_point();
+        f.drop_next = time_point();
+    }
+
+    random_device rd;
+    perturbation = rd();
+}
+
+size_t fq_codel::flow_index(const vector<uint8_t> &pkt) const
+{
+    if(pkt.size() < sizeof(struct ip))
+        return 0;
+
+    const struct ip *hdr = reinterpret_cast<const struct ip *>(pkt.data());
+    size_t hdr_len = hdr->ip_hl * 4;
+    uint32_t ports = 0;
+
+    // Source and destination ports, for the protocols that have them
+    if((hdr->ip_p == IPPROTO_TCP || hdr->ip_p == IPPROTO_UDP) && pkt.size() >= hdr_len + 4)
+    {
+        ports = (static_cast<uint32_t>(pkt[hdr_len]) << 24) | (static_cast<uint32_t>(pkt[hdr_len+1]) << 16) |
+                (static_cast<uint32_t>(pkt[hdr_len+2]) << 8) | pkt[hdr_len+3];
+    }
+
+    // Mix the 5-tuple (MurmurHash3 finalizer)
+    uint64_t h = perturbation;
+    h ^= (static_cast<uint64_t>(hdr->ip_src.s_addr) << 32) | hdr->ip_dst.s_addr;
+    h ^= (static_cast<uint64_t>(ports) << 8) ^ hdr->ip_p;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+
+    return h % flows.size();
+}
+
+void fq_codel::enqueue(fq_entry &&e)
+{
+    size_t idx = flow_index(*e.ip_pkt);
+    flow_t &flow = flows[idx];
+
+    max_packet = max(max_packet, e.ip_pkt->size());
+    flow.bytes += e.ip_pkt->size();
+    flow.q.push_back(std::move(e));
+    packets++;
+    stats.enqueued++;
+
+    if(!flow.listed)
+    {
+        flow.listed = true;
+        flow.deficit = quantum;
+        new_flows.push_back(idx);
+    }
+
+    // Queue full: drop the head packet of the largest flow
+    if(packets > limit)
+    {
+        size_t fattest = 0;
+        for(size_t i = 1; i < flows.size(); i++)
+        {
+            if(flows[i].bytes > flows[fattest].bytes)
+                fattest = i;
+        }
+
+        fq_entry dropped = std::move(flows[fattest].q.front());
+        flows[fattest].q.pop_front();
+        flows[fattest].bytes -= dropped.ip_pkt->size();
+        packets--;
+        stats.overlimit++;
+    }
+}
+
+bool fq_codel::dequeue(fq_entry &e, time_point now)
+{
+    while(true)
+    {
+        deque<size_t> *list;
+        if(!new_flows.empty())
+            list = &new_flows;
+        else if(!old_flows.empty())
+            list = &old_flows;
+        else
+            return false;
+
+        size_t idx = list->front();
+        flow_t &flow = flows[idx];
+
+        // Flow used up its share for this round
+        if(flow.deficit <= 0)
+        {
+            flow.deficit += quantum;
+            list->pop_front();
+            old_flows.push_back(idx);
+            continue;
+        }
+
+        if(!codel_dequeue(flow, e, now))
+        {
+            // Flow is empty. A new flow goes through the old flows once
+            // before being removed, so that it cannot jump ahead twice.
+            list->pop_front();
+            if(list == &new_flows && !old_flows.empty())
+            {
+                old_flows.push_back(idx);
+            }
+            else
+            {
+                flow.listed = false;
+            }
+            continue;
+        }
+
+        flow.deficit -= e.ip_pkt->size();
+        stats.sent++;
+        return true;
+    }
+}
+
+bool fq_codel::codel_pop(flow_t &flow, fq_entry &e, time_point now, bool &ok_to_drop)
+{
+    ok_to_drop = false;
+
+    if(flow.q.empty())
+    {
+        flow.first_above_time = time_point();
+        return false;
+    }
+
+    e = std::move(flow.q.front());
+    flow.q.pop_front();
+    flow.bytes -= e.ip_pkt->size();
+    packets--;
+
+    if(!enabled)
+        return true;
+
+    duration sojourn = now - e.enqueued;
+    if(sojourn < target || flow.bytes <= max_packet)
+    {
+        // Delay is fine, or the flow has less than a packet waiting
+        flow.first_above_time = time_point();
+    }
+    else if(flow.first_above_time == time_point())
+    {
+        // Delay just went above target, wait for one interval
+        flow.first_above_time = now + interval;
+    }
+    else if(now >= flow.first_above_time)
+    {
+        ok_to_drop = true;
+    }
+
+    return true;
+}
+
+bool fq_codel::codel_dequeue(flow_t &flow, fq_entry &e, time_point now)
+{
+    bool ok_to_drop;
+
+    if(!codel_pop(flow, e, now, ok_to_drop))
+    {
+        flow.dropping = false;
+        return false;
+    }
+
+    if(flow.dropping)
+    {
+        if(!ok_to_drop)
+        {
+            // Sojourn time below target, leave dropping state
+            flow.dropping = false;
+        }
+
+        while(flow.dropping && now >= flow.drop_next)
+        {
+            flow.count++;
+
+            if(ecn && mark_ce(*e.ip_pkt))
+            {
+                stats.marked++;
+                flow.drop_next = control_law(flow.drop_next, flow.count);
+                return true;
+            }
+
+            drop(e);
+            if(!codel_pop(flow, e, now, ok_to_drop))
+            {
+                flow.dropping = false;
+                return false;
+            }
+
+            if(!ok_to_drop)
+                flow.dropping = false;
+            else
+                flow.drop_next = control_law(flow.drop_next, flow.count);
+        }
+    }
+    else if(ok_to_drop)
+    {
+        bool sent = true;
+
+        if(ecn && mark_ce(*e.ip_pkt))
+        {
+            stats.marked++;
+        }
+        else
+        {
+            drop(e);
+            sent = codel_pop(flow, e, now, ok_to_drop);
+        }
+
+        flow.dropping = true;
+
+        // If we were dropping recently, resume at the previous drop rate
+        uint32_t delta = flow.count - flow.lastcount;
+        if(delta > 1 && (now - flow.drop_next) < 16*interval)
+            flow.count = delta;
+        else
+            flow.count = 1;
+
+        flow.lastcount = flow.count;
+        flow.drop_next = control_law(now, flow.count);
+
+        return sent;
+    }
+
+    return true;
+}
+
+fq_codel::time_point fq_codel::control_law(time_point t, uint32_t count) const
+{
+    return t + chrono::duration_cast<duration>(interval / sqrt(static_cast<double>(count)));
+}
+
+bool fq_codel::mark_ce(vector<uint8_t> &pkt)
+{
+    if(pkt.size() < sizeof(struct ip))
+        return false;
+
+    struct ip *hdr = reinterpret_cast<struct ip *>(pkt.data());
+    size_t hdr_len = hdr->ip_hl * 4;
+
+    // Leave a malformed header untouched
+    if(hdr->ip_hl < 5 || pkt.size() < hdr_len)
+        return false;
+
+    uint8_t ecn_bits = hdr->ip_tos & 0x03;
+
+    if(ecn_bits == 0x00)
+        return false; // Not ECN-capable
+
+    if(ecn_bits == 0x03)
+        return true; // Already marked
+
+    hdr->ip_tos |= 0x03;
+
+    // Recompute the header checksum
+    hdr->ip_sum = 0;
+    uint32_t sum = 0;
+    const uint16_t *words = reinterpret_cast<const uint16_t *>(pkt.data());
+    for(size_t i = 0; i < hdr_len/2; i++)
+    {
+        sum += words[i];
+    }
+    while(sum >> 16)
+    {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    hdr->ip_sum = static_cast<uint16_t>(~sum);
+
+    return true;
+}
+
+void fq_codel::drop(fq_entry &e)
+{
+    e.ip_pkt.reset();
+    stats.dropped++;
+}
+
+bool fq_codel::empty() const
+{
+    return packets == 0;
+}
+
+size_t fq_codel::length() const
+{
+    return packets;
+}
+
+const fq_codel::stats_t& fq_codel::get_stats() const
+{
+    return stats;
+}
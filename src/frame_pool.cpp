@@ -0,0 +1,106 @@
+/****************************************************************************
+ * M17Netd                                                                  *
+ * Copyright (C) 2024 by Morgan Diepart ON4MOD                              *
+ *                       SDR-Engineering SRL                                *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU Affero General Public License as published *
+ * by the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU Affero General Public License for more details.                      *
+ *                                                                          *
+ * You should have received a copy of the GNU Affero General Public License *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    *
+ ****************************************************************************/
+
+#include <iostream>
+
+#include "frame_pool.h"
+
+using namespace std;
+
+void frame_pool::recycler::operator()(soft_frame_t *frame) const
+{
+    if(pool != nullptr)
+        pool->release(frame);
+    else
+        delete frame;
+}
+
+frame_pool::frame_pool(size_t size): acquired(0), allocations(0), copies(0)
+{
+    free_frames.reserve(size);
+    buffers.reserve(size);
+    for(size_t i = 0; i < size; i++)
+    {
+        buffers.push_back(make_unique<soft_frame_t>());
+        free_frames.push_back(buffers.back().get());
+    }
+}
+
+frame_pool::~frame_pool()
+{
+    if(free_frames.size() != buffers.size())
+        cerr << "frame_pool: " << buffers.size() - free_frames.size() << " buffers still in use." << endl;
+}
+
+frame_pool::frame_ptr frame_pool::acquire()
+{
+    acquired++;
+
+    {
+        lock_guard<mutex> guard(free_lock);
+        if(!free_frames.empty())
+        {
+            soft_frame_t *frame = free_frames.back();
+            free_frames.pop_back();
+            return frame_ptr(frame, recycler{this});
+        }
+    }
+
+    // No buffer left, the pool grows
+    allocations++;
+    unique_ptr<soft_frame_t> frame = make_unique<soft_frame_t>();
+    soft_frame_t *ptr = frame.get();
+
+    lock_guard<mutex> guard(free_lock);
+    buffers.push_back(move(frame));
+    free_frames.reserve(buffers.size());
+
+    return frame_ptr(ptr, recycler{this});
+}
+
+frame_pool::frame_ptr frame_pool::copy(const soft_frame_t &frame)
+{
+    frame_ptr buffer = acquire();
+    *buffer = frame;
+    copies++;
+
+    return buffer;
+}
+
+frame_pool::frame_ptr frame_pool::allocate()
+{
+    return frame_ptr(new soft_frame_t(), recycler{nullptr});
+}
+
+frame_pool::stats_t frame_pool::get_stats() const
+{
+    size_t size;
+    {
+        lock_guard<mutex> guard(free_lock);
+        size = buffers.size();
+    }
+
+    return {size, acquired, allocations, copies};
+}
+
+void frame_pool::release(soft_frame_t *frame)
+{
+    lock_guard<mutex> guard(free_lock);
+    free_frames.push_back(frame);
+}
@@ -21,11 +21,13 @@
 #include <thread>
 #include <atomic>
 #include <csignal>
-#include "ConsumerProducer.h"
+#include "SPSCQueue.h"
 
 #include "tun_threads.h"
 #include "radio_thread.h"
 #include "m17tx_thread.h"
+#include "tx_scheduler.h"
+#include "thread_sched.h"
 #include "m17tx.h"
 #include "m17rx.h"
 
@@ -75,11 +77,29 @@ int main(int argc, char *argv[])
     // Parse config file
     config cfg = config(config_file);
 
+    threads_cfg threadsCfg;
+    cfg.getThreadsConfig(threadsCfg);
+    if(threadsCfg.mlockall)
+    {
+        lock_memory();
+    }
+
     std::size_t txQueueSize = cfg.getTxQueueSize();
     std::size_t rxQueueSize = cfg.getRxQueueSize();
-    ConsumerProducerQueue<std::shared_ptr<std::vector<uint8_t>>> from_net(txQueueSize);
-    ConsumerProducerQueue<std::shared_ptr<m17tx_pkt>> to_radio(txQueueSize);
-    ConsumerProducerQueue<std::shared_ptr<m17rx>> from_radio(rxQueueSize);
+    SPSCQueue<std::shared_ptr<std::vector<uint8_t>>> from_net(txQueueSize);
+    txsched_cfg schedCfg;
+    cfg.getTxSchedConfig(schedCfg);
+    aqm_cfg aqmCfg;
+    cfg.getAqmConfig(aqmCfg);
+    tx_scheduler to_radio(txQueueSize, schedCfg, aqmCfg, cfg.getCallsign());
+    SPSCQueue<std::shared_ptr<m17rx>> from_radio(rxQueueSize);
+
+    // The tun thread waits on this eventfd for packets coming from the radio
+    if(from_radio.enable_eventfd() < 0)
+    {
+        std::cerr << "Could not create the eventfd of the from_radio queue. Exiting." << std::endl;
+        return EXIT_FAILURE;
+    }
 
 
     // Start threads
@@ -92,15 +112,20 @@ int main(int argc, char *argv[])
     sigint_handler.sa_flags = 0;
     sigaction(SIGINT, &sigint_handler, 0);
 
-    std::thread tun_read = std::thread(tun_thread(), std::ref(running), std::ref(cfg), std::ref(from_net), std::ref(from_radio));
-    std::thread radio = std::thread(radio_simplex(), std::ref(running), std::ref(cfg), std::ref(to_radio), std::ref(from_radio));
-    std::thread m17tx = std::thread(m17tx_thread(), std::ref(running), std::ref(cfg), std::ref(from_net), std::ref(to_radio));
+    // Each thread pins itself and sets its own priority at entry
+    std::thread tun_read = std::thread(tun_thread(), std::ref(running), std::ref(cfg), std::cref(threadsCfg), std::ref(from_net), std::ref(from_radio));
+    radio_simplex radio_loop;
+    std::thread radio = std::thread(std::ref(radio_loop), std::ref(running), std::ref(cfg), std::cref(threadsCfg), std::ref(to_radio), std::ref(from_radio));
+    std::thread m17tx = std::thread(m17tx_thread(), std::ref(running), std::ref(cfg), std::cref(threadsCfg), std::ref(from_net), std::ref(to_radio));
 
     // Wait for threads to terminate
     tun_read.join();
     std::cout << "tun read thread stopped" << std::endl;
     radio.join();
     std::cout << "radio thread stopped" << std::endl;
+    radio_simplex::capture_stats_t capture = radio_loop.get_capture_stats();
+    std::cout << "RX capture: " << capture.dropped << " blocks dropped, " << capture.overruns << " radio overruns, ring max fill "
+              << capture.max_fill << " blocks" << std::endl;
     m17tx.join();
     std::cout << "M17 tx thread stopped" << std::endl;
 
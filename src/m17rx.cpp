@@ -21,56 +21,114 @@
 #include <iostream>
 #include <m17.h>
 #include <cstring>
+#include <algorithm>
 
 #include "m17rx.h"
+#include "viterbi.h"
 
 using namespace std;
 
-m17rx::m17rx(): status(packet_status::EMPTY), lsf(), corrected_errors(0), received_pkt_frames(-1), bert_lfsr(1), bert_errcnt(0), bert_totcnt(0), bert_synccnt(bert_lockcnt), bert_hist(0)
+namespace
 {
-    pkt_data = new vector<uint8_t>();
-    pkt_data->reserve(25); // Reserve space for at least one frame
-}
 
-m17rx::~m17rx()
+/**
+ * Deinterleaves the soft bits of a payload in place. Bit i takes the value of bit (45*i + 92*i*i) % 368, as with
+ * reorder_soft_bits() into another buffer. The permutation is applied one cycle at a time, from the first bit of each
+ * cycle.
+ */
+void deinterleave_soft_bits(uint16_t *bits)
 {
-    delete(pkt_data);
+    constexpr size_t len = 2*SYM_PER_PLD;
+
+    struct permutation_t
+    {
+        array<uint16_t, len> source;    // Bit moved into each bit
+        array<uint16_t, len> starts;    // First bit of each cycle
+        size_t nb_cycles;
+    };
+
+    static const permutation_t perm = []()
+    {
+        permutation_t p = {};
+        array<bool, len> visited = {};
+        for(size_t i = 0; i < len; i++)
+            p.source[i] = (45*i + 92*i*i) % len;
+
+        for(size_t i = 0; i < len; i++)
+        {
+            if(visited[i])
+                continue;
+
+            p.starts[p.nb_cycles++] = i;
+            for(size_t j = i; !visited[j]; j = p.source[j])
+                visited[j] = true;
+        }
+
+        return p;
+    }();
+
+    for(size_t c = 0; c < perm.nb_cycles; c++)
+    {
+        size_t start = perm.starts[c];
+        uint16_t first = bits[start];
+
+        size_t i = start;
+        for(size_t src = perm.source[i]; src != start; src = perm.source[i])
+        {
+            bits[i] = bits[src];
+            i = src;
+        }
+        bits[i] = first;
+    }
 }
 
-m17rx::m17rx(const m17rx &origin): status(origin.status), corrected_errors(origin.corrected_errors), received_pkt_frames(origin.received_pkt_frames)
-{
-    lsf = array<uint8_t, 30>(origin.lsf);
-    pkt_data = new vector<uint8_t>(*(origin.pkt_data));
 }
 
-m17rx::m17rx(m17rx &&origin): status(origin.status), lsf(std::move(origin.lsf)), pkt_data(std::move(origin.pkt_data)),
-                              corrected_errors(origin.corrected_errors), received_pkt_frames(origin.received_pkt_frames)
-{}
+m17rx::m17rx(): filter_destination(false), destination()
+{
+    reset();
+}
 
-m17rx& m17rx::operator=(const m17rx &origin)
+void m17rx::set_destination(const callsign_t &dst)
 {
-    status = origin.status;
-    lsf = array<uint8_t, 30>(origin.lsf);
-    pkt_data = new vector<uint8_t>(*(origin.pkt_data));
-    corrected_errors = origin.corrected_errors;
-    received_pkt_frames = origin.received_pkt_frames;
+    destination = dst;
+    filter_destination = true;
+}
 
-    return *this;
+void m17rx::reset()
+{
+    status = packet_status::EMPTY;
+    lsf = {};
+    pkt_len = 0;
+    corrected_errors = 0;
+    received_pkt_frames = -1;
+    skipped = 0;
+    bert_lfsr = 1;
+    bert_errcnt = 0;
+    bert_totcnt = 0;
+    bert_synccnt = bert_lockcnt;
+    bert_hist = 0;
 }
 
-m17rx& m17rx::operator=(m17rx &&origin)
+int m17rx::add_frame(uint16_t sync_word, array<uint16_t, 2*SYM_PER_FRA> frame)
 {
-    status = origin.status;
-    lsf = std::move(origin.lsf);
-    pkt_data = std::move(origin.pkt_data);
-    corrected_errors = origin.corrected_errors;
-    received_pkt_frames = origin.received_pkt_frames;
+    return decode_frame(sync_word, frame.data());
+}
 
-    return *this;
+int m17rx::add_frame(uint16_t sync_word, frame_pool::frame_ptr frame)
+{
+    return decode_frame(sync_word, frame->data());
 }
 
-int m17rx::add_frame(uint16_t sync_word, array<uint16_t, 2*SYM_PER_FRA> frame)
+int m17rx::decode_frame(uint16_t sync_word, uint16_t *frame)
 {
+    // The frames of a superframe addressed to another station are demodulated but not decoded
+    if(status == packet_status::FOREIGN && sync_word == SYNC_PKT)
+    {
+        skipped++;
+        return 0;
+    }
+
     // Check if the packet is ready to receive a frame
     if(status == packet_status::PKT_COMPLETE)
     {
@@ -102,15 +160,13 @@ int m17rx::add_frame(uint16_t sync_word, array<uint16_t, 2*SYM_PER_FRA> frame)
         return -1;
     }
 
-    array<uint16_t, 2*SYM_PER_PLD> deinterleaved;
-
     uint16_t *payload = &(frame[16]);
 
     // De-randomize the last 368 bits
     randomize_soft_bits(payload);
 
-    // de-interleave bits
-    reorder_soft_bits(deinterleaved.data(), payload);
+    // de-interleave bits, in place
+    deinterleave_soft_bits(payload);
 
 
     // Decode the frame based on the syncword
@@ -127,10 +183,17 @@ int m17rx::add_frame(uint16_t sync_word, array<uint16_t, 2*SYM_PER_FRA> frame)
             cout << "Adding LSF frame to packet" << endl;
             status = packet_status::LSF_RECEIVED;
             // Decode 368 type-3 soft bits to type-1 bits, stored in the lsf array
-            corrected_errors += viterbi_decode_punctured(buffer.data(), deinterleaved.data(),
-                                    puncture_pattern_1, deinterleaved.size(), sizeof(puncture_pattern_1));
+            corrected_errors += viterbi::decode_punctured(buffer.data(), payload,
+                                    puncture_pattern_1, 2*SYM_PER_PLD, sizeof(puncture_pattern_1));
 
             memcpy(reinterpret_cast<void *>(&lsf), buffer.data()+1, 30);
+
+            // The destination is only trusted once the CRC confirms it, the superframes of a corrupted LSF are decoded
+            if(filter_destination && CRC_M17(lsf.data(), lsf.size()) == 0
+               && memcmp(lsf.data(), destination.data(), destination.size()) != 0)
+            {
+                status = packet_status::FOREIGN;
+            }
         }
         break;
 
@@ -139,17 +202,19 @@ int m17rx::add_frame(uint16_t sync_word, array<uint16_t, 2*SYM_PER_FRA> frame)
             array<uint8_t, 26> pkt_type1; // 200+6 type-1 bits for pkt
 
             // Decode 368 type-3 soft bits to type-1 bits
-            corrected_errors += viterbi_decode_punctured(buffer.data(), deinterleaved.data(),
-                                    puncture_pattern_3, deinterleaved.size(), sizeof(puncture_pattern_3));
+            corrected_errors += viterbi::decode_punctured(buffer.data(), payload,
+                                    puncture_pattern_3, 2*SYM_PER_PLD, sizeof(puncture_pattern_3));
 
             memcpy(pkt_type1.data(), buffer.data()+1, pkt_type1.size());
 
             // Check that the frame number is consistent with what have been received previously
             if(pkt_type1[25] & (1 << 7)) // Check if this is the last frame
             {
-                size_t nb_bytes = (pkt_type1[25] >> 2) & 0x1F;
-                pkt_data->insert(pkt_data->cend(), pkt_type1.cbegin(), pkt_type1.cbegin() + nb_bytes);
-                cout << "Received last packet frame with " << nb_bytes << " bytes inside. Total payload size is " << pkt_data->size() << "." << endl;
+                // A corrupted byte count may exceed the 25 bytes of the frame
+                size_t nb_bytes = min<size_t>((pkt_type1[25] >> 2) & 0x1F, pkt_type1.size() - 1);
+                memcpy(pkt_data.data() + pkt_len, pkt_type1.data(), nb_bytes);
+                pkt_len += nb_bytes;
+                cout << "Received last packet frame with " << nb_bytes << " bytes inside. Total payload size is " << pkt_len << "." << endl;
                 status = packet_status::PKT_COMPLETE;
             }
             else
@@ -158,7 +223,9 @@ int m17rx::add_frame(uint16_t sync_word, array<uint16_t, 2*SYM_PER_FRA> frame)
                 if(frame_nb == received_pkt_frames+1)
                 {
 		            //cout << "Received frame number " << frame_nb << endl;
-                    pkt_data->insert(pkt_data->cend(), pkt_type1.cbegin(), pkt_type1.cend() - 1);
+                    // Frame numbers go up to 31, the 32 frames and the last one fit in pkt_data
+                    memcpy(pkt_data.data() + pkt_len, pkt_type1.data(), pkt_type1.size() - 1);
+                    pkt_len += pkt_type1.size() - 1;
                 }
                 else
                 {
@@ -175,8 +242,8 @@ int m17rx::add_frame(uint16_t sync_word, array<uint16_t, 2*SYM_PER_FRA> frame)
         case SYNC_BER:
         {
             status = packet_status::BERT;
-            corrected_errors += viterbi_decode_punctured(buffer.data(), deinterleaved.data(),
-                                    puncture_pattern_2, deinterleaved.size(), sizeof(puncture_pattern_2));
+            corrected_errors += viterbi::decode_punctured(buffer.data(), payload,
+                                    puncture_pattern_2, 2*SYM_PER_PLD, sizeof(puncture_pattern_2));
 
             // Iterate over bits
             for(size_t i = 7; i < 197+7; i++)
@@ -271,12 +338,30 @@ array<uint8_t, 30> m17rx::get_lsf() const
 vector<uint8_t> m17rx::get_payload() const
 {
     if(is_valid())
-        return *pkt_data;
+        return vector<uint8_t>(pkt_data.cbegin(), pkt_data.cbegin() + pkt_len);
 
     return vector<uint8_t>();
 
 }
 
+byte_span m17rx::payload() const
+{
+    if(is_valid())
+        return byte_span(pkt_data.data(), pkt_len);
+
+    return byte_span();
+}
+
+bool m17rx::is_foreign() const
+{
+    return (status == packet_status::FOREIGN);
+}
+
+size_t m17rx::skipped_frames() const
+{
+    return skipped;
+}
+
 bool m17rx::is_bert() const
 {
     return status == packet_status::BERT;
@@ -0,0 +1,79 @@
+/****************************************************************************
+ * M17Netd                                                                  *
+ * Copyright (C) 2024 by Morgan Diepart ON4MOD                              *
+ *                       SDR-Engineering SRL                                *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU Affero General Public License as published *
+ * by the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU Affero General Public License for more details.                      *
+ *                                                                          *
+ * You should have received a copy of the GNU Affero General Public License *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    *
+ ****************************************************************************/
+
+
+#include <atomic>
+
+#include "m17rx_pool.h"
+
+using namespace std;
+
+m17rx_pool::m17rx_pool(size_t size, const optional<m17rx::callsign_t> &destination):
+                       next(0), destination(destination), acquired(0), allocations(0)
+{
+    packets.reserve(size);
+    for(size_t i = 0; i < size; i++)
+        packets.push_back(create());
+}
+
+shared_ptr<m17rx> m17rx_pool::acquire()
+{
+    acquired++;
+
+    lock_guard<mutex> guard(lock);
+
+    // Packets are handed out in turn, the oldest one is the most likely to have been released. The count cannot go
+    // back up from 1 behind our back: only the pool copies its references, under the lock.
+    for(size_t i = 0; i < packets.size(); i++)
+    {
+        size_t index = (next + i) % packets.size();
+        if(packets[index].use_count() == 1)
+        {
+            // Pairs with the release of the last user, its accesses to the packet happen before the reset
+            atomic_thread_fence(memory_order_acquire);
+
+            next = (index + 1) % packets.size();
+            packets[index]->reset();
+            return packets[index];
+        }
+    }
+
+    // No packet left, the pool grows
+    allocations++;
+    packets.push_back(create());
+    next = 0;
+
+    return packets.back();
+}
+
+shared_ptr<m17rx> m17rx_pool::create() const
+{
+    shared_ptr<m17rx> packet = make_shared<m17rx>();
+    if(destination)
+        packet->set_destination(*destination);
+
+    return packet;
+}
+
+m17rx_pool::stats_t m17rx_pool::get_stats() const
+{
+    lock_guard<mutex> guard(lock);
+
+    return {packets.size(), acquired, allocations};
+}
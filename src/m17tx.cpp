@@ -24,7 +24,14 @@
 #include <memory>
 #include <iostream>
 #include <stdexcept>
-#include <numeric>
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#define M17TX_SIMD
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define M17TX_SIMD
+#endif
 
 #include <m17.h>
 
@@ -75,6 +82,24 @@ constexpr array<float, 161> m17tx::taps =
 -0.002258562030850857f
 };
 
+// The symbols are N samples apart in the zero-stuffed input of the RRC filter, each output only sees one tap out of N.
+// Output p of a symbol period, the newest symbol being m symbols old, is weighted by taps[N*m + p - (N-1)].
+const array<array<float, m17tx::N>, m17tx::branch_taps> m17tx::branches = []()
+{
+    array<array<float, N>, branch_taps> b = {};
+    for(size_t m = 0; m < branch_taps; m++)
+    {
+        for(size_t p = 0; p < N; p++)
+        {
+            long k = static_cast<long>(N*m + p) - static_cast<long>(N-1);
+            if(k >= 0 && k < static_cast<long>(nb_taps))
+                b[m][p] = taps[k];
+        }
+    }
+
+    return b;
+}();
+
 m17tx_pkt::m17tx_pkt(const string_view &src, const string_view &dst, const shared_ptr<vector<uint8_t>> ip_pkt): m17tx()
 {
     if(ip_pkt->size() > 822)
@@ -265,25 +290,75 @@ m17tx::~m17tx()
     delete(symbols);
 }
 
+void m17tx::interpolate(float *out) const
+{
+    // Accumulated in the order of the taps, as the zero-stuffed filter did. The phases are computed 4 at a time.
+#ifdef M17TX_SIMD
+#if defined(__aarch64__)
+    for(size_t p = 0; p < N; p += 4)
+    {
+        float32x4_t acc = vdupq_n_f32(0.0f);
+        for(size_t m = 0; m < branch_taps; m++)
+            acc = vaddq_f32(acc, vmulq_f32(vld1q_f32(&branches[m][p]), vdupq_n_f32(filt_buff[m])));
+        vst1q_f32(out + p, acc);
+    }
+#else
+    for(size_t p = 0; p < N; p += 4)
+    {
+        __m128 acc = _mm_setzero_ps();
+        for(size_t m = 0; m < branch_taps; m++)
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(&branches[m][p]), _mm_set1_ps(filt_buff[m])));
+        _mm_storeu_ps(out + p, acc);
+    }
+#endif
+#else
+    for(size_t p = 0; p < N; p++)
+    {
+        float acc = 0.0f;
+        for(size_t m = 0; m < branch_taps; m++)
+            acc += branches[m][p]*filt_buff[m];
+        out[p] = acc;
+    }
+#endif
+}
+
 vector<float> m17tx::get_baseband_samples(size_t n)
 {
     // Output baseband filtered signal
     vector<float> baseband = vector<float>();
     baseband.reserve(n);
 
+    const size_t total = (symbols->size() * N)+nb_taps/2;
+    array<float, N> period;
+
     for(size_t i = 0; i < n; i++)
     {
-        auto filt_buff_it = filt_buff.begin() + filt_offset;
-        float out = inner_product(taps.begin(), taps.end(), filt_buff_it, 0.0f);
+        float out;
+
+        if(filt_offset == N-1 && i + N <= n && bb_samples + N <= total)
+        {
+            // Whole symbol period, its last output reloads the filter below
+            interpolate(period.data());
+            baseband.insert(baseband.end(), period.begin(), period.end() - 1);
+            bb_samples += N-1;
+            i += N-1;
+            filt_offset = 0;
+            out = period[N-1];
+        }
+        else
+        {
+            // Single output, of the branch of the phase
+            size_t p = N-1-filt_offset;
+            out = 0.0f;
+            for(size_t m = 0; m < branch_taps; m++)
+                out += branches[m][p]*filt_buff[m];
+        }
 
         if(filt_offset == 0)
         {
             // Reload next sample
-            for(size_t j = 180; j >= N; j -= N)
-            {
-                // Shift only non-zero elements
-                filt_buff[j] = filt_buff[j-N];
-            }
+            for(size_t m = branch_taps-1; m > 0; m--)
+                filt_buff[m] = filt_buff[m-1];
 
             // If we used all symbols, use 0s instead
             if(sym_idx >= symbols->size() && sym_idx < symbols->size()+(nb_taps/N))
@@ -310,7 +385,7 @@ vector<float> m17tx::get_baseband_samples(size_t n)
         baseband.push_back(out);
 
         bb_samples++;
-        if(bb_samples >= (symbols->size() * N)+nb_taps/2)
+        if(bb_samples >= total)
         {
             break;
         }
@@ -34,7 +34,9 @@
 
 #include <m17.h>
 #include "config.h"
+#include "thread_sched.h"
 #include "m17tx.h"
+#include "tx_scheduler.h"
 
 using namespace std;
 
@@ -138,14 +140,19 @@ class m17_route
     in_addr route;
 };
 
-void m17tx_thread::operator()(atomic_bool &running, const config &cfg,
-                    ConsumerProducerQueue<shared_ptr<vector<uint8_t>>> &from_net,
-                    ConsumerProducerQueue<shared_ptr<m17tx_pkt>> &to_radio)
+void m17tx_thread::operator()(atomic_bool &running, const config &cfg, const threads_cfg &threads,
+                    SPSCQueue<shared_ptr<vector<uint8_t>>> &from_net,
+                    tx_scheduler &to_radio)
 {
+    set_thread_sched("m17tx", threads.m17tx);
+    print_thread_sched("m17tx");
+
     vector<peer_t> peers = cfg.getPeers();
-    const string_view src_callsign = cfg.getCallsign();
     map<m17_route, string> callsign_map;
 
+    // The scheduler holds the configuration parsed by main()
+    tx_classifier classifier(to_radio.get_config());
+
     // Parse peers in a map
     for(auto const &p : peers)
     {
@@ -216,9 +223,12 @@ void m17tx_thread::operator()(atomic_bool &running, const config &cfg,
         }
         else
         {
-            cout << "Received a packet (len=" << ntohs(packet->ip_len) << ") for " << ip << ". Sending to " << dst->second << "." << endl;
-            shared_ptr<m17tx_pkt> baseband_pkt = shared_ptr<m17tx_pkt>(new m17tx_pkt(src_callsign, dst->second, raw));
-            to_radio.add(baseband_pkt);
+            tx_class cls = classifier.classify(packet, raw->size());
+            cout << "Received a packet (len=" << ntohs(packet->ip_len) << ", class=" << static_cast<size_t>(cls) << ") for " << ip << ". Sending to " << dst->second << "." << endl;
+            if(to_radio.add(raw, dst->second, cls) < 0)
+            {
+                cerr << "Transmit queue full, dropping packet for " << ip << "." << endl;
+            }
         }
     }
 }
\ No newline at end of file
@@ -28,27 +28,98 @@
 #include <sstream>
 #include <fstream>
 #include <complex>
+#include <cmath>
+#include <thread>
+#include <chrono>
+#include <map>
+#include <optional>
+#include <algorithm>
 
 #include <netinet/ip.h>
 
 #include <liquid/liquid.h>
 #include <m17.h>
-#include <fftw3.h>
 
-#include "ConsumerProducer.h"
+#include "SPSCQueue.h"
 #include "sdrnode.h"
 #include "M17Demodulator.hpp"
+#include "rx_frontend.h"
+#include "rx_pool.h"
+#include "fec_pool.h"
+#include "carrier_sense.h"
 #include "m17rx.h"
 #include "m17tx.h"
 #include "radio_thread.h"
 #include "config.h"
+#include "thread_sched.h"
 
 using namespace std;
 
-void radio_simplex::operator()(atomic_bool &running, const config &cfg,
-                    ConsumerProducerQueue<shared_ptr<m17tx_pkt>> &to_radio,
-                    ConsumerProducerQueue<shared_ptr<m17rx>> &from_radio)
+void radio_simplex::capture(atomic_bool &capturing, sdrnode &radio, SPSCQueue<rx_block_t> &ring, atomic<size_t> &dropped)
 {
+    rx_block_t block;
+
+    while(capturing)
+    {
+        block.len = radio.receive(block.samples.data(), block_size);
+        if(block.len == 0)
+            continue;
+
+        // Never wait on the DSP thread, the radio would overrun instead
+        if(ring.try_add(block) < 0)
+            dropped++;
+    }
+}
+
+void radio_simplex::record_offset(const m17rx &packet, float offset)
+{
+    // A corrupted LSF would add a peer that does not exist and skew the learned offset
+    array<uint8_t, 30> lsf = packet.get_lsf();
+    if(CRC_M17(lsf.data(), lsf.size()) != 0)
+        return;
+
+    // The source callsign is in bytes 6 to 11 of the LSF
+    char src[10] = {0};
+    if(decode_callsign_bytes(src, &lsf[6]) < 0)
+        return;
+
+    auto peer = peer_offsets.find(src);
+    if(peer == peer_offsets.end())
+        peer_offsets.emplace(src, offset);
+    else
+        peer->second += afc_weight*(offset - peer->second);
+}
+
+float radio_simplex::learned_offset() const
+{
+    if(peer_offsets.empty())
+        return 0.0f;
+
+    float sum = 0.0f;
+    for(const auto &[callsign, offset] : peer_offsets)
+        sum += offset;
+
+    return sum/peer_offsets.size();
+}
+
+radio_simplex::capture_stats_t radio_simplex::get_capture_stats() const
+{
+    capture_stats_t stats;
+    stats.dropped = capture_dropped;
+    stats.overruns = capture_overruns;
+    stats.max_fill = capture_max_fill;
+
+    return stats;
+}
+
+void radio_simplex::operator()(atomic_bool &running, const config &cfg, const threads_cfg &threads,
+                    tx_scheduler &to_radio,
+                    SPSCQueue<shared_ptr<m17rx>> &from_radio)
+{
+    // Set before the workers are created, so that they start with it
+    set_thread_sched("radio", threads.radio);
+    print_thread_sched("radio");
+
     radio_thread_cfg radio_cfg;
     cfg.getRadioConfig(radio_cfg);
 
@@ -62,140 +133,268 @@ void radio_simplex::operator()(atomic_bool &running, const config &cfg,
     sdrnode_cfg sdrnode_cfg;
     cfg.getSDRNodeConfig(sdrnode_cfg);
 
-    // Initialize frequency modulator / demodulator
+    // Initialize frequency modulator
     fmod = freqmod_create(radio_cfg.k);
-    fdem = freqdem_create(radio_cfg.k);
 
-    // initialize DC remover and low pass filter
-    iirfilt_crcf dcr = iirfilt_crcf_create_dc_blocker(4.0/96000.0);
-    firfilt_crcf lpf = firfilt_crcf_create_kaiser(101, 5300.0/96000.0, 65, 0);
+    // DC remover, decimating channel filter and frequency demodulator, in float or fixed-point
+    rx_frontend frontend(radio_cfg.k, 4.0f/96000.0f, 5300.0f/96000.0f, 65.0f, rx_decimation);
+    rx_frontend_q15 frontend_q15(radio_cfg.k, 4.0f/96000.0f, 5300.0f/96000.0f, 65.0f, rx_decimation);
 
     shared_ptr<m17tx_pkt> packet;
 
     // Allocations
-    // Allocate the RX samples with fftw so that it is aligned for SIMD
-    complex<float>                      *rx_samples         = reinterpret_cast<complex<float>*>(fftwf_alloc_complex(block_size));
-    array<complex<float>, block_size>   *rx_samples_filt    = new array<complex<float>, block_size>();
     array<complex<float>, block_size>   *tx_samples         = new array<complex<float>, block_size>();
     array<float, block_size>            *rx_baseband        = new array<float, block_size>();
+    array<int16_t, block_size>          *rx_baseband_q15    = new array<int16_t, block_size>();
 
-    // FFT: we only compute the FFT of the first 512 points
-    complex<float> *rx_samples_fft = reinterpret_cast<complex<float>*>(fftwf_alloc_complex(fft_size));
-    fftwf_plan fft_plan = fftwf_plan_dft_1d(fft_size, reinterpret_cast<fftwf_complex*>(rx_samples), reinterpret_cast<fftwf_complex*>(rx_samples_fft), FFTW_FORWARD, FFTW_MEASURE);
+    // Soft frame buffers: two per demodulator and the queues of the FEC workers, they go from the demodulator to m17rx
+    // and back without being copied
+    frame_pool frames(2 + radio_cfg.fec_workers*(fec_pool::queue_frames + 2));
 
     // M17 Demodulator
-    M17::M17Demodulator demodulator;
+    M17::M17Demodulator< rx_samples_per_symbol > demodulator;
+    demodulator.setFramePool(&frames);
     demodulator.init();
 
+    // Several channels: filter bank, then one demodulator per channel on the workers.
+    // One channel: the frames of the demodulator are decoded on the FEC workers.
+    unique_ptr<rx_pool> pool;
+    unique_ptr<fec_pool> fec;
+
+    // The TUN thread only keeps the packets addressed to our callsign, the others are not decoded past their LSF
+    optional<m17rx::callsign_t> destination;
+    m17rx::callsign_t own_callsign;
+    if(encode_callsign_bytes(own_callsign.data(), string(cfg.getCallsign()).c_str()) == 0)
+        destination = own_callsign;
+    else
+        cerr << "Callsign " << cfg.getCallsign() << " cannot be encoded, all the packets received are decoded." << endl;
+
+    if(radio_cfg.channels > 1)
+    {
+        pool = make_unique<rx_pool>(radio_cfg.k, radio_cfg.channels, radio_cfg.rx_channels, radio_cfg.rx_workers,
+                                    threads.rx_workers, destination);
+
+        cout << "Receiving on " << radio_cfg.rx_channels.size() << " channel(s) out of " << radio_cfg.channels
+             << ", spaced by " << 96000/radio_cfg.channels << " Hz" << endl;
+    }
+    else
+    {
+        fec = make_unique<fec_pool>(radio_cfg.fec_workers, threads.fec_workers, destination);
+    }
+    rx_pool::rx_packet_t pool_packet;
+    fec_pool::rx_packet_t fec_packet;
+
+    // The demodulator measures the carrier offset of every transmission in
+    // baseband units, hz_per_unit converts it to Hz
+    const float hz_per_unit = radio_cfg.k*96000.0f;
+    float lo_correction = 0.0f; // Offset already corrected by the radio, in Hz
+
     // Create and initialize the radio
     sdrnode radio = sdrnode(radio_cfg.rx_freq, radio_cfg.tx_freq, radio_cfg.ppm);
     radio.set_rx_gain(sdrnode_cfg.lna_gain);
     radio.set_tx_gain(sdrnode_cfg.mix_gain);
 
-    bool channel_bsy = true;
+    // Samples are captured on a separate thread so that a long processing
+    // (e.g. Viterbi decoding of a full packet) does not delay the reads
+    SPSCQueue<rx_block_t> rx_ring("rx_ring", rx_ring_blocks);
+    rx_ring.setTimeout(chrono::milliseconds(100));
+    rx_block_t rx_block;
+    atomic_bool capturing = false;
+    size_t ring_max_fill = 0;
+    bool first_capture = true;
+
+    // Listen-before-talk, relative to the noise floor
+    carrier_sense_cfg sense_cfg;
+    cfg.getCarrierSenseConfig(sense_cfg);
+    carrier_sense sense(sense_cfg, 96000.0f, full_scale_power);
+
     while(running)
     {
-        // While the channel is busy or while there is nothing to send
-        // We keep receiving and (attempting to) demodulate
-        shared_ptr<m17rx> rx_packet = make_shared<m17rx>();
+        // Retune the radio when the offset learned from the peers has moved far enough
+        float learned = learned_offset();
+        if(radio_cfg.afc_feedback && fabs(learned) >= afc_min_step)
+        {
+            if(radio.set_freq_correction(lround(lo_correction + learned)) == 0)
+            {
+                lo_correction += learned;
+                for(auto &[callsign, offset] : peer_offsets)
+                    offset -= learned;
+                learned = 0.0f;
+                cout << "Radio LO corrected by " << lo_correction << " Hz" << endl;
+            }
+        }
+
+        // Start the acquisition of the next transmissions from the learned offset
+        demodulator.setFrequencyOffset(learned/hz_per_unit);
+        if(pool)
+            pool->set_frequency_offset(learned/hz_per_unit);
         radio.switch_rx();
 
-        while(running && (to_radio.isEmpty() || channel_bsy))
+        // The capture thread gets its own CPU set and a priority above this thread, so that it preempts the processing
+        capturing = true;
+        thread capture_thread = thread(capture, ref(capturing), ref(radio), ref(rx_ring), ref(capture_dropped));
+        set_thread_sched(capture_thread, "capture", threads.capture);
+        if(first_capture)
         {
-            int read = radio.receive(rx_samples, block_size);
-
-            // Remove DC offset (in-place)
-            iirfilt_crcf_execute_block(dcr, rx_samples, read, rx_samples);
+            print_thread_sched(capture_thread, "capture");
+            first_capture = false;
+        }
 
-            // Filter out-of-band signal
-            firfilt_crcf_execute_block(lpf, rx_samples, read, rx_samples_filt->data());
+        // While the channel is busy or while there is nothing to send
+        // We keep receiving and (attempting to) demodulate
+        while(running && (to_radio.isEmpty() || sense.is_busy()))
+        {
+            if(rx_ring.consume(rx_block) < 0)
+                continue;
 
-            // Frequency demodulation
-            freqdem_demodulate_block(fdem, rx_samples_filt->data(), read, rx_baseband->data());
+            size_t fill = rx_ring.length() + 1;
+            if(fill > ring_max_fill)
+                ring_max_fill = fill;
 
+            // Remove DC offset, filter out-of-band signal, decimate and demodulate in one pass.
+            // The front-end also tracks the power of the filtered samples for listen-before-talk.
             // Use OpenRTX demodulator
-            int new_frame = demodulator.update(rx_baseband->data(), read);
+            int new_frame;
+            if(pool)
+            {
+                pool->process(rx_block.samples.data(), rx_block.len);
+                new_frame = 0;
+
+                while(pool->fetch(pool_packet) == 0)
+                {
+                    record_offset(*pool_packet.packet, pool_packet.offset*hz_per_unit);
+                    if(!pool_packet.packet->is_foreign())
+                        from_radio.add(pool_packet.packet);
+                }
+            }
+            else if(radio_cfg.fixed_point_rx)
+            {
+                size_t read = frontend_q15.process(rx_block.samples.data(), rx_block.len, rx_baseband_q15->data());
+                new_frame = demodulator.update(rx_baseband_q15->data(), read);
+            }
+            else
+            {
+                size_t read = frontend.process(rx_block.samples.data(), rx_block.len, rx_baseband->data());
+                new_frame = demodulator.update(rx_baseband->data(), read);
+            }
 
+            // Derandomization, deinterleaving and Viterbi run on the FEC workers
             if(new_frame == 1)
             {
-                array<uint16_t, 2*SYM_PER_FRA> frame = demodulator.getFrame();
                 array<uint8_t, 2> sync_word = demodulator.getFrameSyncWord();
                 uint16_t sync_word_packed = (static_cast<uint16_t>(sync_word[0]) << 8) + sync_word[1];
 
-                rx_packet->add_frame(sync_word_packed, frame);
-
-                if(rx_packet->is_error())
-                {
-                    // If the packet is in error state, discard it
-                    rx_packet = make_shared<m17rx>();
-                }
-                else if(rx_packet->is_complete())
-                {
-                    // If this frame completes the packet, push it to the output queue
-                    from_radio.add(rx_packet);
-                    rx_packet = make_shared<m17rx>();
-                }
+                fec->add_frame(0, sync_word_packed, demodulator.takeFrame(), demodulator.getFrequencyOffset());
             }
             else if(new_frame == -1)
             {
-                rx_packet = make_shared<m17rx>();
+                fec->end_stream(0);
             }
 
-            if(!demodulator.isLocked())
+            while(fec && fec->fetch(fec_packet) == 0)
             {
-                fftwf_execute(fft_plan);
+                record_offset(*fec_packet.packet, fec_packet.offset*hz_per_unit);
 
-                // Re-use rx_samples to store the module of the array
-                complex<float> *in = rx_samples_fft;
+                // Push the completed packets to the output queue, the foreign ones are only used for their offset
+                if(!fec_packet.packet->is_foreign())
+                    from_radio.add(fec_packet.packet);
+            }
 
-                // measure the energy inside the channel, avoiding the DC component
-                float chan = 0;
-                for(size_t i = 2; i < half_chan_width-2; i++)
-                {
-                    chan += abs(in[i]);
-                }
-                for(size_t i = fft_size-half_chan_width; i < fft_size-1; i++)
-                {
-                    chan += abs(in[i]);
-                }
+            // The channel at the center of the capture is the one we transmit on.
+            // Power inside the channel filter, updated at each sample by the front-end.
+            bool locked = pool ? pool->is_locked(0) : demodulator.isLocked();
+            float chan;
+            if(pool)
+                chan = pool->get_band_power();
+            else if(radio_cfg.fixed_point_rx)
+                chan = frontend_q15.get_band_power();
+            else
+                chan = frontend.get_band_power();
+
+            if(sense.update(chan, locked, rx_block.len))
+            {
+                cout << "Channel now " << (sense.is_busy() ? "busy" : "free") << " (" << fixed << setprecision(1)
+                     << sense.get_power() << " dBFS, noise floor " << sense.get_noise_floor() << " dBFS)"
+                     << defaultfloat << endl;
+            }
+        }
 
-                // Check if there is more energy in the channel than elsewhere in the spectrum
-                if( (chan >= LBT_threshold) && !channel_bsy )
-                {
-                    // Channel is busy
-                    cout << "Channel now busy (chan=" << chan << ")" << endl;
-                    channel_bsy = true;
+        // Stop capturing before the radio is switched to TX, the packet being received is lost
+        capturing = false;
+        capture_thread.join();
+        if(fec)
+            fec->end_stream(0);
 
-                }
-                else if( (chan < LBT_threshold) && channel_bsy)
-                {
-                    // Channel is free
-                    cout << "Channel now free (chan=" << chan << ")" << endl;
-                    channel_bsy = false;
-                }
-                /*else
-                {
-                    static size_t counter = 0;
-                    if(counter >= 2000)
-                    {
-                        cout << "channel is " << (channel_bsy?"busy":"free") << ": chan=" << chan << " << endl;
-                        counter = 0;
-                    }
-                    counter++;
-                }*/ // Uncomment to display channel status every 2000 iters
-            }
+        capture_overruns = radio.get_rx_overruns();
+        if(ring_max_fill > capture_max_fill)
+            capture_max_fill = ring_max_fill;
+
+        cout << "RX ring: max fill " << ring_max_fill << "/" << rx_ring_blocks << " blocks, "
+             << capture_dropped << " blocks dropped, " << capture_overruns << " radio overruns" << endl;
+        if(pool)
+        {
+            frame_pool::stats_t buffers = pool->get_frame_stats();
+            cout << "RX channels: " << pool->get_dropped() << " blocks dropped by the workers, " << buffers.size
+                 << " frame buffers, " << buffers.allocations << " allocated after startup, " << buffers.copies
+                 << " frames copied" << endl;
+
+            rx_pool::stats_t decoded = pool->get_stats();
+            cout << "RX decoding: " << decoded.frames << " frames decoded, " << decoded.foreign
+                 << " superframes to other stations, " << decoded.skipped << " frames skipped, " << fixed
+                 << setprecision(2) << 1e3*decoded.saved << " ms of decoding saved" << defaultfloat << endl;
+
+            m17rx_pool::stats_t packets = pool->get_packet_stats();
+            cout << "RX packets: " << packets.size << " packets, " << packets.acquired << " taken, "
+                 << packets.allocations << " allocated after startup" << endl;
+        }
+        if(fec)
+        {
+            fec_pool::stats_t decoded = fec->get_stats();
+            cout << "FEC: " << decoded.frames << " frames decoded, " << decoded.dropped << " dropped, "
+                 << decoded.packets << " packets, latency mean " << fixed << setprecision(2) << 1e3*decoded.mean_latency
+                 << " ms, max " << 1e3*decoded.max_latency << " ms, decoding " << 1e3*decoded.mean_decode << " ms/frame"
+                 << defaultfloat << endl;
+            cout << "FEC: " << decoded.foreign << " superframes to other stations, " << decoded.skipped
+                 << " frames skipped, " << fixed << setprecision(2) << 1e3*decoded.saved << " ms of decoding saved"
+                 << defaultfloat << endl;
+
+            frame_pool::stats_t buffers = frames.get_stats();
+            cout << "Frame buffers: " << buffers.size << " buffers, " << buffers.acquired << " taken, "
+                 << buffers.allocations << " allocated after startup, " << buffers.copies << " frames copied" << endl;
+
+            m17rx_pool::stats_t packets = fec->get_packet_stats();
+            cout << "RX packets: " << packets.size << " packets, " << packets.acquired << " taken, "
+                 << packets.allocations << " allocated after startup" << endl;
+        }
+
+        const carrier_sense::stats_t &occupancy = sense.get_stats();
+        cout << "Channel occupancy: " << fixed << setprecision(1) << 100.0*occupancy.busy/max(occupancy.observed, 1e-9)
+             << "% of " << occupancy.observed << " s, " << occupancy.busy_periods << " busy periods, longest "
+             << setprecision(3) << occupancy.longest_busy << " s, noise floor " << setprecision(1)
+             << sense.get_noise_floor() << " dBFS" << defaultfloat << endl;
+
+        if(!peer_offsets.empty())
+        {
+            cout << "Carrier offsets (Hz):";
+            for(const auto &[callsign, offset] : peer_offsets)
+                cout << " " << callsign << " " << fixed << setprecision(0) << offset << defaultfloat;
+            cout << endl;
         }
+        rx_ring.clear();
+        ring_max_fill = 0;
 
         if(running)
             radio.switch_tx();
 
+        // Packets are fetched one at a time so that a packet of a higher class
+        // queued during a transmission goes out before the lower classes
         while(running && (!to_radio.isEmpty()))
         {
-            int ret = to_radio.consume(packet);
-            if(ret < 0)
+            int cls = to_radio.consume(packet);
+            if(cls < 0)
                 break;
 
-            cout << "Fetched packet for radio." << endl;
+            cout << "Fetched packet of class " << cls << " for radio." << endl;
             do
             {
                 vector<float> tx_baseband = packet->get_baseband_samples(block_size);
@@ -203,19 +402,25 @@ void radio_simplex::operator()(atomic_bool &running, const config &cfg,
                 radio.transmit(tx_samples->data(), tx_samples->size());
             }
             while(running && (packet->baseband_samples_left() > 0));
+
+            packet.reset();
         }
-    }
 
-    iirfilt_crcf_destroy(dcr);
-    firfilt_crcf_destroy(lpf);
+        if(running)
+        {
+            const tx_scheduler::stats_t &stats = to_radio.get_stats();
+            cout << "TX queue stats (sent/full/aqm dropped/aqm marked):";
+            for(size_t c = 0; c < tx_scheduler::nb_classes; c++)
+            {
+                cout << " [" << c << "] " << stats.sent[c] << "/" << stats.dropped[c] << "/" << stats.aqm_dropped[c] << "/" << stats.aqm_marked[c];
+            }
+            cout << endl;
+        }
+    }
 
-    fftwf_destroy_plan(fft_plan);
-    fftwf_free(rx_samples);
-    fftwf_free(rx_samples_fft);
-    fftwf_cleanup();
     delete(rx_baseband);
+    delete(rx_baseband_q15);
     delete(tx_samples);
 
     freqmod_destroy(fmod);
-    freqdem_destroy(fdem);
 }
@@ -0,0 +1,871 @@
+/****************************************************************************
+ * M17Netd                                                                  *
+ * Copyright (C) 2024 by Morgan Diepart ON4MOD                              *
+ *                       SDR-Engineering SRL                                *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU Affero General Public License as published *
+ * by the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU Affero General Public License for more details.                      *
+ *                                                                          *
+ * You should have received a copy of the GNU Affero General Public License *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    *
+ ****************************************************************************/
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#define RX_FRONTEND_SIMD
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define RX_FRONTEND_SIMD
+#endif
+
+#include "rx_frontend.h"
+
+using namespace std;
+
+namespace
+{
+
+constexpr float pi_f = 3.14159265358979f;
+
+// Minimax polynomial for atan(x) on [0, 1], max error ~1e-6 rad
+constexpr float atan_c[6] = {0.99997726f, -0.33262347f, 0.19354346f, -0.11643287f, 0.05265332f, -0.01172120f};
+
+/**
+ * Modified Bessel function of the first kind, order 0
+ */
+double bessel_i0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for(unsigned k = 1; k < 32; k++)
+    {
+        term *= (x/2.0)/k;
+        sum += term*term;
+    }
+
+    return sum;
+}
+
+/**
+ * Kaiser windowed sinc low-pass filter, unity gain at DC
+ */
+array<double, rx_frontend::nb_taps> kaiser_lowpass(float fc, float As)
+{
+    // Kaiser window parameter for the requested attenuation
+    double beta;
+    if(As > 50.0)
+        beta = 0.1102*(As - 8.7);
+    else if(As > 21.0)
+        beta = 0.5842*pow(As - 21.0, 0.4) + 0.07886*(As - 21.0);
+    else
+        beta = 0.0;
+
+    constexpr size_t nb_taps = rx_frontend::nb_taps;
+    array<double, nb_taps> h;
+    double sum = 0.0;
+    for(size_t i = 0; i < nb_taps; i++)
+    {
+        double t = static_cast<double>(i) - (nb_taps-1)/2.0;
+        double x = 2.0*fc*t;
+        double sinc = (t == 0.0) ? 1.0 : sin(M_PI*x)/(M_PI*x);
+        double r = 2.0*t/nb_taps;
+        h[i] = sinc * bessel_i0(beta*sqrt(1.0 - r*r)) / bessel_i0(beta);
+        sum += h[i];
+    }
+
+    for(auto &tap : h)
+        tap /= sum;
+
+    return h;
+}
+
+/**
+ * Branch-free atan2, same algorithm as the vector version
+ */
+inline float fast_atan2(float y, float x)
+{
+    float ax = fabsf(x);
+    float ay = fabsf(y);
+    float a = min(ax, ay) / max(max(ax, ay), 1e-30f);
+    float s = a*a;
+    float r = ((((( atan_c[5]*s + atan_c[4])*s + atan_c[3])*s + atan_c[2])*s + atan_c[1])*s + atan_c[0])*a;
+
+    r = (ay > ax) ? pi_f/2 - r : r;
+    r = (x < 0.0f) ? pi_f - r : r;
+    return (y < 0.0f) ? -r : r;
+}
+
+#ifdef RX_FRONTEND_SIMD
+// Minimal 4 x float vector abstraction over NEON and SSE2
+#if defined(__aarch64__)
+typedef float32x4_t vf;
+typedef uint32x4_t vm;
+inline vf vf_load(const float *p) { return vld1q_f32(p); }
+inline void vf_store(float *p, vf a) { vst1q_f32(p, a); }
+inline vf vf_set(float a) { return vdupq_n_f32(a); }
+inline vf vf_add(vf a, vf b) { return vaddq_f32(a, b); }
+inline vf vf_sub(vf a, vf b) { return vsubq_f32(a, b); }
+inline vf vf_mul(vf a, vf b) { return vmulq_f32(a, b); }
+inline vf vf_mla(vf acc, vf a, vf b) { return vmlaq_f32(acc, a, b); }
+inline vf vf_div(vf a, vf b) { return vdivq_f32(a, b); }
+inline vf vf_min(vf a, vf b) { return vminq_f32(a, b); }
+inline vf vf_max(vf a, vf b) { return vmaxq_f32(a, b); }
+inline vf vf_abs(vf a) { return vabsq_f32(a); }
+inline vm vf_gt(vf a, vf b) { return vcgtq_f32(a, b); }
+inline vf vf_select(vm m, vf a, vf b) { return vbslq_f32(m, a, b); }
+inline float vf_hsum(vf a) { return vaddvq_f32(a); }
+#else
+typedef __m128 vf;
+typedef __m128 vm;
+inline vf vf_load(const float *p) { return _mm_loadu_ps(p); }
+inline void vf_store(float *p, vf a) { _mm_storeu_ps(p, a); }
+inline vf vf_set(float a) { return _mm_set1_ps(a); }
+inline vf vf_add(vf a, vf b) { return _mm_add_ps(a, b); }
+inline vf vf_sub(vf a, vf b) { return _mm_sub_ps(a, b); }
+inline vf vf_mul(vf a, vf b) { return _mm_mul_ps(a, b); }
+inline vf vf_mla(vf acc, vf a, vf b) { return _mm_add_ps(acc, _mm_mul_ps(a, b)); }
+inline vf vf_div(vf a, vf b) { return _mm_div_ps(a, b); }
+inline vf vf_min(vf a, vf b) { return _mm_min_ps(a, b); }
+inline vf vf_max(vf a, vf b) { return _mm_max_ps(a, b); }
+inline vf vf_abs(vf a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+inline vm vf_gt(vf a, vf b) { return _mm_cmpgt_ps(a, b); }
+inline vf vf_select(vm m, vf a, vf b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+inline float vf_hsum(vf a)
+{
+    __m128 s = _mm_add_ps(a, _mm_movehl_ps(a, a));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+#endif
+
+/**
+ * Vector version of fast_atan2
+ */
+inline vf vf_atan2(vf y, vf x)
+{
+    const vf zero = vf_set(0.0f);
+    vf ax = vf_abs(x);
+    vf ay = vf_abs(y);
+    vf a = vf_div(vf_min(ax, ay), vf_max(vf_max(ax, ay), vf_set(1e-30f)));
+    vf s = vf_mul(a, a);
+
+    vf r = vf_mla(vf_set(atan_c[4]), vf_set(atan_c[5]), s);
+    r = vf_mla(vf_set(atan_c[3]), r, s);
+    r = vf_mla(vf_set(atan_c[2]), r, s);
+    r = vf_mla(vf_set(atan_c[1]), r, s);
+    r = vf_mla(vf_set(atan_c[0]), r, s);
+    r = vf_mul(r, a);
+
+    r = vf_select(vf_gt(ay, ax), vf_sub(vf_set(pi_f/2), r), r);
+    r = vf_select(vf_gt(zero, x), vf_sub(vf_set(pi_f), r), r);
+    return vf_select(vf_gt(zero, y), vf_sub(zero, r), r);
+}
+#endif
+
+}
+
+rx_frontend::rx_frontend(float kf, float dc_alpha, float fc, float As, size_t decimation):
+                         decimation((decimation > 0) ? decimation : 1),
+                         power(static_cast<float>(this->decimation)/max_chunk)
+{
+    array<double, nb_taps> h = kaiser_lowpass(fc, As);
+    for(size_t i = 0; i < nb_taps; i++)
+    {
+        taps[i] = h[nb_taps-1-i];
+    }
+
+    dc_pole = 1.0f - dc_alpha;
+    // After decimation the phase rotates decimation times faster between two samples
+    gain = 1.0f / (2.0f*pi_f*kf*this->decimation);
+
+    reset();
+}
+
+void rx_frontend::reset()
+{
+    hist_i.fill(0.0f);
+    hist_q.fill(0.0f);
+    filt_i.fill(0.0f);
+    filt_q.fill(0.0f);
+    dc_x_i = dc_x_q = 0.0f;
+    dc_y_i = dc_y_q = 0.0f;
+    decim_phase = 0;
+    power.reset();
+}
+
+float rx_frontend::get_band_power() const
+{
+    return power.get();
+}
+
+size_t rx_frontend::process(const complex<int32_t> *in, size_t n, float *out, complex<float> *dc_out)
+{
+    size_t produced = 0;
+
+    while(n > 0)
+    {
+        size_t len = min(n, max_chunk);
+        produced += process_chunk(in, len, out + produced, dc_out);
+
+        in += len;
+        if(dc_out != nullptr)
+            dc_out += len;
+        n -= len;
+    }
+
+    return produced;
+}
+
+size_t rx_frontend::process_chunk(const complex<int32_t> *in, size_t n, float *out, complex<float> *dc_out)
+{
+    // Same scaling as int32_to_float<24, 8>
+    constexpr float scale = 1.0f / static_cast<float>((1 << 23) - 1);
+    constexpr size_t hlen = nb_taps-1;
+
+    float *xi = hist_i.data() + hlen;
+    float *xq = hist_q.data() + hlen;
+
+    // Conversion and DC removal. The IIR is recursive, only I and Q are independent.
+    for(size_t j = 0; j < n; j++)
+    {
+        float si = static_cast<float>(static_cast<int32_t>(static_cast<uint32_t>(in[j].real()) << 8)) * scale;
+        float sq = static_cast<float>(static_cast<int32_t>(static_cast<uint32_t>(in[j].imag()) << 8)) * scale;
+
+        dc_y_i = si - dc_x_i + dc_pole*dc_y_i;
+        dc_y_q = sq - dc_x_q + dc_pole*dc_y_q;
+        dc_x_i = si;
+        dc_x_q = sq;
+
+        xi[j] = dc_y_i;
+        xq[j] = dc_y_q;
+    }
+
+    if(dc_out != nullptr)
+    {
+        for(size_t j = 0; j < n; j++)
+        {
+            dc_out[j] = complex<float>(xi[j], xq[j]);
+        }
+    }
+
+    // Channel filter
+    size_t m = (decimation > 1) ? filter_decimate(n) : filter(n);
+    power.update(&filt_i[1], &filt_q[1], m);
+
+    // FM discriminator: arg(x[n] * conj(x[n-1]))
+    size_t j = 0;
+#ifdef RX_FRONTEND_SIMD
+    const vf g = vf_set(gain);
+    for(; j + 4 <= m; j += 4)
+    {
+        vf a = vf_load(&filt_i[1+j]);
+        vf b = vf_load(&filt_q[1+j]);
+        vf c = vf_load(&filt_i[j]);
+        vf d = vf_load(&filt_q[j]);
+
+        vf re = vf_add(vf_mul(a, c), vf_mul(b, d));
+        vf im = vf_sub(vf_mul(b, c), vf_mul(a, d));
+        vf_store(out+j, vf_mul(vf_atan2(im, re), g));
+    }
+#endif
+    for(; j < m; j++)
+    {
+        float re = filt_i[1+j]*filt_i[j] + filt_q[1+j]*filt_q[j];
+        float im = filt_q[1+j]*filt_i[j] - filt_i[1+j]*filt_q[j];
+        out[j] = fast_atan2(im, re) * gain;
+    }
+
+    // Keep the history for the next chunk
+    memmove(hist_i.data(), hist_i.data() + n, hlen*sizeof(float));
+    memmove(hist_q.data(), hist_q.data() + n, hlen*sizeof(float));
+    filt_i[0] = filt_i[m];
+    filt_q[0] = filt_q[m];
+
+    return m;
+}
+
+size_t rx_frontend::filter(size_t n)
+{
+    // filt[1+j] = sum(taps[k] * hist[j+k])
+    size_t j = 0;
+#ifdef RX_FRONTEND_SIMD
+    // 8 outputs per iteration, the accumulators stay in registers
+    for(; j + 8 <= n; j += 8)
+    {
+        vf ai0 = vf_set(0.0f), ai1 = vf_set(0.0f);
+        vf aq0 = vf_set(0.0f), aq1 = vf_set(0.0f);
+        const float *pi = hist_i.data() + j;
+        const float *pq = hist_q.data() + j;
+
+        for(size_t k = 0; k < nb_taps; k++)
+        {
+            vf h = vf_set(taps[k]);
+            ai0 = vf_mla(ai0, vf_load(pi+k), h);
+            ai1 = vf_mla(ai1, vf_load(pi+k+4), h);
+            aq0 = vf_mla(aq0, vf_load(pq+k), h);
+            aq1 = vf_mla(aq1, vf_load(pq+k+4), h);
+        }
+
+        vf_store(&filt_i[1+j], ai0);
+        vf_store(&filt_i[5+j], ai1);
+        vf_store(&filt_q[1+j], aq0);
+        vf_store(&filt_q[5+j], aq1);
+    }
+#endif
+    for(; j < n; j++)
+    {
+        float ai = 0.0f, aq = 0.0f;
+        for(size_t k = 0; k < nb_taps; k++)
+        {
+            ai += taps[k]*hist_i[j+k];
+            aq += taps[k]*hist_q[j+k];
+        }
+        filt_i[1+j] = ai;
+        filt_q[1+j] = aq;
+    }
+
+    return n;
+}
+
+size_t rx_frontend::filter_decimate(size_t n)
+{
+    // Only one output every decimation samples is computed, this costs the
+    // same as running each polyphase branch at the output rate.
+    size_t m = 0;
+    size_t j = decim_phase;
+    for(; j < n; j += decimation)
+    {
+        const float *pi = hist_i.data() + j;
+        const float *pq = hist_q.data() + j;
+        float ai = 0.0f, aq = 0.0f;
+        size_t k = 0;
+#ifdef RX_FRONTEND_SIMD
+        vf vi = vf_set(0.0f), vq = vf_set(0.0f);
+        for(; k + 4 <= nb_taps; k += 4)
+        {
+            vf h = vf_load(&taps[k]);
+            vi = vf_mla(vi, vf_load(pi+k), h);
+            vq = vf_mla(vq, vf_load(pq+k), h);
+        }
+        ai = vf_hsum(vi);
+        aq = vf_hsum(vq);
+#endif
+        for(; k < nb_taps; k++)
+        {
+            ai += taps[k]*pi[k];
+            aq += taps[k]*pq[k];
+        }
+
+        filt_i[1+m] = ai;
+        filt_q[1+m] = aq;
+        m++;
+    }
+
+    decim_phase = j - n;
+
+    return m;
+}
+
+namespace
+{
+
+constexpr int32_t pi_q15 = 102944;  // pi in Q15
+
+// atan_c in Q15
+constexpr int32_t atan_q15[6] = {32767, -10899, 6342, -3815, 1725, -384};
+
+/**
+ * Integer atan2, same polynomial as fast_atan2. Branch free but for the division, the signs of the samples are
+ * random in noise.
+ *
+ * @return the angle in Q15 radians
+ */
+inline int32_t fast_atan2_q15(int32_t y, int32_t x)
+{
+    uint32_t ax = (x < 0) ? -static_cast<uint32_t>(x) : static_cast<uint32_t>(x);
+    uint32_t ay = (y < 0) ? -static_cast<uint32_t>(y) : static_cast<uint32_t>(y);
+    uint32_t mn = min(ax, ay);
+    uint32_t mx = max(ax, ay) | 1;
+
+    // Keep at most 16 significant bits so that the ratio is a 32 bits division
+    int sh = max(16 - __builtin_clz(mx), 0);
+    mn >>= sh;
+    mx >>= sh;
+
+    int32_t a = static_cast<int32_t>((mn << 15) / mx);
+    int32_t s = (a*a) >> 15;
+    int32_t p = atan_q15[5];
+    for(int k = 4; k >= 0; k--)
+        p = ((p*s) >> 15) + atan_q15[k];
+    p = (p*a) >> 15;
+
+    // Octant: p = pi/2 - p when |y| > |x|, pi - p when x < 0, -p when y < 0
+    int32_t m = -static_cast<int32_t>(ay > ax);
+    p = (p ^ m) - m + (m & (pi_q15/2));
+    m = x >> 31;
+    p = (p ^ m) - m + (m & pi_q15);
+    m = y >> 31;
+    return (p ^ m) - m;
+}
+
+/**
+ * Dot products of rx_frontend_q15::nb_taps Q15 I and Q samples with the taps, accumulated on 32 bits
+ */
+inline void dot_q15(const int16_t *xi, const int16_t *xq, const int16_t *h, int32_t &ri, int32_t &rq)
+{
+    constexpr size_t n = rx_frontend_q15::nb_taps;
+#if defined(__aarch64__)
+    int32x4_t acc_i = vdupq_n_s32(0);
+    int32x4_t acc_q = vdupq_n_s32(0);
+#pragma GCC unroll 13
+    for(size_t k = 0; k < n; k += 8)
+    {
+        int16x8_t t = vld1q_s16(h+k);
+        int16x8_t a = vld1q_s16(xi+k);
+        int16x8_t b = vld1q_s16(xq+k);
+        acc_i = vmlal_s16(acc_i, vget_low_s16(a), vget_low_s16(t));
+        acc_i = vmlal_high_s16(acc_i, a, t);
+        acc_q = vmlal_s16(acc_q, vget_low_s16(b), vget_low_s16(t));
+        acc_q = vmlal_high_s16(acc_q, b, t);
+    }
+    int32x4_t s = vpaddq_s32(acc_i, acc_q);
+    s = vpaddq_s32(s, s);
+    ri = vgetq_lane_s32(s, 0);
+    rq = vgetq_lane_s32(s, 1);
+#elif defined(__SSE2__)
+    __m128i acc_i = _mm_setzero_si128();
+    __m128i acc_q = _mm_setzero_si128();
+#pragma GCC unroll 13
+    for(size_t k = 0; k < n; k += 8)
+    {
+        __m128i t = _mm_load_si128(reinterpret_cast<const __m128i *>(h+k));
+        acc_i = _mm_add_epi32(acc_i, _mm_madd_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(xi+k)), t));
+        acc_q = _mm_add_epi32(acc_q, _mm_madd_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(xq+k)), t));
+    }
+    // [i0+i2, q0+q2, i1+i3, q1+q3], then [i, q, i, q]
+    __m128i s = _mm_add_epi32(_mm_unpacklo_epi32(acc_i, acc_q), _mm_unpackhi_epi32(acc_i, acc_q));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+    ri = _mm_cvtsi128_si32(s);
+    rq = _mm_cvtsi128_si32(_mm_shuffle_epi32(s, 0x55));
+#else
+    ri = rq = 0;
+    for(size_t k = 0; k < n; k++)
+    {
+        ri += static_cast<int32_t>(xi[k]) * h[k];
+        rq += static_cast<int32_t>(xq[k]) * h[k];
+    }
+#endif
+}
+
+/**
+ * Saturates to the symmetric Q15 range, so that the sum of two products of samples fits in 32 bits
+ */
+inline int16_t sat_q15(int64_t x)
+{
+    return static_cast<int16_t>(clamp<int64_t>(x, -32767, 32767));
+}
+
+}
+
+rx_frontend_q15::rx_frontend_q15(float kf, float dc_alpha, float fc, float As, size_t decimation):
+                                 decimation((decimation > 0) ? decimation : 1)
+{
+    constexpr size_t pad = nb_taps - rx_frontend::nb_taps;
+
+    array<double, rx_frontend::nb_taps> h = kaiser_lowpass(fc, As);
+    taps.fill(0);
+    for(size_t i = 0; i < rx_frontend::nb_taps; i++)
+    {
+        taps[pad+i] = sat_q15(llround(h[rx_frontend::nb_taps-1-i] * 32768.0));
+    }
+
+    this->dc_alpha = llround(static_cast<double>(dc_alpha) * 2147483648.0);
+    gain = llround(32768.0 / (2.0*M_PI*kf*this->decimation));
+
+    reset();
+}
+
+void rx_frontend_q15::reset()
+{
+    hist_i.fill(0);
+    hist_q.fill(0);
+    filt_i.fill(0);
+    filt_q.fill(0);
+    dc_avg_i = dc_avg_q = 0;
+    shift = 0;
+    quiet = 0;
+    decim_phase = 0;
+    power = 0;
+}
+
+float rx_frontend_q15::get_band_power() const
+{
+    // Same scaling as int32_to_float<24, 8>, which converts the samples shifted left by 8 bits
+    constexpr double scale = static_cast<double>(1 << 8) / ((1 << 23) - 1);
+    return static_cast<float>(ldexp(static_cast<double>(power), -power_frac_bits) * scale * scale);
+}
+
+size_t rx_frontend_q15::process(const complex<int32_t> *in, size_t n, int16_t *out, complex<float> *dc_out)
+{
+    size_t produced = 0;
+
+    while(n > 0)
+    {
+        size_t len = min(n, max_chunk);
+        produced += process_chunk(in, len, out + produced, dc_out);
+
+        in += len;
+        if(dc_out != nullptr)
+            dc_out += len;
+        n -= len;
+    }
+
+    return produced;
+}
+
+size_t rx_frontend_q15::process_chunk(const complex<int32_t> *in, size_t n, int16_t *out, complex<float> *dc_out)
+{
+    constexpr size_t hlen = nb_taps-1;
+
+    // Sign extension of the 24 bits samples and DC removal. The DC is constant over the chunk,
+    // so that the loops have no dependency between samples.
+    const int32_t dc_i_int = static_cast<int32_t>(dc_avg_i >> 16);
+    const int32_t dc_q_int = static_cast<int32_t>(dc_avg_q >> 16);
+    int64_t sum_i = 0, sum_q = 0;
+    int32_t peak = 0;
+    for(size_t j = 0; j < n; j++)
+    {
+        int32_t si = static_cast<int32_t>(static_cast<uint32_t>(in[j].real()) << 8) >> 8;
+        int32_t sq = static_cast<int32_t>(static_cast<uint32_t>(in[j].imag()) << 8) >> 8;
+        sum_i += si;
+        sum_q += sq;
+
+        dc_i[j] = si - dc_i_int;
+        dc_q[j] = sq - dc_q_int;
+        peak = max(peak, max(abs(dc_i[j]), abs(dc_q[j])));
+    }
+
+    // Leaky average of the input: dc += alpha * (x - dc) for each sample of the chunk, the error is in 2^-8 LSB
+    dc_avg_i += (((sum_i << 8) - static_cast<int64_t>(n) * (dc_avg_i >> 8)) * dc_alpha) >> 23;
+    dc_avg_q += (((sum_q << 8) - static_cast<int64_t>(n) * (dc_avg_q >> 8)) * dc_alpha) >> 23;
+
+    if(dc_out != nullptr)
+    {
+        // Same scaling as int32_to_float<24, 8>, which converts the samples shifted left by 8 bits
+        constexpr float scale = static_cast<float>(1 << 8) / static_cast<float>((1 << 23) - 1);
+        for(size_t j = 0; j < n; j++)
+        {
+            dc_out[j] = complex<float>(dc_i[j]*scale, dc_q[j]*scale);
+        }
+    }
+
+    // Block exponent: raised at once when the chunk would exceed half scale,
+    // lowered one bit at a time after a while below a quarter of the scale
+    int new_shift = shift;
+    if((peak >> shift) >= (1 << 14))
+    {
+        while(new_shift < max_shift && (peak >> new_shift) >= (1 << 14))
+            new_shift++;
+        quiet = 0;
+    }
+    else if(shift > 0 && (peak >> shift) < (1 << 12))
+    {
+        if(++quiet >= quiet_limit)
+        {
+            new_shift--;
+            quiet = 0;
+        }
+    }
+    else
+    {
+        quiet = 0;
+    }
+
+    if(new_shift != shift)
+        rescale(new_shift);
+
+    int16_t *xi = hist_i.data() + hlen;
+    int16_t *xq = hist_q.data() + hlen;
+    for(size_t j = 0; j < n; j++)
+    {
+        xi[j] = static_cast<int16_t>(clamp(dc_i[j] >> shift, -32767, 32767));
+        xq[j] = static_cast<int16_t>(clamp(dc_q[j] >> shift, -32767, 32767));
+    }
+
+    // Channel filter
+    size_t m = filter_decimate(n);
+
+    // Band power, alpha = decimation/max_chunk = decimation/2^7. At most 2^31 << 20 per sample before the fractional
+    // bits, the product by decimation stays within 64 bits.
+    static_assert(max_chunk == (1 << 7), "the band power weight is a shift by log2(max_chunk)");
+    for(size_t j = 0; j < m; j++)
+    {
+        int64_t fi = filt_i[1+j], fq = filt_q[1+j];
+        int64_t e = (fi*fi + fq*fq) << (2*shift + power_frac_bits);
+        power += ((e - power) * static_cast<int64_t>(decimation)) >> 7;
+    }
+
+    // FM discriminator: arg(x[n] * conj(x[n-1]))
+    for(size_t j = 0; j < m; j++)
+    {
+        int32_t a = filt_i[1+j], b = filt_q[1+j];
+        int32_t c = filt_i[j],   d = filt_q[j];
+        int32_t phase = fast_atan2_q15(b*c - a*d, a*c + b*d);
+
+        out[j] = sat_q15((static_cast<int64_t>(phase) * gain) >> (30 - out_frac_bits));
+    }
+
+    // Keep the history for the next chunk
+    memmove(hist_i.data(), hist_i.data() + n, hlen*sizeof(int16_t));
+    memmove(hist_q.data(), hist_q.data() + n, hlen*sizeof(int16_t));
+    filt_i[0] = filt_i[m];
+    filt_q[0] = filt_q[m];
+
+    return m;
+}
+
+size_t rx_frontend_q15::filter_decimate(size_t n)
+{
+    size_t m = 0;
+    size_t j = decim_phase;
+    for(; j < n; j += decimation)
+    {
+        int32_t ai, aq;
+        dot_q15(hist_i.data() + j, hist_q.data() + j, taps.data(), ai, aq);
+
+        filt_i[1+m] = sat_q15((static_cast<int64_t>(ai) + (1 << 14)) >> 15);
+        filt_q[1+m] = sat_q15((static_cast<int64_t>(aq) + (1 << 14)) >> 15);
+        m++;
+    }
+
+    decim_phase = j - n;
+
+    return m;
+}
+
+void rx_frontend_q15::rescale(int new_shift)
+{
+    constexpr size_t hlen = nb_taps-1;
+
+    if(new_shift > shift)
+    {
+        int d = new_shift - shift;
+        for(size_t k = 0; k < hlen; k++)
+        {
+            hist_i[k] >>= d;
+            hist_q[k] >>= d;
+        }
+        filt_i[0] >>= d;
+        filt_q[0] >>= d;
+    }
+    else
+    {
+        // Only lowered after a while below a quarter of the scale, this cannot overflow
+        int d = shift - new_shift;
+        for(size_t k = 0; k < hlen; k++)
+        {
+            hist_i[k] = static_cast<int16_t>(hist_i[k] * (1 << d));
+            hist_q[k] = static_cast<int16_t>(hist_q[k] * (1 << d));
+        }
+        filt_i[0] = static_cast<int16_t>(filt_i[0] * (1 << d));
+        filt_q[0] = static_cast<int16_t>(filt_q[0] * (1 << d));
+    }
+
+    shift = new_shift;
+}
+
+rx_channelizer::rx_channelizer(float kf, size_t nb_channels, const vector<int> &channels, float dc_alpha, float fc,
+                               float As, size_t decimation):
+                               rotations(channels.size()), last(channels.size()),
+                               nb_bins(nb_channels), decimation((decimation > 0) ? decimation : 1),
+                               power(static_cast<float>(this->decimation)/max_chunk)
+{
+    constexpr size_t pad = nb_taps - rx_frontend::nb_taps;
+
+    array<double, rx_frontend::nb_taps> h = kaiser_lowpass(fc, As);
+    taps.fill(0.0f);
+    for(size_t i = 0; i < rx_frontend::nb_taps; i++)
+    {
+        taps[pad+i] = h[rx_frontend::nb_taps-1-i];
+    }
+
+    // Channel k is shifted to DC by exp(-2j*pi*k*t/nb_bins), t being the index of the sample. The window ends on the
+    // newest sample, t = phase - lag, and the lag of the taps in partial sum q is 103 - q modulo 8, thus modulo
+    // nb_bins.
+    for(size_t c = 0; c < channels.size(); c++)
+    {
+        for(size_t phase = 0; phase < nb_bins; phase++)
+        {
+            for(size_t q = 0; q < 8; q++)
+            {
+                long t = static_cast<long>(phase) - static_cast<long>(nb_taps - 1 - q);
+                double arg = -2.0*M_PI*channels[c]*t/static_cast<double>(nb_bins);
+                rotations[c][phase][q] = complex<float>(cos(arg), sin(arg));
+            }
+        }
+    }
+
+    dc_pole = 1.0f - dc_alpha;
+    gain = 1.0f / (2.0f*pi_f*kf*this->decimation);
+
+    reset();
+}
+
+void rx_channelizer::reset()
+{
+    hist_i.fill(0.0f);
+    hist_q.fill(0.0f);
+    fill(last.begin(), last.end(), complex<float>(0.0f, 0.0f));
+    dc_x_i = dc_x_q = 0.0f;
+    dc_y_i = dc_y_q = 0.0f;
+    decim_phase = 0;
+    sample_phase = 0;
+    power.reset();
+}
+
+float rx_channelizer::get_band_power() const
+{
+    return power.get();
+}
+
+size_t rx_channelizer::process(const complex<int32_t> *in, size_t n, float *const *out, complex<float> *dc_out)
+{
+    size_t produced = 0;
+    array<float *, max_channels> chunk_out;
+
+    while(n > 0)
+    {
+        size_t len = min(n, max_chunk);
+        for(size_t c = 0; c < last.size(); c++)
+            chunk_out[c] = out[c] + produced;
+
+        produced += process_chunk(in, len, chunk_out.data(), dc_out);
+
+        in += len;
+        if(dc_out != nullptr)
+            dc_out += len;
+        n -= len;
+    }
+
+    return produced;
+}
+
+size_t rx_channelizer::process_chunk(const complex<int32_t> *in, size_t n, float *const *out, complex<float> *dc_out)
+{
+    // Same scaling as int32_to_float<24, 8>
+    constexpr float scale = 1.0f / static_cast<float>((1 << 23) - 1);
+    constexpr size_t hlen = nb_taps-1;
+
+    float *xi = hist_i.data() + hlen;
+    float *xq = hist_q.data() + hlen;
+
+    for(size_t j = 0; j < n; j++)
+    {
+        float si = static_cast<float>(static_cast<int32_t>(static_cast<uint32_t>(in[j].real()) << 8)) * scale;
+        float sq = static_cast<float>(static_cast<int32_t>(static_cast<uint32_t>(in[j].imag()) << 8)) * scale;
+
+        dc_y_i = si - dc_x_i + dc_pole*dc_y_i;
+        dc_y_q = sq - dc_x_q + dc_pole*dc_y_q;
+        dc_x_i = si;
+        dc_x_q = sq;
+
+        xi[j] = dc_y_i;
+        xq[j] = dc_y_q;
+    }
+
+    if(dc_out != nullptr)
+    {
+        for(size_t j = 0; j < n; j++)
+        {
+            dc_out[j] = complex<float>(xi[j], xq[j]);
+        }
+    }
+
+    size_t m = 0;
+    size_t j = decim_phase;
+    for(; j < n; j += decimation)
+    {
+        // Filter the window ending on sample j into 8 interleaved partial sums
+        const float *pi = hist_i.data() + j;
+        const float *pq = hist_q.data() + j;
+        alignas(16) array<float, 8> si, sq;
+#ifdef RX_FRONTEND_SIMD
+        vf ai0 = vf_set(0.0f), ai1 = vf_set(0.0f);
+        vf aq0 = vf_set(0.0f), aq1 = vf_set(0.0f);
+        for(size_t k = 0; k < nb_taps; k += 8)
+        {
+            vf h0 = vf_load(&taps[k]);
+            vf h1 = vf_load(&taps[k+4]);
+            ai0 = vf_mla(ai0, vf_load(pi+k), h0);
+            ai1 = vf_mla(ai1, vf_load(pi+k+4), h1);
+            aq0 = vf_mla(aq0, vf_load(pq+k), h0);
+            aq1 = vf_mla(aq1, vf_load(pq+k+4), h1);
+        }
+        vf_store(&si[0], ai0);
+        vf_store(&si[4], ai1);
+        vf_store(&sq[0], aq0);
+        vf_store(&sq[4], aq1);
+#else
+        si.fill(0.0f);
+        sq.fill(0.0f);
+        for(size_t k = 0; k < nb_taps; k += 8)
+        {
+            for(size_t q = 0; q < 8; q++)
+            {
+                si[q] += taps[k+q]*pi[k+q];
+                sq[q] += taps[k+q]*pq[k+q];
+            }
+        }
+#endif
+
+        // The center channel needs no rotation
+        float ci = 0.0f, cq = 0.0f;
+        for(size_t q = 0; q < 8; q++)
+        {
+            ci += si[q];
+            cq += sq[q];
+        }
+        power.update(ci, cq);
+
+        // Shift each channel to DC and demodulate it
+        size_t phase = (sample_phase + j) % nb_bins;
+        for(size_t c = 0; c < last.size(); c++)
+        {
+            const array<complex<float>, 8> &rot = rotations[c][phase];
+            float yi = 0.0f, yq = 0.0f;
+            for(size_t q = 0; q < 8; q++)
+            {
+                yi += si[q]*rot[q].real() - sq[q]*rot[q].imag();
+                yq += si[q]*rot[q].imag() + sq[q]*rot[q].real();
+            }
+
+            // FM discriminator: arg(y[n] * conj(y[n-1]))
+            float re = yi*last[c].real() + yq*last[c].imag();
+            float im = yq*last[c].real() - yi*last[c].imag();
+            out[c][m] = fast_atan2(im, re) * gain;
+            last[c] = complex<float>(yi, yq);
+        }
+
+        m++;
+    }
+
+    decim_phase = j - n;
+    sample_phase = (sample_phase + n) % nb_bins;
+
+    // Keep the history for the next chunk
+    memmove(hist_i.data(), hist_i.data() + n, hlen*sizeof(float));
+    memmove(hist_q.data(), hist_q.data() + n, hlen*sizeof(float));
+
+    return m;
+}
@@ -0,0 +1,231 @@
+/****************************************************************************
+ * M17Netd                                                                  *
+ * Copyright (C) 2024 by Morgan Diepart ON4MOD                              *
+ *                       SDR-Engineering SRL                                *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU Affero General Public License as published *
+ * by the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU Affero General Public License for more details.                      *
+ *                                                                          *
+ * You should have received a copy of the GNU Affero General Public License *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    *
+ ****************************************************************************/
+
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <algorithm>
+
+#include <m17.h>
+
+#include "rx_pool.h"
+#include "thread_sched.h"
+
+using namespace std;
+
+rx_pool::rx_pool(float kf, size_t nb_channels, const vector<int> &channels, size_t nb_workers, const thread_cfg &sched,
+                 const optional<m17rx::callsign_t> &destination):
+                 channelizer(kf, nb_channels, channels, 4.0f/96000.0f, 5300.0f/96000.0f, 65.0f, decimation),
+                 frames(3*channels.size()),
+                 rx_packets(channels.size()*(queue_packets + 1) + packets_in_flight, destination),
+                 running(true), offset(0.0f), offset_gen(0), dropped(0), decoded_frames(0), decode_sum(0),
+                 foreign_packets(0), skipped_frames(0), next_fetch(0)
+{
+    for(int index : channels)
+    {
+        unique_ptr<channel_t> channel = make_unique<channel_t>();
+        channel->index = index;
+        channel->demodulator.setFramePool(&frames);
+        channel->demodulator.init();
+        channel->packet = rx_packets.acquire();
+        channel->locked = false;
+        this->channels.push_back(move(channel));
+    }
+
+    nb_workers = clamp<size_t>(nb_workers, 1, channels.size());
+    for(size_t w = 0; w < nb_workers; w++)
+    {
+        unique_ptr<worker_t> worker = make_unique<worker_t>();
+        worker->blocks.setTimeout(chrono::milliseconds(100));
+        for(size_t c = w; c < channels.size(); c += nb_workers)
+            worker->channels.push_back(c);
+        workers.push_back(move(worker));
+    }
+
+    for(size_t w = 0; w < workers.size(); w++)
+    {
+        workers[w]->t = thread(&rx_pool::work, this, ref(*workers[w]));
+        set_thread_sched(workers[w]->t, "rx_worker" + to_string(w), sched);
+    }
+}
+
+rx_pool::~rx_pool()
+{
+    running = false;
+    for(auto &worker : workers)
+        worker->t.join();
+}
+
+void rx_pool::process(const complex<int32_t> *in, size_t n, complex<float> *dc_out)
+{
+    array<float *, rx_channelizer::max_channels> out;
+    for(size_t c = 0; c < channels.size(); c++)
+        out[c] = baseband[c].data();
+
+    block.len = channelizer.process(in, n, out.data(), dc_out);
+
+    for(auto &worker : workers)
+    {
+        for(size_t i = 0; i < worker->channels.size(); i++)
+            copy_n(baseband[worker->channels[i]].begin(), block.len, block.samples[i].begin());
+
+        // Never wait on a worker, the radio would overrun instead
+        if(worker->blocks.try_add(block) < 0)
+            dropped++;
+    }
+}
+
+int rx_pool::fetch(rx_packet_t &packet)
+{
+    for(size_t i = 0; i < workers.size(); i++)
+    {
+        worker_t &worker = *workers[(next_fetch + i) % workers.size()];
+        if(worker.packets.try_consume(packet) >= 0)
+        {
+            next_fetch = (next_fetch + i + 1) % workers.size();
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+bool rx_pool::is_locked(int channel) const
+{
+    for(const auto &c : channels)
+    {
+        if(c->index == channel)
+            return c->locked;
+    }
+
+    return false;
+}
+
+float rx_pool::get_band_power() const
+{
+    return channelizer.get_band_power();
+}
+
+void rx_pool::set_frequency_offset(float offset)
+{
+    this->offset = offset;
+    offset_gen++;
+}
+
+size_t rx_pool::get_dropped() const
+{
+    return dropped;
+}
+
+frame_pool::stats_t rx_pool::get_frame_stats() const
+{
+    return frames.get_stats();
+}
+
+rx_pool::stats_t rx_pool::get_stats() const
+{
+    stats_t stats = {decoded_frames, foreign_packets, skipped_frames, 0.0, 0.0};
+    if(stats.frames > 0)
+        stats.mean_decode = 1e-9*decode_sum/stats.frames;
+    stats.saved = stats.skipped*stats.mean_decode;
+
+    return stats;
+}
+
+m17rx_pool::stats_t rx_pool::get_packet_stats() const
+{
+    return rx_packets.get_stats();
+}
+
+void rx_pool::work(worker_t &worker)
+{
+    block_t *work_block = new block_t();
+    unsigned applied_gen = 0;
+
+    while(running)
+    {
+        if(worker.blocks.consume(*work_block) < 0)
+            continue;
+
+        if(offset_gen != applied_gen)
+        {
+            applied_gen = offset_gen;
+            for(size_t c : worker.channels)
+                channels[c]->demodulator.setFrequencyOffset(offset);
+        }
+
+        for(size_t i = 0; i < worker.channels.size(); i++)
+        {
+            channel_t &channel = *channels[worker.channels[i]];
+
+            int new_frame = channel.demodulator.update(work_block->samples[i].data(), work_block->len);
+            channel.locked = channel.demodulator.isLocked();
+
+            if(new_frame == 1)
+            {
+                array<uint8_t, 2> sync_word = channel.demodulator.getFrameSyncWord();
+                uint16_t sync_word_packed = (static_cast<uint16_t>(sync_word[0]) << 8) + sync_word[1];
+
+                // A foreign packet never completes, the next LSF starts a new one
+                if(sync_word_packed == SYNC_LSF && channel.packet->is_foreign())
+                    channel.packet = rx_packets.acquire();
+
+                size_t skipped = channel.packet->skipped_frames();
+                auto start = chrono::steady_clock::now();
+                channel.packet->add_frame(sync_word_packed, channel.demodulator.takeFrame());
+
+                if(channel.packet->skipped_frames() != skipped)
+                {
+                    // Frame of a superframe addressed to another station, not decoded
+                    skipped_frames++;
+                    continue;
+                }
+                decoded_frames++;
+                decode_sum += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+
+                if(channel.packet->is_error())
+                {
+                    // If the packet is in error state, discard it
+                    channel.packet = rx_packets.acquire();
+                }
+                else if(channel.packet->is_complete())
+                {
+                    rx_packet_t done = {channel.packet, channel.index, channel.demodulator.getFrequencyOffset()};
+                    if(worker.packets.try_add(done) < 0)
+                        cerr << "rx_pool: packet received on channel " << channel.index << " dropped, queue full." << endl;
+
+                    channel.packet = rx_packets.acquire();
+                }
+                else if(channel.packet->is_foreign())
+                {
+                    // The source and the carrier offset of the other stations are still of use to the calling thread
+                    rx_packet_t foreign = {channel.packet, channel.index, channel.demodulator.getFrequencyOffset()};
+                    worker.packets.try_add(foreign);
+                    foreign_packets++;
+                }
+            }
+            else if(new_frame == -1)
+            {
+                channel.packet = rx_packets.acquire();
+            }
+        }
+    }
+
+    delete work_block;
+}
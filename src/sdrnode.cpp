@@ -327,6 +327,8 @@ size_t sdrnode::receive(complex<float> *rx, size_t n)
 
         snd_pcm_sframes_t read = snd_pcm_readi(pcm_hdl, buff, n);
 
+        if(read == -EPIPE)
+            rx_overruns++;
         if(read < 0)
             read = snd_pcm_recover(pcm_hdl, read, 0);
         if(read < 0)
@@ -353,6 +355,8 @@ size_t sdrnode::receive(complex<int32_t> *rx, size_t n)
     {
         snd_pcm_sframes_t read = snd_pcm_readi(pcm_hdl, rx, n);
 
+        if(read == -EPIPE)
+            rx_overruns++;
         if(read < 0)
             read = snd_pcm_recover(pcm_hdl, read, 0);
         if(read < 0)
@@ -443,4 +447,19 @@ int sdrnode::set_tx_gain(unsigned gain)
 void sdrnode::set_tx_high(const bool high)
 {
     tx_high = high;
-}
\ No newline at end of file
+}
+
+size_t sdrnode::get_rx_overruns() const
+{
+    return rx_overruns;
+}
+
+int sdrnode::set_freq_correction(const long rx_offset)
+{
+    int64_t tx_offset = (static_cast<int64_t>(rx_offset)*static_cast<int64_t>(tx_frequency))/static_cast<int64_t>(rx_frequency);
+
+    if(sx1255.set_rx_freq(rx_frequency + rx_offset) < 0)
+        return -1;
+
+    return sx1255.set_tx_freq(tx_frequency + tx_offset);
+}
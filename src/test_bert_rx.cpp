@@ -159,7 +159,7 @@ int main(int argc, char *argv[])
     complex<float> buffer[block_size] = {0};
     float baseband[block_size] = {0};
 
-    M17Demodulator m17demod;
+    M17Demodulator<> m17demod;
     m17demod.init();
 
     freqdem fdem = freqdem_create(kf);
@@ -0,0 +1,178 @@
+/****************************************************************************
+ * M17Netd                                                                  *
+ * Copyright (C) 2024 by Morgan Diepart ON4MOD                              *
+ *                       SDR-Engineering SRL                                *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU Affero General Public License as published *
+ * by the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU Affero General Public License for more details.                      *
+ *                                                                          *
+ * You should have received a copy of the GNU Affero General Public License *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    *
+ ****************************************************************************/
+
+
+#include <vector>
+#include <array>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <cmath>
+#include <cstring>
+#include <m17.h>
+
+#include "rx_frontend.h"
+#include "carrier_sense.h"
+#include "test_bursts.h"
+
+using namespace std;
+
+constexpr float  sample_rate      = 96000.0f;
+constexpr size_t block_size       = 128;
+constexpr float  kf               = 0.0375f;
+constexpr size_t decimation       = 2;
+constexpr float  full_scale_power = 65536.0f;     // The front-end scales the samples to 256
+constexpr float  fixed_threshold  = 3.3e-3f;      // Threshold of the band power before the noise floor tracking, -73 dBFS
+
+constexpr float  burst_period     = 0.4f;         // A transmission starts every 400 ms
+constexpr float  burst_length     = 0.15f;        // and lasts 150 ms
+
+/**
+ * Generates n I/Q samples at 96 kHz: white gaussian noise and bursts of an M17 signal of random symbols.
+ * The noise and the signal are 20 dB stronger after gain_step samples, as if the LNA gain had been raised.
+ *
+ * @param signal power of the bursts in dBFS, before the gain step
+ * @param noise power of the noise in dBFS, before the gain step
+ * @param busy receives, for each block, whether a burst covers it
+ */
+vector<complex<int32_t>> generate(size_t n, float signal, float noise, size_t gain_step, vector<bool> &busy)
+{
+    mt19937 rng(1);
+    normal_distribution<double> awgn(0.0, 1.0);
+    vector<double> phase = fm_phase(n, kf, 0.0f, rng);
+
+    const size_t period = burst_period*sample_rate;
+    const size_t length = burst_length*sample_rate;
+
+    vector<complex<int32_t>> iq(n);
+    busy.assign(n/block_size, false);
+    for(size_t i = 0; i < n; i++)
+    {
+        double gain = (i < gain_step) ? 0.0 : 20.0;
+        bool on = (i % period) >= period/2 && (i % period) < period/2 + length;
+        double amplitude = on ? pow(10.0, (signal + gain)/20.0) : 0.0;
+        double sigma = pow(10.0, (noise + gain)/20.0)/sqrt(2.0);
+
+        iq[i] = to_s24(polar(amplitude, phase[i]) + sigma*complex<double>(awgn(rng), awgn(rng)));
+
+        if(on && i/block_size < busy.size())
+            busy[i/block_size] = true;
+    }
+
+    return iq;
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc >= 2 && strcmp(argv[1], "help") == 0)
+    {
+        cout << "Usage: " << argv[0] << " [snr]\n"
+             << "\tsnr                 power of the bursts relative to the noise in the channel, in dB (default 10)."
+             << endl;
+        return EXIT_SUCCESS;
+    }
+
+    float snr = (argc >= 2) ? strtof(argv[1], nullptr) : 10.0f;
+
+    // The channel filter keeps about 11% of the noise, 9.6 dB less than at the input
+    constexpr float noise = -80.0f;
+    const float signal = noise - 9.6f + snr;
+
+    const size_t n = 12*sample_rate;
+    const size_t gain_step = n/2;
+    vector<bool> truth;
+    vector<complex<int32_t>> iq = generate(n, signal, noise, gain_step, truth);
+
+    carrier_sense_cfg cfg = {0.1f, 100.0f, 6.0f, 3.0f, 20, 5};
+    carrier_sense sense(cfg, sample_rate, full_scale_power);
+    rx_frontend frontend(kf, 4.0f/96000.0f, 5300.0f/96000.0f, 65.0f, decimation);
+    array<float, block_size> baseband;
+
+    // Decisions counted per period: [fixed threshold, carrier sense][false busy, false free]
+    struct period_t
+    {
+        const char *name;
+        float start, end;           // In seconds
+        size_t free, busy;          // Blocks of each state, margins excluded
+        array<array<size_t, 2>, 2> errors;
+        float floor;                // Noise floor at the end of the period
+    };
+    array<period_t, 3> periods =
+    {{
+        {"before the gain step  ",  1.0f,  6.0f, 0, 0, {}, 0.0f},
+        {"first 2 s after it    ",  6.0f,  8.0f, 0, 0, {}, 0.0f},
+        {"following 4 s         ",  8.0f, 12.0f, 0, 0, {}, 0.0f},
+    }};
+
+    // Blocks near the edges of the bursts are not counted: the filter delays the power and the channel is held busy
+    // for free_hold after a burst
+    const size_t margin = 0.01f*sample_rate/block_size;
+
+    for(size_t b = 0; b < truth.size(); b++)
+    {
+        frontend.process(&iq[b*block_size], block_size, baseband.data());
+        float power = frontend.get_band_power();
+        sense.update(power, false, block_size);
+
+        float t = (b + 1)*block_size/sample_rate;
+        for(auto &p : periods)
+        {
+            if(t < p.start || t >= p.end)
+                continue;
+
+            p.floor = sense.get_noise_floor();
+
+            bool edge = false;
+            for(size_t k = (b > margin) ? b - margin : 0; k <= min(b + margin, truth.size() - 1); k++)
+                edge |= (truth[k] != truth[b]);
+            if(edge)
+                continue;
+
+            bool decisions[2] = {power >= fixed_threshold, sense.is_busy()};
+            (truth[b] ? p.busy : p.free)++;
+            for(size_t d = 0; d < 2; d++)
+            {
+                if(decisions[d] && !truth[b])
+                    p.errors[d][0]++;
+                else if(!decisions[d] && truth[b])
+                    p.errors[d][1]++;
+            }
+        }
+    }
+
+    cout << "Bursts at " << snr << " dB SNR in the channel, noise " << noise << " dBFS then "
+         << noise + 20.0f << " dBFS after " << gain_step/sample_rate << " s (false busy/false free):" << endl;
+    for(const auto &p : periods)
+    {
+        cout << "  " << p.name << fixed << setprecision(1)
+             << " fixed threshold " << setw(5) << 100.0*p.errors[0][0]/max<size_t>(p.free, 1) << "%/"
+             << setw(5) << 100.0*p.errors[0][1]/max<size_t>(p.busy, 1) << "%,"
+             << " carrier sense " << setw(5) << 100.0*p.errors[1][0]/max<size_t>(p.free, 1) << "%/"
+             << setw(5) << 100.0*p.errors[1][1]/max<size_t>(p.busy, 1) << "%,"
+             << " noise floor " << p.floor << " dBFS" << defaultfloat << endl;
+    }
+
+    const carrier_sense::stats_t &stats = sense.get_stats();
+    cout << "Channel occupancy: " << fixed << setprecision(1) << 100.0*stats.busy/stats.observed << "% of "
+         << stats.observed << " s (bursts " << 100.0*burst_length/burst_period << "%), " << stats.busy_periods
+         << " busy periods (" << static_cast<size_t>(n/(burst_period*sample_rate)) << " bursts), longest "
+         << setprecision(3) << stats.longest_busy << " s" << defaultfloat << endl;
+
+    return EXIT_SUCCESS;
+}
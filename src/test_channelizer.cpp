@@ -0,0 +1,181 @@
+/****************************************************************************
+ * M17Netd                                                                  *
+ * Copyright (C) 2024 by Morgan Diepart ON4MOD                              *
+ *                       SDR-Engineering SRL                                *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU Affero General Public License as published *
+ * by the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU Affero General Public License for more details.                      *
+ *                                                                          *
+ * You should have received a copy of the GNU Affero General Public License *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    *
+ ****************************************************************************/
+
+
+#include <vector>
+#include <array>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <m17.h>
+
+#include "M17Demodulator.hpp"
+#include "rx_frontend.h"
+#include "test_bursts.h"
+
+using namespace std;
+
+constexpr float  kf          = 0.0375f;
+constexpr size_t nb_channels = 8;
+constexpr size_t block_size  = 128;
+constexpr size_t decimation  = 2;
+
+/**
+ * Generates a 96 kHz M17 baseband made of bursts of packet superframes,
+ * delayed by a silence that depends on the seed.
+ *
+ * @param frames: receives the hard bits of every frame transmitted.
+ */
+vector<float> generate(size_t bursts, unsigned seed, vector<frame_bits_t> &frames)
+{
+    mt19937 rng(seed);
+
+    // Bursts of each channel start at different times
+    return rrc_shape(burst_symbols(bursts, rng, &frames, 480 + 200*seed));
+}
+
+/**
+ * Counts the transmitted frames demodulated without any bit error.
+ */
+size_t count_received(const vector<float> &baseband, const vector<frame_bits_t> &frames)
+{
+    M17::M17Demodulator< 20 / decimation > demod;
+    demod.init();
+
+    vector<bool> received(frames.size(), false);
+    for(size_t i = 0; i + 64 <= baseband.size(); i += 64)
+    {
+        if(demod.update(&baseband[i], 64) != 1)
+            continue;
+
+        const auto &soft = demod.getFrame();
+        for(size_t f = 0; f < frames.size(); f++)
+        {
+            size_t dist = 0;
+            for(size_t b = 0; b < soft.size(); b++)
+                dist += ((soft[b] > 0x7FFF) != frames[f][b]);
+
+            if(dist == 0)
+                received[f] = true;
+        }
+    }
+
+    return count(received.begin(), received.end(), true);
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc >= 2 && strcmp(argv[1], "help") == 0)
+    {
+        cout << "Usage: " << argv[0] << " [noise]\n"
+             << "\tnoise               standard deviation of the noise added to the I/Q samples, relative to the signals (default 0.05)."
+             << endl;
+        return EXIT_SUCCESS;
+    }
+
+    float noise = (argc >= 2) ? strtof(argv[1], nullptr) : 0.05f;
+
+    // One transmission on each of three channels, 12 kHz apart
+    const vector<int> channels = {-1, 0, 2};
+    vector<vector<frame_bits_t>> frames(channels.size());
+    vector<vector<float>> basebands;
+    size_t length = 0;
+    for(size_t c = 0; c < channels.size(); c++)
+    {
+        basebands.push_back(generate(2, c + 1, frames[c]));
+        length = max(length, basebands[c].size());
+    }
+
+    mt19937 rng(17);
+    normal_distribution<float> awgn(0.0f, noise);
+    constexpr double amplitude = 1000000.0;
+    vector<complex<int32_t>> iq(length / block_size * block_size);
+    vector<double> phases(channels.size(), 0.0);
+    for(size_t i = 0; i < iq.size(); i++)
+    {
+        complex<double> sum = 0.0;
+        for(size_t c = 0; c < channels.size(); c++)
+        {
+            float bb = (i < basebands[c].size()) ? basebands[c][i] : 0.0f;
+            phases[c] += 2.0*M_PI*kf*bb + 2.0*M_PI*channels[c]/nb_channels;
+            sum += polar(1.0, phases[c]);
+        }
+
+        sum = (sum + complex<double>(awgn(rng), awgn(rng))) * amplitude;
+        iq[i] = complex<int32_t>(lround(sum.real()) & 0xFFFFFF, lround(sum.imag()) & 0xFFFFFF);
+    }
+
+    // Split the capture and demodulate every channel
+    rx_channelizer channelizer(kf, nb_channels, channels, 4.0f/96000.0f, 5300.0f/96000.0f, 65.0f, decimation);
+    vector<vector<float>> outputs(channels.size(), vector<float>(iq.size()/decimation + 1));
+    size_t produced = 0;
+    for(size_t i = 0; i < iq.size(); i += block_size)
+    {
+        array<float *, rx_channelizer::max_channels> out;
+        for(size_t c = 0; c < channels.size(); c++)
+            out[c] = outputs[c].data() + produced;
+
+        produced += channelizer.process(&iq[i], block_size, out.data());
+    }
+
+    for(size_t c = 0; c < channels.size(); c++)
+    {
+        outputs[c].resize(produced);
+        size_t good = count_received(outputs[c], frames[c]);
+        cout << "Channel " << showpos << channels[c] << noshowpos << " (" << channels[c]*96000/static_cast<int>(nb_channels)
+             << " Hz): " << good << "/" << frames[c].size() << " frames received without error" << endl;
+    }
+
+    // Cost of the filter bank against the single channel front-end
+    vector<float> out(block_size);
+    rx_frontend frontend(kf, 4.0f/96000.0f, 5300.0f/96000.0f, 65.0f, decimation);
+    auto start = chrono::steady_clock::now();
+    for(size_t i = 0; i < iq.size(); i += block_size)
+        frontend.process(&iq[i], block_size, out.data());
+    double frontend_time = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "rx_frontend, 1 channel: " << fixed << setprecision(2)
+         << 1e6*frontend_time/(iq.size()/block_size) << " us/block" << defaultfloat << endl;
+
+    for(size_t n : {1, 3, 8})
+    {
+        vector<int> bench_channels(n);
+        for(size_t c = 0; c < n; c++)
+            bench_channels[c] = static_cast<int>(c) - static_cast<int>(nb_channels/2);
+
+        rx_channelizer bench(kf, nb_channels, bench_channels, 4.0f/96000.0f, 5300.0f/96000.0f, 65.0f, decimation);
+        vector<vector<float>> bench_out(n, vector<float>(block_size));
+        array<float *, rx_channelizer::max_channels> bench_ptr;
+        for(size_t c = 0; c < n; c++)
+            bench_ptr[c] = bench_out[c].data();
+
+        start = chrono::steady_clock::now();
+        for(size_t i = 0; i < iq.size(); i += block_size)
+            bench.process(&iq[i], block_size, bench_ptr.data());
+        double time = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        cout << "rx_channelizer, " << n << " channel(s) out of " << nb_channels << ": " << fixed << setprecision(2)
+             << 1e6*time/(iq.size()/block_size) << " us/block" << defaultfloat << endl;
+    }
+
+    return EXIT_SUCCESS;
+}
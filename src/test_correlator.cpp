@@ -0,0 +1,192 @@
+/****************************************************************************
+ * M17Netd                                                                  *
+ * Copyright (C) 2024 by Morgan Diepart ON4MOD                              *
+ *                       SDR-Engineering SRL                                *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU Affero General Public License as published *
+ * by the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU Affero General Public License for more details.                      *
+ *                                                                          *
+ * You should have received a copy of the GNU Affero General Public License *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    *
+ ****************************************************************************/
+
+#include <array>
+#include <vector>
+#include <iostream>
+#include <random>
+#include <chrono>
+#include <numeric>
+#include <cstring>
+
+#include "Correlator.hpp"
+#include "SyncwordBank.hpp"
+
+using namespace std;
+
+/**
+ * Reference implementation of Correlator::full_convolve: two-part dot product
+ * over the circular buffer.
+ */
+template < size_t SYNCW_SIZE, size_t SAMPLES_PER_SYM >
+int32_t reference_convolve(const Correlator< SYNCW_SIZE, SAMPLES_PER_SYM > &correlator,
+                           const array< int16_t, (SYNCW_SIZE-1)*SAMPLES_PER_SYM+1 > &syncword)
+{
+    const int16_t *samples = correlator.data();
+    size_t buffer_size = correlator.bufferSize();
+    size_t pos = (correlator.index() + SAMPLES_PER_SYM + 1) % buffer_size;
+
+    int64_t acc = 0;
+    size_t l1 = min( (buffer_size-pos), syncword.size() );
+    acc = inner_product(samples + pos, samples + pos + l1, syncword.begin(), acc);
+    acc = inner_product(syncword.begin() + l1, syncword.end(), samples, acc);
+
+    return (acc>>13);
+}
+
+/**
+ * Checks full_convolve and the syncword bank against the reference on random
+ * data and measures them
+ *
+ * @return the number of mismatches
+ */
+template < size_t SAMPLES_PER_SYM >
+size_t run(size_t nb_samples)
+{
+    constexpr size_t syncw_samples = 7*SAMPLES_PER_SYM+1;
+
+    mt19937 rng(SAMPLES_PER_SYM);
+    uniform_int_distribution<int> full(-32768, 32767);
+    uniform_int_distribution<int> tmpl(-32767, 32767);
+
+    array< int16_t, syncw_samples > syncword;
+    for(auto &x : syncword)
+        x = tmpl(rng);
+
+    vector<int16_t> input(nb_samples);
+    for(auto &x : input)
+        x = full(rng);
+
+    // Templates of the syncword bank, and the opposite of the LSF and packet ones
+    using Bank = SyncwordBank< 8, SAMPLES_PER_SYM >;
+    array< typename Bank::template_t, 5 > lanes;
+    for(size_t l = 0; l < 3; l++)
+    {
+        for(auto &x : lanes[l])
+            x = tmpl(rng);
+    }
+    for(size_t i = 0; i < syncw_samples; i++)
+    {
+        lanes[3][i] = -lanes[1][i];
+        lanes[4][i] = -lanes[0][i];
+    }
+    Bank bank(lanes[0], lanes[1], lanes[2]);
+    const typename Bank::Lane lane_of[5] = {Bank::LSF, Bank::PACKET, Bank::EOT, Bank::BERT, Bank::STREAM};
+
+    // Bit-exactness, checked on every sample
+    Correlator< 8, SAMPLES_PER_SYM > correlator;
+    size_t errors = 0;
+    size_t bank_errors = 0;
+    for(auto x : input)
+    {
+        correlator.sample(x);
+        if(correlator.full_convolve(syncword) != reference_convolve(correlator, syncword))
+            errors++;
+
+        bank.update(correlator);
+        for(size_t l = 0; l < 5; l++)
+        {
+            if(bank[lane_of[l]] != reference_convolve(correlator, lanes[l]))
+                bank_errors++;
+        }
+    }
+
+    // Throughput
+    Correlator< 8, SAMPLES_PER_SYM > c_ref;
+    int64_t sink = 0;
+    auto start = chrono::steady_clock::now();
+    for(auto x : input)
+    {
+        c_ref.sample(x);
+        sink += reference_convolve(c_ref, syncword);
+    }
+    double ref_ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+
+    Correlator< 8, SAMPLES_PER_SYM > c_new;
+    start = chrono::steady_clock::now();
+    for(auto x : input)
+    {
+        c_new.sample(x);
+        sink -= c_new.full_convolve(syncword);
+    }
+    double new_ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+
+    // LSF, packet and EOT correlations: one full_convolve per syncword or one bank update
+    Correlator< 8, SAMPLES_PER_SYM > c_sep;
+    start = chrono::steady_clock::now();
+    for(auto x : input)
+    {
+        c_sep.sample(x);
+        sink += c_sep.full_convolve(lanes[0]) + c_sep.full_convolve(lanes[1]) + c_sep.full_convolve(lanes[2]);
+    }
+    double sep_ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+
+    Correlator< 8, SAMPLES_PER_SYM > c_bank;
+    start = chrono::steady_clock::now();
+    for(auto x : input)
+    {
+        c_bank.sample(x);
+        bank.update(c_bank);
+        sink -= bank[Bank::LSF] + bank[Bank::PACKET] + bank[Bank::EOT];
+    }
+    double bank_ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+
+    cout << SAMPLES_PER_SYM << " samples per symbol: " << errors << " mismatches over " << nb_samples << " samples" << endl;
+    cout << "\treference:     " << ref_ns/nb_samples << " ns/sample" << endl;
+    cout << "\tfull_convolve: " << new_ns/nb_samples << " ns/sample (x" << ref_ns/new_ns << ")" << endl;
+    cout << "\tsyncword bank: " << bank_errors << " mismatches over " << 5*nb_samples << " correlations" << endl;
+    cout << "\t3 x full_convolve: " << sep_ns/nb_samples << " ns/sample" << endl;
+    cout << "\tbank update:       " << bank_ns/nb_samples << " ns/sample (x" << sep_ns/bank_ns << ")" << endl;
+
+    if(sink != 0)
+        errors++;
+
+    return errors + bank_errors;
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc == 2 && strcmp(argv[1], "help") == 0)
+    {
+        cout << "Usage: " << argv[0] << " [samples]\n"
+             << "\tsamples          number of samples correlated per rate (default 1000000)."
+             << endl;
+        return EXIT_SUCCESS;
+    }
+
+    size_t nb_samples = (argc >= 2) ? strtoul(argv[1], nullptr, 10) : 1000000;
+
+#if defined(__aarch64__)
+    cout << "Using NEON" << endl;
+#elif defined(__AVX2__)
+    cout << "Using AVX2" << endl;
+#else
+    cout << "Using scalar code" << endl;
+#endif
+
+    size_t errors = run<20>(nb_samples) + run<10>(nb_samples) + run<5>(nb_samples);
+
+    if(errors != 0)
+    {
+        cerr << "full_convolve does not match the reference implementation" << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -94,7 +94,7 @@ int main(int argc, char *argv[])
     }
 
     freqdem fdem = freqdem_create(kf);
-    M17Demodulator m17dem;
+    M17Demodulator<> m17dem;
     m17dem.init();
 
     float i, q;
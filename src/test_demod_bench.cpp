@@ -0,0 +1,148 @@
+/****************************************************************************
+ * M17Netd                                                                  *
+ * Copyright (C) 2024 by Morgan Diepart ON4MOD                              *
+ *                       SDR-Engineering SRL                                *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU Affero General Public License as published *
+ * by the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU Affero General Public License for more details.                      *
+ *                                                                          *
+ * You should have received a copy of the GNU Affero General Public License *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    *
+ ****************************************************************************/
+
+
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <random>
+#include <chrono>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <type_traits>
+#include <m17.h>
+
+#include "M17Demodulator.hpp"
+#include "test_bursts.h"
+
+using namespace std;
+
+/**
+ * Generates a 96 kHz M17 baseband made of bursts of packet frames: preamble,
+ * LSF, a few packet frames and EOT, separated by silence.
+ */
+vector<float> generate(size_t bursts, float noise)
+{
+    mt19937 rng(17);
+    normal_distribution<float> awgn(0.0f, noise);
+
+    vector<float> baseband = rrc_shape(burst_symbols(bursts, rng));
+    for(auto &sample : baseband)
+        sample += awgn(rng);
+
+    return baseband;
+}
+
+/**
+ * Runs the demodulator over a baseband, decimated to SAMPLES_PER_SYMBOL, given
+ * as floats or as Q3.12 fixed-point samples
+ */
+template < size_t SAMPLES_PER_SYMBOL, typename T >
+void run(const vector<float> &baseband, size_t block_size, size_t iterations)
+{
+    constexpr size_t decimation = 20 / SAMPLES_PER_SYMBOL;
+    constexpr bool fixed = is_same_v<T, int16_t>;
+
+    vector<T> input;
+    for(size_t i = 0; i < baseband.size(); i += decimation)
+    {
+        if constexpr (fixed)
+            input.push_back(static_cast<int16_t>(clamp(lrintf(baseband[i]*4096.0f), -32768L, 32767L)));
+        else
+            input.push_back(baseband[i]);
+    }
+
+    vector<T> block(block_size);
+    size_t frames = 0;
+    uint64_t checksum = 0xcbf29ce484222325ULL;
+    double ns = 0;
+
+    for(size_t it = 0; it < iterations; it++)
+    {
+        M17::M17Demodulator< SAMPLES_PER_SYMBOL > demod;
+        demod.init();
+
+        for(size_t i = 0; i + block_size <= input.size(); i += block_size)
+        {
+            // update() filters in place
+            memcpy(block.data(), &input[i], block_size*sizeof(T));
+
+            auto start = chrono::steady_clock::now();
+            int ret = demod.update(block.data(), block_size);
+            ns += chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+
+            if(ret == 1 && it == 0)
+            {
+                // FNV-1a of the soft bits, to compare builds
+                for(uint16_t bit : demod.getFrame())
+                    checksum = (checksum ^ bit) * 0x100000001b3ULL;
+                frames++;
+            }
+        }
+    }
+
+    size_t samples = iterations * (input.size() - input.size() % block_size);
+    double seconds = static_cast<double>(samples) / (4800*SAMPLES_PER_SYMBOL);
+
+    cout << SAMPLES_PER_SYMBOL << " samples per symbol, " << (fixed ? "Q3.12" : "float") << " input: " << frames << " frames, checksum " << hex << checksum << dec << endl;
+    cout << "\t" << ns/samples << " ns/sample, x" << seconds/(ns*1e-9) << " real time" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc >= 2 && strcmp(argv[1], "help") == 0)
+    {
+        cout << "Usage: " << argv[0] << " [iterations] [baseband_file]\n"
+             << "\titerations          number of times the baseband is demodulated (default 10).\n"
+             << "\tbaseband_file       96 kHz baseband stored as floats. A synthetic one is used if absent."
+             << endl;
+        return EXIT_SUCCESS;
+    }
+
+    size_t iterations = (argc >= 2) ? strtoul(argv[1], nullptr, 10) : 10;
+    if(iterations == 0)
+        iterations = 1;
+
+    vector<float> baseband;
+    if(argc >= 3)
+    {
+        ifstream file(argv[2], ios_base::binary);
+        if(!file.is_open())
+        {
+            cerr << "Unable to open input file \"" << argv[2] << "\"." << endl;
+            return EXIT_FAILURE;
+        }
+
+        float x;
+        while(file.read(reinterpret_cast<char *>(&x), sizeof(float)))
+            baseband.push_back(x);
+    }
+    else
+    {
+        baseband = generate(4, 0.05f);
+    }
+
+    run< 20, float >(baseband, 128, iterations);
+    run< 20, int16_t >(baseband, 128, iterations);
+    run< 10, float >(baseband, 64, iterations);
+    run< 10, int16_t >(baseband, 64, iterations);
+
+    return EXIT_SUCCESS;
+}
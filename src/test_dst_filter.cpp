@@ -0,0 +1,138 @@
+/****************************************************************************
+ * M17Netd                                                                  *
+ * Copyright (C) 2024 by Morgan Diepart ON4MOD                              *
+ *                       SDR-Engineering SRL                                *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU Affero General Public License as published *
+ * by the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU Affero General Public License for more details.                      *
+ *                                                                          *
+ * You should have received a copy of the GNU Affero General Public License *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    *
+ ****************************************************************************/
+
+
+
+#include <vector>
+#include <array>
+#include <memory>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <m17.h>
+
+#include "m17tx.h"
+#include "m17rx.h"
+#include "test_packets.h"
+
+using namespace std;
+
+/**
+ * Decodes the frames into packets as the workers do, a LSF starts a new packet
+ *
+ * @param own encoded callsign of the station
+ * @param filter if true, own is given to m17rx::set_destination()
+ * @param payloads receives the payloads of the valid packets addressed to the station, as kept by the TUN thread
+ * @param foreign receives the number of foreign packets
+ * @param skipped receives the number of frames not decoded
+ *
+ * @return the decoding time, in s
+ */
+double decode(const vector<rx_frame_t> &frames, const m17rx::callsign_t &own, bool filter,
+              vector<vector<uint8_t>> &payloads, size_t &foreign, size_t &skipped)
+{
+    m17rx packet;
+    if(filter)
+        packet.set_destination(own);
+
+    foreign = 0;
+    skipped = 0;
+    auto start = chrono::steady_clock::now();
+    for(const auto &f : frames)
+    {
+        if(f.sync_word == SYNC_LSF)
+        {
+            skipped += packet.skipped_frames();
+            packet.reset();
+        }
+
+        packet.add_frame(f.sync_word, f.frame);
+        if(f.sync_word == SYNC_LSF && packet.is_foreign())
+            foreign++;
+
+        if(packet.is_complete())
+        {
+            array<uint8_t, 30> lsf = packet.get_lsf();
+            if(packet.is_valid() && memcmp(lsf.data(), own.data(), own.size()) == 0)
+            {
+                byte_span payload = packet.payload();
+                payloads.emplace_back(payload.begin(), payload.end());
+            }
+            packet.reset();
+        }
+    }
+    skipped += packet.skipped_frames();
+
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc >= 2 && strcmp(argv[1], "help") == 0)
+    {
+        cout << "Usage: " << argv[0] << " [packets] [own]\n"
+             << "\tpackets             number of packets on the channel (default 400).\n"
+             << "\town                 percentage of the packets addressed to the station (default 25)."
+             << endl;
+        return EXIT_SUCCESS;
+    }
+
+    size_t nb_packets = (argc >= 2) ? strtoul(argv[1], nullptr, 10) : 400;
+    unsigned own_share = (argc >= 3) ? strtoul(argv[2], nullptr, 10) : 25;
+
+    // A busy channel: packets of every length to the station and to three others
+    const string own_call = "ON4MOD-2";
+    const vector<string> others = {"ON4MOD-3", "F4XYZ", "@ALL"};
+    mt19937 rng(1);
+    vector<rx_frame_t> frames;
+    size_t sent_own = 0;
+    for(size_t p = 0; p < nb_packets; p++)
+    {
+        bool own = (rng() % 100) < own_share;
+        const string &dst = own ? own_call : others[rng() % others.size()];
+        vector<rx_frame_t> packet = packet_frames(0, dst, 1 + rng() % 800, 0.2f, rng);
+        frames.insert(frames.end(), packet.begin(), packet.end());
+        sent_own += own;
+    }
+
+    m17rx::callsign_t own;
+    encode_callsign_bytes(own.data(), own_call.c_str());
+
+    // The payloads of the station must be the same with and without the filter
+    vector<vector<uint8_t>> all, filtered;
+    size_t foreign, skipped;
+    double all_time = decode(frames, own, false, all, foreign, skipped);
+    double filtered_time = decode(frames, own, true, filtered, foreign, skipped);
+
+    cout << "Packets: " << nb_packets << " sent, " << sent_own << " to the station, received " << all.size()
+         << " without the filter and " << filtered.size() << " with the filter, " << foreign << " foreign" << endl
+         << "Payloads of the station: " << ((filtered == all) ? "identical" : "DIFFERENT")
+         << " with and without the filter" << endl
+         << "Frames: " << frames.size() << " received, " << skipped << " not decoded" << endl
+         << fixed << setprecision(3)
+         << "Decoding without the filter: " << 1e3*all_time << " ms, " << 1e6*all_time/frames.size() << " us/frame" << endl
+         << "Decoding with the filter:    " << 1e3*filtered_time << " ms, " << 1e6*filtered_time/frames.size()
+         << " us/frame, " << 1e3*(all_time - filtered_time) << " ms saved" << defaultfloat << endl;
+
+    return (filtered == all) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
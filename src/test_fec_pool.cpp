@@ -0,0 +1,183 @@
+/****************************************************************************
+ * M17Netd                                                                  *
+ * Copyright (C) 2024 by Morgan Diepart ON4MOD                              *
+ *                       SDR-Engineering SRL                                *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU Affero General Public License as published *
+ * by the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU Affero General Public License for more details.                      *
+ *                                                                          *
+ * You should have received a copy of the GNU Affero General Public License *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    *
+ ****************************************************************************/
+
+
+#include <vector>
+#include <array>
+#include <memory>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <m17.h>
+
+#include "m17tx.h"
+#include "m17rx.h"
+#include "fec_pool.h"
+#include "test_packets.h"
+
+using namespace std;
+
+int main(int argc, char *argv[])
+{
+    if(argc >= 2 && strcmp(argv[1], "help") == 0)
+    {
+        cout << "Usage: " << argv[0] << " [packets] [workers]\n"
+             << "\tpackets             number of packets per stream (default 200).\n"
+             << "\tworkers             number of FEC workers (default 2)."
+             << endl;
+        return EXIT_SUCCESS;
+    }
+
+    size_t nb_packets = (argc >= 2) ? strtoul(argv[1], nullptr, 10) : 200;
+    size_t nb_workers = (argc >= 3) ? strtoul(argv[2], nullptr, 10) : 2;
+    constexpr size_t nb_streams = 3;
+    constexpr auto frame_period = chrono::milliseconds(40);
+
+    // Packets of every length on interleaved streams, as from several channels
+    mt19937 rng(1);
+    vector<vector<uint8_t>> payloads;
+    vector<vector<rx_frame_t>> streams(nb_streams);
+    for(size_t p = 0; p < nb_packets*nb_streams; p++)
+    {
+        vector<uint8_t> payload;
+        vector<rx_frame_t> frames = packet_frames(p % nb_streams, "ON4MOD-2", 1 + rng() % 800, 0.2f, rng, &payload);
+        streams[p % nb_streams].insert(streams[p % nb_streams].end(), frames.begin(), frames.end());
+        payloads.push_back(payload);
+    }
+
+    vector<rx_frame_t> frames;
+    for(size_t i = 0; ; i++)
+    {
+        bool left = false;
+        for(const auto &s : streams)
+        {
+            if(i < s.size())
+            {
+                frames.push_back(s[i]);
+                left = true;
+            }
+        }
+        if(!left)
+            break;
+    }
+
+    // Inline decoding, as the radio thread did
+    vector<vector<vector<uint8_t>>> inline_out(nb_streams);
+    vector<shared_ptr<m17rx>> packets(nb_streams);
+    double inline_max = 0.0;
+    auto start = chrono::steady_clock::now();
+    for(const auto &f : frames)
+    {
+        auto frame_start = chrono::steady_clock::now();
+        shared_ptr<m17rx> &packet = packets[f.stream];
+        if(!packet || f.sync_word == SYNC_LSF)
+            packet = make_shared<m17rx>();
+
+        packet->add_frame(f.sync_word, f.frame);
+        if(packet->is_complete())
+        {
+            inline_out[f.stream].push_back(packet->get_payload());
+            packet.reset();
+        }
+        inline_max = max(inline_max, chrono::duration<double>(chrono::steady_clock::now() - frame_start).count());
+    }
+    double inline_time = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    // On the FEC workers, the frames arrive at the pace of the demodulator. They are copied into the buffers here, the
+    // demodulator fills the buffers itself.
+    frame_pool buffers(nb_workers*(fec_pool::queue_frames + 2));
+    thread_cfg sched = {{}, false, 0};
+    fec_pool pool(nb_workers, sched);
+    vector<vector<vector<uint8_t>>> pool_out(nb_streams);
+    fec_pool::rx_packet_t done;
+    auto take_payload = [&]()
+    {
+        byte_span payload = done.packet->payload();
+        pool_out[done.stream].emplace_back(payload.begin(), payload.end());
+        done.packet.reset();
+    };
+    double feed_time = 0.0, feed_max = 0.0;
+    auto next = chrono::steady_clock::now();
+    for(size_t i = 0; i < frames.size(); i++)
+    {
+        auto frame_start = chrono::steady_clock::now();
+        pool.add_frame(frames[i].stream, frames[i].sync_word, buffers.copy(frames[i].frame), 0.0f);
+        double t = chrono::duration<double>(chrono::steady_clock::now() - frame_start).count();
+        feed_time += t;
+        feed_max = max(feed_max, t);
+
+        while(pool.fetch(done) == 0)
+            take_payload();
+
+        // A frame of each stream per frame period
+        if((i + 1) % nb_streams == 0)
+        {
+            next += frame_period;
+            this_thread::sleep_until(next);
+        }
+    }
+
+    this_thread::sleep_for(chrono::milliseconds(200));
+    while(pool.fetch(done) == 0)
+        take_payload();
+
+    size_t received = 0, same = 0;
+    for(size_t s = 0; s < nb_streams; s++)
+    {
+        received += pool_out[s].size();
+        same += (pool_out[s] == inline_out[s]);
+    }
+
+    size_t correct = 0;
+    for(size_t s = 0; s < nb_streams; s++)
+    {
+        for(size_t p = 0, k = 0; p < payloads.size() && k < pool_out[s].size(); p++)
+        {
+            if(p % nb_streams != s)
+                continue;
+            correct += (pool_out[s][k++] == payloads[p]);
+        }
+    }
+
+    fec_pool::stats_t stats = pool.get_stats();
+    frame_pool::stats_t buffer_stats = buffers.get_stats();
+    m17rx_pool::stats_t packet_stats = pool.get_packet_stats();
+    cout << "Packets: " << payloads.size() << " sent, " << received << " received by the pool (" << correct
+         << " intact), " << same << "/" << nb_streams << " streams identical to the inline decoding" << endl
+         << "Frames: " << stats.frames << " decoded, " << stats.dropped << " dropped" << endl
+         << "Frame buffers: " << buffer_stats.size << " buffers, " << buffer_stats.acquired << " taken, "
+         << buffer_stats.allocations << " allocated after startup" << endl
+         << "Packets of the workers: " << packet_stats.size << " packets, " << packet_stats.acquired << " taken, "
+         << packet_stats.allocations << " allocated after startup" << endl
+         << fixed << setprecision(3)
+         << "Radio thread per frame, inline decoding: mean " << 1e3*inline_time/frames.size() << " ms, max "
+         << 1e3*inline_max << " ms" << endl
+         << "Radio thread per frame, FEC pool:        mean " << 1e3*feed_time/frames.size() << " ms, max "
+         << 1e3*feed_max << " ms" << endl
+         << "Decode latency: mean " << 1e3*stats.mean_latency << " ms, max " << 1e3*stats.max_latency
+         << " ms, decoding " << 1e3*stats.mean_decode << " ms/frame" << defaultfloat << endl;
+
+    // The workers must output the packets of the inline decoding, in the same order
+    return (same == nb_streams) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,227 @@
+/****************************************************************************
+ * M17Netd                                                                  *
+ * Copyright (C) 2024 by Morgan Diepart ON4MOD                              *
+ *                       SDR-Engineering SRL                                *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU Affero General Public License as published *
+ * by the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU Affero General Public License for more details.                      *
+ *                                                                          *
+ * You should have received a copy of the GNU Affero General Public License *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    *
+ ****************************************************************************/
+
+
+#include <vector>
+#include <array>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fftw3.h>
+#include <m17.h>
+
+#include "rx_frontend.h"
+#include "test_bursts.h"
+
+using namespace std;
+
+// Fixed listen-before-talk thresholds: the one radio_simplex used on the FFT and the matching band power
+constexpr size_t block_size      = 128;
+constexpr size_t fft_size        = 128;
+constexpr size_t half_chan_width = (9000*fft_size/96000);
+constexpr float  fft_threshold   = 22.0f;
+constexpr float  power_threshold = 3.3e-3f;
+
+constexpr float  kf         = 0.0375f;
+constexpr size_t decimation = 2;
+
+/**
+ * Generates n I/Q samples at 96 kHz: an M17 signal of random symbols, shifted by offset Hz, plus white gaussian noise.
+ *
+ * @param signal power of the signal in dBFS
+ * @param noise power of the noise in dBFS
+ */
+vector<complex<int32_t>> generate(size_t n, float signal, float offset, float noise, unsigned seed)
+{
+    mt19937 rng(seed);
+    normal_distribution<double> awgn(0.0, pow(10.0, noise/20.0)/sqrt(2.0));
+    const double amplitude = pow(10.0, signal/20.0);
+    vector<double> phase = fm_phase(n, kf, offset, rng);
+
+    vector<complex<int32_t>> iq(n);
+    for(size_t i = 0; i < n; i++)
+        iq[i] = to_s24(polar(amplitude, phase[i]) + complex<double>(awgn(rng), awgn(rng)));
+
+    return iq;
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc >= 2 && strcmp(argv[1], "help") == 0)
+    {
+        cout << "Usage: " << argv[0] << " [blocks]\n"
+             << "\tblocks              number of blocks of " << block_size << " samples per scenario (default 2000)."
+             << endl;
+        return EXIT_SUCCESS;
+    }
+
+    size_t blocks = (argc >= 2) ? strtoul(argv[1], nullptr, 10) : 2000;
+
+    complex<float> *dc_samples = reinterpret_cast<complex<float>*>(fftwf_alloc_complex(block_size));
+    complex<float> *spectrum = reinterpret_cast<complex<float>*>(fftwf_alloc_complex(fft_size));
+    fftwf_plan plan = fftwf_plan_dft_1d(fft_size, reinterpret_cast<fftwf_complex*>(dc_samples),
+                                        reinterpret_cast<fftwf_complex*>(spectrum), FFTW_FORWARD, FFTW_MEASURE);
+
+    // Sum of the magnitudes of the in-band bins, avoiding the DC component, as radio_simplex did
+    auto fft_detector = [&]()
+    {
+        fftwf_execute(plan);
+
+        float chan = 0;
+        for(size_t i = 2; i < half_chan_width-2; i++)
+            chan += abs(spectrum[i]);
+        for(size_t i = fft_size-half_chan_width; i < fft_size-1; i++)
+            chan += abs(spectrum[i]);
+
+        return chan;
+    };
+
+    struct scenario_t
+    {
+        const char *name;
+        float signal;       // Power of the M17 signal in dBFS
+        float offset;       // Offset of the M17 signal from the channel center in Hz
+        float noise;        // Power of the noise in dBFS
+    };
+
+    constexpr float none = -200.0f;
+    const vector<scenario_t> scenarios =
+    {
+        {"noise -80 dBFS",                      none,        0.0f, -80.0f},
+        {"noise -76 dBFS",                      none,        0.0f, -76.0f},
+        {"noise -72 dBFS",                      none,        0.0f, -72.0f},
+        {"noise -68 dBFS",                      none,        0.0f, -68.0f},
+        {"noise -64 dBFS",                      none,        0.0f, -64.0f},
+        {"noise -60 dBFS",                      none,        0.0f, -60.0f},
+        {"M17 -84 dBFS",                        -84.0f,      0.0f, -110.0f},
+        {"M17 -80 dBFS",                        -80.0f,      0.0f, -110.0f},
+        {"M17 -76 dBFS",                        -76.0f,      0.0f, -110.0f},
+        {"M17 -72 dBFS",                        -72.0f,      0.0f, -110.0f},
+        {"M17 -68 dBFS",                        -68.0f,      0.0f, -110.0f},
+        {"M17 -40 dBFS",                        -40.0f,      0.0f, -110.0f},
+        {"M17 -72 dBFS, noise -80 dBFS",        -72.0f,      0.0f, -80.0f},
+        {"M17 -72 dBFS, 1 kHz off",             -72.0f,   1000.0f, -110.0f},
+        {"M17 -60 dBFS, +12.5 kHz",             -60.0f,  12500.0f, -110.0f},
+        {"M17 -40 dBFS, +25 kHz",               -40.0f,  25000.0f, -110.0f},
+    };
+
+    // The front-ends scale the 24 bits samples as int32_to_float<24, 8>, full scale is 256
+    auto dbfs = [](double power)
+    {
+        return 10.0*log10(power/65536.0);
+    };
+
+    cout << "Busy blocks, FFT detector (threshold " << fft_threshold << ") and band power (threshold "
+         << fixed << setprecision(1) << dbfs(power_threshold) << " dBFS):" << defaultfloat << endl;
+
+    for(const auto &sc : scenarios)
+    {
+        vector<complex<int32_t>> iq = generate(blocks*block_size, sc.signal, sc.offset, sc.noise, 1);
+
+        rx_frontend frontend(kf, 4.0f/96000.0f, 5300.0f/96000.0f, 65.0f, decimation);
+        rx_frontend_q15 frontend_q15(kf, 4.0f/96000.0f, 5300.0f/96000.0f, 65.0f, decimation);
+        array<float, block_size> baseband;
+        array<int16_t, block_size> baseband_q15;
+
+        size_t fft_busy = 0, power_busy = 0, q15_busy = 0, same = 0;
+        double chan_sum = 0.0, power_sum = 0.0, q15_sum = 0.0;
+        for(size_t b = 0; b < blocks; b++)
+        {
+            frontend.process(&iq[b*block_size], block_size, baseband.data(), dc_samples);
+            frontend_q15.process(&iq[b*block_size], block_size, baseband_q15.data());
+
+            // Leave time to the DC blocker and the power to settle
+            if(b < blocks/10)
+                continue;
+
+            float chan = fft_detector();
+            float power = frontend.get_band_power();
+            float power_q15 = frontend_q15.get_band_power();
+            bool fft_bsy = (chan >= fft_threshold);
+            bool power_bsy = (power >= power_threshold);
+
+            fft_busy += fft_bsy;
+            power_busy += power_bsy;
+            q15_busy += (power_q15 >= power_threshold);
+            same += (fft_bsy == power_bsy);
+            chan_sum += chan;
+            power_sum += power;
+            q15_sum += power_q15;
+        }
+
+        size_t counted = blocks - blocks/10;
+        cout << "  " << left << setw(36) << sc.name << right << fixed << setprecision(1)
+             << " FFT " << setw(5) << 100.0*fft_busy/counted << "% (mean " << setw(6) << chan_sum/counted << "),"
+             << " band power " << setw(5) << 100.0*power_busy/counted << "% (mean " << setw(5)
+             << dbfs(power_sum/counted) << " dBFS), Q15 " << setw(5) << 100.0*q15_busy/counted << "% (mean " << setw(5)
+             << dbfs(q15_sum/counted) << " dBFS), same decision " << setw(5) << 100.0*same/counted << "%"
+             << defaultfloat << endl;
+    }
+
+    // Cost of each detector alone, per block
+    vector<complex<int32_t>> iq = generate(blocks*block_size, -60.0f, 0.0f, -80.0f, 2);
+    rx_frontend frontend(kf, 4.0f/96000.0f, 5300.0f/96000.0f, 65.0f, decimation);
+    array<float, block_size> baseband;
+    volatile float sink = 0.0f;
+
+    double fft_time = 0.0;
+    for(size_t b = 0; b < blocks; b++)
+    {
+        frontend.process(&iq[b*block_size], block_size, baseband.data(), dc_samples);
+
+        auto start = chrono::steady_clock::now();
+        sink = fft_detector();
+        fft_time += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+
+    // The band power runs on the filtered samples, decimated to 64 per block
+    constexpr size_t filtered = block_size/decimation;
+    mt19937 rng(3);
+    normal_distribution<float> awgn(0.0f, 0.01f);
+    vector<float> filt_i(blocks*filtered), filt_q(blocks*filtered);
+    for(size_t i = 0; i < filt_i.size(); i++)
+    {
+        filt_i[i] = awgn(rng);
+        filt_q[i] = awgn(rng);
+    }
+
+    band_power power(static_cast<float>(decimation)/block_size);
+    auto start = chrono::steady_clock::now();
+    for(size_t b = 0; b < blocks; b++)
+    {
+        power.update(&filt_i[b*filtered], &filt_q[b*filtered], filtered);
+        sink = power.get();
+    }
+    double power_time = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    (void)sink;
+
+    cout << fixed << setprecision(3)
+         << "FFT detector: " << 1e6*fft_time/blocks << " us/block" << endl
+         << "Band power:   " << 1e6*power_time/blocks << " us/block" << defaultfloat << endl;
+
+    fftwf_destroy_plan(plan);
+    fftwf_free(dc_samples);
+    fftwf_free(spectrum);
+    fftwf_cleanup();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,155 @@
+/****************************************************************************
+ * M17Netd                                                                  *
+ * Copyright (C) 2024 by Morgan Diepart ON4MOD                              *
+ *                       SDR-Engineering SRL                                *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU Affero General Public License as published *
+ * by the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU Affero General Public License for more details.                      *
+ *                                                                          *
+ * You should have received a copy of the GNU Affero General Public License *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    *
+ ****************************************************************************/
+
+#include <complex>
+#include <vector>
+#include <iostream>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <liquid/liquid.h>
+
+#include "type_conversion.hpp"
+#include "rx_frontend.h"
+
+using namespace std;
+
+/**
+ * Compares the fused rx_frontend against the liquid-dsp chain used before
+ * (DC blocker, 101 taps Kaiser low-pass filter and FM discriminator), and the
+ * fixed-point rx_frontend_q15 against rx_frontend.
+ */
+int main(int argc, char *argv[])
+{
+    if(argc == 2 && strcmp(argv[1], "help") == 0)
+    {
+        cout << "Usage: " << argv[0] << " [iterations]\n"
+             << "\titerations          number of times 10 seconds of baseband are processed (default 10)."
+             << endl;
+        return EXIT_SUCCESS;
+    }
+
+    size_t iterations = (argc >= 2) ? strtoul(argv[1], nullptr, 10) : 10;
+    if(iterations == 0)
+        iterations = 1;
+
+    constexpr float kf = 0.0375;
+    constexpr size_t block_size = 128;
+    constexpr size_t nb_samples = 96000*10;
+
+    // Generate an FM modulated 4FSK-like signal with DC offset and noise, as S24 in 32 bits
+    vector<complex<int32_t>> iq(nb_samples);
+    mt19937 rng(17);
+    normal_distribution<float> noise(0.0f, 2000.0f);
+    uniform_int_distribution<int> symbol(0, 3);
+    const float levels[4] = {-3.0f/3, -1.0f/3, 1.0f/3, 3.0f/3};
+    double phase = 0.0;
+    float m = 0.0f;
+    for(size_t i = 0; i < nb_samples; i++)
+    {
+        if(i % 20 == 0)
+            m = levels[symbol(rng)] * 0.8f;
+
+        phase += 2.0*M_PI*kf*m;
+        int32_t re = 200000.0*cos(phase) + 1500.0 + noise(rng);
+        int32_t im = 200000.0*sin(phase) - 700.0 + noise(rng);
+        iq[i] = complex<int32_t>(re & 0xFFFFFF, im & 0xFFFFFF);
+    }
+
+    vector<float> out_liquid(nb_samples);
+    vector<float> out_fused(nb_samples);
+
+    // liquid-dsp chain
+    iirfilt_crcf dcr = iirfilt_crcf_create_dc_blocker(4.0/96000.0);
+    firfilt_crcf lpf = firfilt_crcf_create_kaiser(101, 5300.0/96000.0, 65, 0);
+    freqdem fdem = freqdem_create(kf);
+    vector<complex<float>> samples(block_size);
+    vector<complex<float>> samples_filt(block_size);
+
+    auto start = chrono::steady_clock::now();
+    for(size_t it = 0; it < iterations; it++)
+    {
+        for(size_t i = 0; i + block_size <= nb_samples; i += block_size)
+        {
+            int32_to_float<24, 8>(reinterpret_cast<const int32_t *>(&iq[i]), reinterpret_cast<float *>(samples.data()), 2*block_size);
+            iirfilt_crcf_execute_block(dcr, samples.data(), block_size, samples.data());
+            firfilt_crcf_execute_block(lpf, samples.data(), block_size, samples_filt.data());
+            freqdem_demodulate_block(fdem, samples_filt.data(), block_size, &out_liquid[i]);
+        }
+    }
+    double liquid_ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+
+    iirfilt_crcf_destroy(dcr);
+    firfilt_crcf_destroy(lpf);
+    freqdem_destroy(fdem);
+
+    // Fused front-end
+    rx_frontend frontend(kf);
+
+    start = chrono::steady_clock::now();
+    for(size_t it = 0; it < iterations; it++)
+    {
+        for(size_t i = 0; i + block_size <= nb_samples; i += block_size)
+        {
+            frontend.process(&iq[i], block_size, &out_fused[i]);
+        }
+    }
+    double fused_ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+
+    // Fixed-point front-end
+    rx_frontend_q15 frontend_q15(kf);
+    vector<int16_t> out_q15(nb_samples);
+
+    start = chrono::steady_clock::now();
+    for(size_t it = 0; it < iterations; it++)
+    {
+        for(size_t i = 0; i + block_size <= nb_samples; i += block_size)
+        {
+            frontend_q15.process(&iq[i], block_size, &out_q15[i]);
+        }
+    }
+    double q15_ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+
+    // Compare the outputs of the last iteration, after the filters transient
+    double max_err = 0.0, max_err_q15 = 0.0;
+    double sq_err = 0.0, sq_err_q15 = 0.0;
+    size_t cnt = 0;
+    for(size_t i = 1000; i < nb_samples - nb_samples%block_size; i++)
+    {
+        double err = fabs(out_fused[i] - out_liquid[i]);
+        max_err = max(max_err, err);
+        sq_err += err*err;
+
+        err = fabs(out_q15[i]/static_cast<double>(1 << rx_frontend_q15::out_frac_bits) - out_fused[i]);
+        max_err_q15 = max(max_err_q15, err);
+        sq_err_q15 += err*err;
+        cnt++;
+    }
+
+    size_t nb_blocks = iterations * (nb_samples/block_size);
+    cout << "Processed " << nb_blocks << " blocks of " << block_size << " samples." << endl;
+    cout << "liquid-dsp chain: " << liquid_ns/nb_blocks << " ns/block" << endl;
+    cout << "rx_frontend:      " << fused_ns/nb_blocks << " ns/block (x" << liquid_ns/fused_ns << ")" << endl;
+    cout << "rx_frontend_q15:  " << q15_ns/nb_blocks << " ns/block (x" << fused_ns/q15_ns << " against rx_frontend)" << endl;
+    cout << "Baseband difference: max " << max_err << ", rms " << sqrt(sq_err/cnt) << endl;
+    cout << "Q15 baseband difference to rx_frontend: max " << max_err_q15 << ", rms " << sqrt(sq_err_q15/cnt) << endl;
+
+    return EXIT_SUCCESS;
+}
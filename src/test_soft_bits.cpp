@@ -0,0 +1,208 @@
+/****************************************************************************
+ * M17Netd                                                                  *
+ * Copyright (C) 2024 by Morgan Diepart ON4MOD                              *
+ *                       SDR-Engineering SRL                                *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU Affero General Public License as published *
+ * by the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU Affero General Public License for more details.                      *
+ *                                                                          *
+ * You should have received a copy of the GNU Affero General Public License *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    *
+ ****************************************************************************/
+
+
+#include <vector>
+#include <array>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <m17.h>
+
+#include "M17Demodulator.hpp"
+#include "test_bursts.h"
+
+using namespace std;
+
+struct packet_frame_t
+{
+    frame_bits_t       bits;    ///< Hard bits of the frame symbols
+    array<uint8_t, 26> data;    ///< Type-1 bits of the frame
+};
+
+/**
+ * Generates a 96 kHz M17 baseband made of bursts of packet superframes
+ * (preamble, LSF, 33 packet frames and EOT) encoded by libm17, with white
+ * gaussian noise.
+ *
+ * @param frames: receives the packet frames transmitted.
+ */
+vector<float> generate(size_t bursts, float noise, unsigned seed, vector<packet_frame_t> &frames)
+{
+    mt19937 rng(seed);
+    normal_distribution<float> awgn(0.0f, noise);
+    vector<float> symbols;
+    array<float, SYM_PER_FRA> frame;
+    uint32_t cnt;
+
+    lsf_t lsf = {};
+    encode_callsign_bytes(lsf.dst, "@ALL");
+    encode_callsign_bytes(lsf.src, "N0CALL");
+    uint16_t crc = LSF_CRC(&lsf);
+    lsf.crc[0] = crc >> 8;
+    lsf.crc[1] = crc & 0xFF;
+
+    for(size_t b = 0; b < bursts; b++)
+    {
+        symbols.insert(symbols.end(), 480, 0.0f);
+
+        cnt = 0;
+        send_preamble(frame.data(), &cnt, PREAM_LSF);
+        symbols.insert(symbols.end(), frame.begin(), frame.end());
+
+        send_frame(frame.data(), nullptr, FRAME_LSF, &lsf, 0, 0);
+        symbols.insert(symbols.end(), frame.begin(), frame.end());
+
+        for(size_t f = 0; f < 33; f++)
+        {
+            packet_frame_t pkt;
+            for(size_t i = 0; i < 25; i++)
+                pkt.data[i] = rng() & 0xFF;
+            pkt.data[25] = (f == 32) ? (0x80 | (25 << 2)) : (f << 2);
+
+            send_frame(frame.data(), pkt.data.data(), FRAME_PKT, &lsf, 0, 0);
+            symbols.insert(symbols.end(), frame.begin(), frame.end());
+
+            pkt.bits = frame_bits(frame.data());
+            frames.push_back(pkt);
+        }
+
+        cnt = 0;
+        send_eot(frame.data(), &cnt);
+        symbols.insert(symbols.end(), frame.begin(), frame.end());
+    }
+    symbols.insert(symbols.end(), 480, 0.0f);
+
+    vector<float> baseband = rrc_shape(symbols);
+    for(auto &sample : baseband)
+        sample += awgn(rng);
+
+    return baseband;
+}
+
+/**
+ * Demodulates a baseband at 10 samples per symbol and decodes its packet
+ * frames as m17rx does. A frame is in error when it was not demodulated or
+ * when its decoded bits differ from the ones transmitted.
+ */
+void run(const vector<float> &baseband, const vector<packet_frame_t> &frames,
+         size_t &demodulated, size_t &raw_errors, size_t &frame_errors, double &demod_time)
+{
+    constexpr size_t block_size = 64;
+
+    vector<float> input;
+    for(size_t i = 0; i < baseband.size(); i += 2)
+        input.push_back(baseband[i]);
+
+    M17::M17Demodulator< 10 > demod;
+    demod.init();
+
+    vector<bool> raw_ok(frames.size(), false);
+    vector<bool> decoded(frames.size(), false);
+    array<uint16_t, 2*SYM_PER_PLD> payload;
+    array<uint16_t, 2*SYM_PER_PLD> deinterleaved;
+    array<uint8_t, 31> buffer;
+
+    for(size_t i = 0; i + block_size <= input.size(); i += block_size)
+    {
+        auto start = chrono::steady_clock::now();
+        int ret = demod.update(&input[i], block_size);
+        demod_time += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if(ret != 1)
+            continue;
+
+        const auto &soft = demod.getFrame();
+
+        // Match the frame with the closest transmitted one, others are not packet frames
+        size_t best = 0, best_dist = SIZE_MAX;
+        for(size_t f = 0; f < frames.size(); f++)
+        {
+            size_t dist = 0;
+            for(size_t b = 0; b < soft.size(); b++)
+                dist += ((soft[b] > 0x7FFF) != frames[f].bits[b]);
+
+            if(dist < best_dist)
+            {
+                best_dist = dist;
+                best = f;
+            }
+        }
+
+        if(best_dist >= soft.size()/4)
+            continue;
+
+        demodulated++;
+        if(best_dist == 0)
+            raw_ok[best] = true;
+
+        memcpy(payload.data(), &soft[16], sizeof(payload));
+        randomize_soft_bits(payload.data());
+        reorder_soft_bits(deinterleaved.data(), payload.data());
+        viterbi_decode_punctured(buffer.data(), deinterleaved.data(), puncture_pattern_3,
+                                 deinterleaved.size(), sizeof(puncture_pattern_3));
+
+        const auto &data = frames[best].data;
+        if((memcmp(buffer.data() + 1, data.data(), 25) == 0) && ((buffer[26] & 0xFC) == data[25]))
+            decoded[best] = true;
+    }
+
+    raw_errors   += count(raw_ok.begin(), raw_ok.end(), false);
+    frame_errors += count(decoded.begin(), decoded.end(), false);
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc >= 2 && strcmp(argv[1], "help") == 0)
+    {
+        cout << "Usage: " << argv[0] << " [bursts]\n"
+             << "\tbursts              number of packet superframes per noise level and seed (default 10)."
+             << endl;
+        return EXIT_SUCCESS;
+    }
+
+    size_t bursts = (argc >= 2) ? strtoul(argv[1], nullptr, 10) : 10;
+
+    for(float noise : {0.30f, 0.34f, 0.38f, 0.42f, 0.46f, 0.50f})
+    {
+        size_t total = 0, demodulated = 0, raw_errors = 0, frame_errors = 0;
+        double demod_time = 0.0;
+
+        for(unsigned seed = 1; seed <= 3; seed++)
+        {
+            vector<packet_frame_t> frames;
+            vector<float> baseband = generate(bursts, noise, seed, frames);
+            run(baseband, frames, demodulated, raw_errors, frame_errors, demod_time);
+            total += frames.size();
+        }
+
+        cout << "Noise " << noise << ": " << demodulated << "/" << total << " frames demodulated, "
+             << fixed << setprecision(4)
+             << "uncoded PER " << static_cast<float>(raw_errors)/total
+             << ", FER " << static_cast<float>(frame_errors)/total
+             << ", FER of demodulated frames " << static_cast<float>(frame_errors - (total - demodulated))/max<size_t>(demodulated, 1)
+             << setprecision(2) << ", demodulator " << 1e6*demod_time/max<size_t>(demodulated, 1) << " us/frame"
+             << defaultfloat << endl;
+    }
+
+    return EXIT_SUCCESS;
+}
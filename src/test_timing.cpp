@@ -0,0 +1,168 @@
+/****************************************************************************
+ * M17Netd                                                                  *
+ * Copyright (C) 2024 by Morgan Diepart ON4MOD                              *
+ *                       SDR-Engineering SRL                                *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU Affero General Public License as published *
+ * by the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU Affero General Public License for more details.                      *
+ *                                                                          *
+ * You should have received a copy of the GNU Affero General Public License *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    *
+ ****************************************************************************/
+
+
+#include <vector>
+#include <array>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <cmath>
+#include <cstring>
+#include <m17.h>
+
+#include "M17Demodulator.hpp"
+#include "test_bursts.h"
+
+using namespace std;
+
+/**
+ * Generates a 96 kHz M17 baseband made of bursts of packet superframes
+ * (preamble, LSF, 33 packet frames and EOT), as received by a node whose
+ * sample clock is off by ppm parts per million.
+ *
+ * @param frames: receives the hard bits of every frame transmitted.
+ */
+vector<float> generate(size_t bursts, float noise, float ppm, vector<frame_bits_t> &frames)
+{
+    mt19937 rng(17);
+    normal_distribution<float> awgn(0.0f, noise);
+
+    // Upsample and shape at the transmitter clock
+    vector<float> shaped = rrc_shape(burst_symbols(bursts, rng, &frames));
+
+    // Resample at the receiver clock with a Blackman windowed sinc
+    constexpr int half = 16;
+    const double ratio = 1.0 + ppm * 1e-6;
+    vector<float> baseband;
+    for(double t = half; t < shaped.size() - half; t += ratio)
+    {
+        long   n   = static_cast<long>(t);
+        double mu  = t - n;
+        double acc = 0.0;
+        for(int k = -half + 1; k <= half; k++)
+        {
+            double x = k - mu;
+            double sinc = (x == 0.0) ? 1.0 : sin(M_PI*x)/(M_PI*x);
+            double win  = 0.42 + 0.5*cos(M_PI*x/half) + 0.08*cos(2*M_PI*x/half);
+            acc += shaped[n + k] * sinc * win;
+        }
+        baseband.push_back(acc + awgn(rng));
+    }
+
+    return baseband;
+}
+
+/**
+ * Demodulates a baseband decimated to SAMPLES_PER_SYMBOL and compares the
+ * frames against the ones transmitted. A frame is in error when any of its
+ * hard bits is wrong or when it was not demodulated.
+ */
+template < size_t SAMPLES_PER_SYMBOL >
+void run(const vector<float> &baseband, const vector<frame_bits_t> &frames, bool tracking)
+{
+    constexpr size_t decimation = 20 / SAMPLES_PER_SYMBOL;
+    constexpr size_t block_size = 64;
+
+    vector<float> input;
+    for(size_t i = 0; i < baseband.size(); i += decimation)
+        input.push_back(baseband[i]);
+
+    M17::M17Demodulator< SAMPLES_PER_SYMBOL > demod;
+    demod.init();
+    demod.setTimingRecovery(tracking);
+
+    vector<bool> received(frames.size(), false);
+    size_t bit_errors = 0;
+    size_t demodulated = 0;
+    float  max_error = 0.0f;
+    float  correction = 0.0f;
+
+    vector<float> block(block_size);
+    for(size_t i = 0; i + block_size <= input.size(); i += block_size)
+    {
+        memcpy(block.data(), &input[i], block_size*sizeof(float));
+        if(demod.update(block.data(), block_size) != 1)
+            continue;
+
+        const auto &soft = demod.getFrame();
+        demodulated++;
+
+        // Match the frame with the closest transmitted one
+        size_t best = 0, best_dist = SIZE_MAX;
+        for(size_t f = 0; f < frames.size(); f++)
+        {
+            size_t dist = 0;
+            for(size_t b = 0; b < soft.size(); b++)
+                dist += ((soft[b] > 0x7FFF) != frames[f][b]);
+
+            if(dist < best_dist)
+            {
+                best_dist = dist;
+                best = f;
+            }
+        }
+
+        // Frames further away are not M17 frames, count them as lost
+        if(best_dist < soft.size()/4)
+        {
+            bit_errors += best_dist;
+            if(best_dist == 0)
+                received[best] = true;
+        }
+
+        const auto &timing = demod.getFrameTiming();
+        max_error   = max(max_error, fabs(timing.error));
+        correction += timing.correction;
+    }
+
+    size_t good = count(received.begin(), received.end(), true);
+    cout << "\t" << SAMPLES_PER_SYMBOL << " sps, timing recovery " << (tracking ? "on " : "off") << ": "
+         << demodulated << " frames, " << bit_errors << " bit errors, PER "
+         << fixed << setprecision(3) << 1.0f - static_cast<float>(good)/frames.size()
+         << ", mean correction " << setprecision(2) << correction/max<size_t>(demodulated, 1)
+         << " samples/frame, max frame error " << max_error << " samples" << defaultfloat << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc >= 2 && strcmp(argv[1], "help") == 0)
+    {
+        cout << "Usage: " << argv[0] << " [noise]\n"
+             << "\tnoise               standard deviation of the noise added to the baseband (default 0.15)."
+             << endl;
+        return EXIT_SUCCESS;
+    }
+
+    float noise = (argc >= 2) ? strtof(argv[1], nullptr) : 0.15f;
+
+    for(float ppm : {0.0f, 100.0f, 500.0f, 1000.0f, 2000.0f})
+    {
+        vector<frame_bits_t> frames;
+        vector<float> baseband = generate(2, noise, ppm, frames);
+
+        cout << "Sample clock offset " << ppm << " ppm:" << endl;
+        run< 20 >(baseband, frames, false);
+        run< 20 >(baseband, frames, true);
+        run< 10 >(baseband, frames, false);
+        run< 10 >(baseband, frames, true);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,180 @@
+/****************************************************************************
+ * M17Netd                                                                  *
+ * Copyright (C) 2024 by Morgan Diepart ON4MOD                              *
+ *                       SDR-Engineering SRL                                *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU Affero General Public License as published *
+ * by the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU Affero General Public License for more details.                      *
+ *                                                                          *
+ * You should have received a copy of the GNU Affero General Public License *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    *
+ ****************************************************************************/
+
+
+
+#include <vector>
+#include <array>
+#include <memory>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <chrono>
+#include <numeric>
+#include <cstring>
+#include <m17.h>
+
+#include "m17tx.h"
+
+using namespace std;
+
+/**
+ * Packet transmitter giving access to the RRC taps of m17tx
+ */
+class tx_packet : public m17tx_pkt
+{
+public:
+    using m17tx_pkt::m17tx_pkt;
+
+    static const array<float, nb_taps> &rrc_taps()
+    {
+        return taps;
+    }
+};
+
+/**
+ * The interpolator m17tx used before the polyphase filter: the symbols are zero-stuffed in a buffer of 181 samples and
+ * every output is the inner product of the 161 taps with the buffer
+ */
+class zero_stuffed_tx
+{
+public:
+    static constexpr size_t N = 20;
+
+    zero_stuffed_tx(const vector<float> &symbols): symbols(symbols), bb_samples(0), sym_idx(0), filt_offset(0)
+    {
+        filt_buff.fill(0.0f);
+        filt_buff[0] = symbols.at(sym_idx++);
+    }
+
+    vector<float> get_baseband_samples(size_t n)
+    {
+        const array<float, 161> &taps = tx_packet::rrc_taps();
+        vector<float> baseband;
+        baseband.reserve(n);
+
+        for(size_t i = 0; i < n; i++)
+        {
+            float out = inner_product(taps.begin(), taps.end(), filt_buff.begin() + filt_offset, 0.0f);
+
+            if(filt_offset == 0)
+            {
+                for(size_t j = 180; j >= N; j -= N)
+                    filt_buff[j] = filt_buff[j-N];
+
+                if(sym_idx >= symbols.size() && sym_idx < symbols.size()+(taps.size()/N))
+                {
+                    filt_buff[0] = 0;
+                    sym_idx++;
+                }
+                else if(sym_idx >= symbols.size()+(taps.size()/N))
+                {
+                    break;
+                }
+                else
+                {
+                    filt_buff[0] = symbols.at(sym_idx++);
+                }
+
+                filt_offset = N-1;
+            }
+            else
+            {
+                filt_offset--;
+            }
+            baseband.push_back(out);
+
+            bb_samples++;
+            if(bb_samples >= (symbols.size() * N)+taps.size()/2)
+                break;
+        }
+
+        return baseband;
+    }
+
+private:
+    vector<float> symbols;
+    size_t bb_samples;
+    size_t sym_idx;
+    array<float, 181> filt_buff;
+    size_t filt_offset;
+};
+
+int main(int argc, char *argv[])
+{
+    if(argc >= 2 && strcmp(argv[1], "help") == 0)
+    {
+        cout << "Usage: " << argv[0] << " [packets]\n"
+             << "\tpackets             number of packets to interpolate (default 100)."
+             << endl;
+        return EXIT_SUCCESS;
+    }
+
+    size_t nb_packets = (argc >= 2) ? strtoul(argv[1], nullptr, 10) : 100;
+
+    mt19937 rng(1);
+    size_t samples = 0, mismatches = 0;
+    double polyphase_time = 0.0, zero_stuffed_time = 0.0;
+    for(size_t p = 0; p < nb_packets; p++)
+    {
+        shared_ptr<vector<uint8_t>> ip_pkt = make_shared<vector<uint8_t>>(1 + rng() % 800);
+        for(auto &b : *ip_pkt)
+            b = rng();
+
+        // Blocks of the radio thread, and odd sizes to cut the symbol periods anywhere
+        const size_t block_sizes[] = {128, 37, 1000};
+        size_t block_size = block_sizes[p % 3];
+
+        tx_packet tx("ON4MOD-1", "ON4MOD-2", ip_pkt);
+        zero_stuffed_tx reference(tx.get_symbols());
+
+        vector<float> polyphase, zero_stuffed;
+        auto start = chrono::steady_clock::now();
+        while(tx.baseband_samples_left() > 0)
+        {
+            vector<float> block = tx.get_baseband_samples(block_size);
+            polyphase.insert(polyphase.end(), block.begin(), block.end());
+        }
+        polyphase_time += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        start = chrono::steady_clock::now();
+        while(zero_stuffed.size() < polyphase.size())
+        {
+            vector<float> block = reference.get_baseband_samples(block_size);
+            if(block.empty())
+                break;
+            zero_stuffed.insert(zero_stuffed.end(), block.begin(), block.end());
+        }
+        zero_stuffed_time += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        samples += polyphase.size();
+        if(polyphase.size() != zero_stuffed.size()
+           || memcmp(polyphase.data(), zero_stuffed.data(), polyphase.size()*sizeof(float)) != 0)
+            mismatches++;
+    }
+
+    cout << "Packets: " << nb_packets << ", " << samples << " samples, " << mismatches
+         << " packets differing from the zero-stuffed filter" << endl
+         << fixed << setprecision(2)
+         << "Zero-stuffed filter: " << 1e9*zero_stuffed_time/samples << " ns/sample" << endl
+         << "Polyphase filter:    " << 1e9*polyphase_time/samples << " ns/sample, "
+         << zero_stuffed_time/polyphase_time << "x faster" << defaultfloat << endl;
+
+    return (mismatches == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
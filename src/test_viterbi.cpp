@@ -0,0 +1,164 @@
+/****************************************************************************
+ * M17Netd                                                                  *
+ * Copyright (C) 2024 by Morgan Diepart ON4MOD                              *
+ *                       SDR-Engineering SRL                                *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU Affero General Public License as published *
+ * by the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU Affero General Public License for more details.                      *
+ *                                                                          *
+ * You should have received a copy of the GNU Affero General Public License *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    *
+ ****************************************************************************/
+
+
+#include <vector>
+#include <array>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <m17.h>
+
+#include "viterbi.h"
+
+using namespace std;
+
+constexpr size_t frame_bits = 2*SYM_PER_PLD;    /** Soft bits in a frame payload */
+
+/**
+ * Encodes bits with the M17 convolutional code and punctures them, as done on the air
+ *
+ * @param bits bits to encode, the 4 flushing bits are appended
+ *
+ * @return the encoded bits, frame_bits long
+ */
+vector<uint8_t> encode(const vector<uint8_t> &bits, const uint8_t *punct, size_t p_len)
+{
+    vector<uint8_t> encoded;
+    unsigned state = 0;
+    size_t p = 0;
+    for(size_t i = 0; i < bits.size() + 4; i++)
+    {
+        unsigned reg = ((i < bits.size() ? bits[i] : 0) << 4) | state;
+        for(unsigned poly : {0x19, 0x17})
+        {
+            if(punct[p] && encoded.size() < frame_bits)
+                encoded.push_back(__builtin_parity(reg & poly));
+            p = (p + 1) % p_len;
+        }
+        state = reg >> 1;
+    }
+
+    return encoded;
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc >= 2 && strcmp(argv[1], "help") == 0)
+    {
+        cout << "Usage: " << argv[0] << " [frames]\n"
+             << "\tframes              number of frames decoded per pattern and input (default 20000)."
+             << endl;
+        return EXIT_SUCCESS;
+    }
+
+    size_t frames = (argc >= 2) ? strtoul(argv[1], nullptr, 10) : 20000;
+
+    struct pattern_t
+    {
+        const char *name;
+        const uint8_t *punct;
+        size_t p_len;
+        size_t nb_bits;     // Decoded bits, without the flushing bits
+    };
+
+    const pattern_t patterns[] =
+    {
+        {"P1 (LSF)",  puncture_pattern_1, sizeof(puncture_pattern_1), 240},
+        {"P2 (BERT)", puncture_pattern_2, sizeof(puncture_pattern_2), 197},
+        {"P3 (PKT)",  puncture_pattern_3, sizeof(puncture_pattern_3), 206},
+    };
+
+    // Random soft bits, encoded frames with gaussian noise and encoded frames without any error
+    const char *inputs[] = {"random", "noisy", "hard"};
+
+    mt19937 rng(1);
+    normal_distribution<float> awgn(0.0f, 0.3f);
+    bool failed = false;
+    for(const auto &pat : patterns)
+    {
+        for(size_t input = 0; input < 3; input++)
+        {
+            vector<array<uint16_t, frame_bits>> soft(frames);
+            for(auto &frame : soft)
+            {
+                if(input == 0)
+                {
+                    for(auto &s : frame)
+                        s = rng();
+                    continue;
+                }
+
+                vector<uint8_t> bits(pat.nb_bits);
+                for(auto &b : bits)
+                    b = rng() & 1;
+
+                vector<uint8_t> encoded = encode(bits, pat.punct, pat.p_len);
+                for(size_t i = 0; i < frame_bits; i++)
+                {
+                    float s = encoded[i] + ((input == 1) ? awgn(rng) : 0.0f);
+                    frame[i] = static_cast<uint16_t>(clamp(s, 0.0f, 1.0f)*0xFFFF);
+                }
+            }
+
+            // libm17 pairs an odd last depunctured soft bit (BERT frames) with a leftover of its buffer, the costs
+            // can differ by its distance
+            size_t depunctured = 0;
+            for(size_t n = 0; n < frame_bits; depunctured++)
+                n += pat.punct[depunctured % pat.p_len];
+            bool same_cost = (depunctured % 2 == 0);
+
+            // Same decoded bits and costs
+            size_t mismatches = 0;
+            for(const auto &frame : soft)
+            {
+                array<uint8_t, 32> ref = {}, out = {};
+                uint32_t ref_cost = viterbi_decode_punctured(ref.data(), frame.data(), pat.punct, frame_bits, pat.p_len);
+                uint32_t cost = viterbi::decode_punctured(out.data(), frame.data(), pat.punct, frame_bits, pat.p_len);
+
+                if(ref != out || (same_cost && ref_cost != cost))
+                    mismatches++;
+            }
+
+            auto start = chrono::steady_clock::now();
+            volatile uint32_t sink = 0;
+            array<uint8_t, 32> out;
+            for(const auto &frame : soft)
+                sink = viterbi_decode_punctured(out.data(), frame.data(), pat.punct, frame_bits, pat.p_len);
+            double ref_time = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+            start = chrono::steady_clock::now();
+            for(const auto &frame : soft)
+                sink = viterbi::decode_punctured(out.data(), frame.data(), pat.punct, frame_bits, pat.p_len);
+            double time = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            (void)sink;
+
+            failed |= (mismatches != 0);
+            cout << left << setw(10) << pat.name << " " << setw(7) << inputs[input] << right << ": " << mismatches << "/"
+                 << frames << " mismatches" << (same_cost ? "" : " (bits only)") << ", libm17 " << fixed << setprecision(2) << 1e6*ref_time/frames
+                 << " us/frame, in-tree " << 1e6*time/frames << " us/frame (x" << ref_time/time << ")"
+                 << defaultfloat << endl;
+        }
+    }
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
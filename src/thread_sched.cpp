@@ -0,0 +1,172 @@
+/****************************************************************************
+ * M17Netd                                                                  *
+ * Copyright (C) 2024 by Morgan Diepart ON4MOD                              *
+ *                       SDR-Engineering SRL                                *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU Affero General Public License as published *
+ * by the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU Affero General Public License for more details.                      *
+ *                                                                          *
+ * You should have received a copy of the GNU Affero General Public License *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    *
+ ****************************************************************************/
+
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "thread_sched.h"
+
+using namespace std;
+
+int lock_memory()
+{
+    if(mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+    {
+        cerr << "Could not lock memory (" << strerror(errno) << "). Page faults may delay the threads." << endl;
+        return EXIT_FAILURE;
+    }
+
+    cout << "Memory locked." << endl;
+    return EXIT_SUCCESS;
+}
+
+int set_thread_sched(pthread_t handle, const string_view &name, const thread_cfg &cfg)
+{
+    int ret = EXIT_SUCCESS;
+    int err;
+
+    // Thread names are limited to 15 characters
+    err = pthread_setname_np(handle, string(name.substr(0, 15)).c_str());
+    if(err != 0)
+    {
+        cerr << "Could not name the " << name << " thread (" << strerror(err) << ")." << endl;
+    }
+
+    if(!cfg.cpus.empty())
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        for(auto c : cfg.cpus)
+        {
+            CPU_SET(c, &cpus);
+        }
+
+        err = pthread_setaffinity_np(handle, sizeof(cpu_set_t), &cpus);
+        if(err != 0)
+        {
+            cerr << "Could not set the CPU affinity of the " << name << " thread (" << strerror(err) << ")." << endl;
+            ret = EXIT_FAILURE;
+        }
+    }
+
+    if(cfg.fifo)
+    {
+        struct sched_param param = {};
+        param.sched_priority = cfg.priority;
+
+        err = pthread_setschedparam(handle, SCHED_FIFO, &param);
+        if(err != 0)
+        {
+            cerr << "Could not set SCHED_FIFO priority " << cfg.priority << " for the " << name << " thread (" << strerror(err)
+                 << "). Run as root or grant CAP_SYS_NICE." << endl;
+            ret = EXIT_FAILURE;
+        }
+    }
+    else
+    {
+        // The thread may have inherited a real-time policy from the thread that created it
+        struct sched_param param = {};
+
+        err = pthread_setschedparam(handle, SCHED_OTHER, &param);
+        if(err != 0)
+        {
+            cerr << "Could not set SCHED_OTHER for the " << name << " thread (" << strerror(err) << ")." << endl;
+            ret = EXIT_FAILURE;
+        }
+    }
+
+    return ret;
+}
+
+int set_thread_sched(thread &t, const string_view &name, const thread_cfg &cfg)
+{
+    return set_thread_sched(t.native_handle(), name, cfg);
+}
+
+int set_thread_sched(const string_view &name, const thread_cfg &cfg)
+{
+    return set_thread_sched(pthread_self(), name, cfg);
+}
+
+void print_thread_sched(pthread_t handle, const string_view &name)
+{
+    int policy;
+    struct sched_param param;
+
+    cout << "Thread " << name << ": ";
+
+    int err = pthread_getschedparam(handle, &policy, &param);
+    if(err != 0)
+    {
+        cout << "unknown policy (" << strerror(err) << ")";
+    }
+    else
+    {
+        switch(policy)
+        {
+            case SCHED_FIFO:
+                cout << "SCHED_FIFO, priority " << param.sched_priority;
+                break;
+            case SCHED_RR:
+                cout << "SCHED_RR, priority " << param.sched_priority;
+                break;
+            case SCHED_OTHER:
+                cout << "SCHED_OTHER";
+                break;
+            default:
+                cout << "policy " << policy;
+        }
+    }
+
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    err = pthread_getaffinity_np(handle, sizeof(cpu_set_t), &cpus);
+    if(err != 0)
+    {
+        cout << ", unknown CPU set (" << strerror(err) << ")";
+    }
+    else
+    {
+        cout << ", CPUs";
+        for(int c = 0; c < CPU_SETSIZE; c++)
+        {
+            if(CPU_ISSET(c, &cpus))
+                cout << " " << c;
+        }
+    }
+
+    cout << endl;
+}
+
+void print_thread_sched(thread &t, const string_view &name)
+{
+    print_thread_sched(t.native_handle(), name);
+}
+
+void print_thread_sched(const string_view &name)
+{
+    print_thread_sched(pthread_self(), name);
+}
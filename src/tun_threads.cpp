@@ -30,46 +30,24 @@
 #include <linux/if_tun.h>
 #include <netinet/ip.h>
 #include <unistd.h>
-#include <sys/eventfd.h>
 
 #include "tun_threads.h"
 #include "tuntap.h"
-#include "ConsumerProducer.h"
+#include "SPSCQueue.h"
 #include "config.h"
+#include "thread_sched.h"
 
 #include "m17.h"
 
 using namespace std;
 
-void to_net_monitor(atomic_bool &running, ConsumerProducerQueue<shared_ptr<m17rx>> &to_net, int event_fd)
+void tun_thread::operator()(atomic_bool &running, const config &cfg, const threads_cfg &threads,
+                                 SPSCQueue<shared_ptr<vector<uint8_t>>> &from_net,
+                                 SPSCQueue<shared_ptr<m17rx>> &to_net)
 {
-    std::chrono::milliseconds timeout(1000);
-    uint64_t write_val = 1;
+    set_thread_sched("tun", threads.tun);
+    print_thread_sched("tun");
 
-    while(running)
-    {
-        if(to_net.wait_for_non_empty(timeout))
-        {
-            ssize_t ret = write(event_fd, &write_val, 8);
-            if(ret < 0)
-            {
-                cout << "write() error: returned " << errno << "(" << strerror(errno) << ")" << endl;
-            }
-
-            while(!to_net.isEmpty())
-            {
-                usleep(100);
-            }
-        }
-    }
-}
-
-
-
-void tun_thread::operator()(atomic_bool &running, const config &cfg,
-                                 ConsumerProducerQueue<shared_ptr<vector<uint8_t>>> &from_net,
-                                 ConsumerProducerQueue<shared_ptr<m17rx>> &to_net)
-{
     tunthread_cfg if_cfg;
     cfg.getTunConfig(if_cfg);
     std::string_view radio_callsign = cfg.getCallsign();
@@ -101,17 +79,22 @@ void tun_thread::operator()(atomic_bool &running, const config &cfg,
     }
 
     std::shared_ptr<std::vector<uint8_t>> from_net_packet;
-    std::shared_ptr<m17rx> to_net_packet;
+    std::vector<std::shared_ptr<m17rx>> to_net_packets;
+    to_net_packets.reserve(16);
 
     struct timespec read_timeout = {.tv_sec = 1, .tv_nsec = 0}; // 1 sec timeout
     fd_set read_fdset;
 
     int tun_fd = interface.get_tun_fd();
-    int data_avail_fd = eventfd(0, EFD_NONBLOCK);
-    int nfds = max(tun_fd, data_avail_fd) + 1;
 
-    // Start to_net monitoring thread
-    std::thread monitoring_thread = std::thread(to_net_monitor, std::ref(running), std::ref(to_net), data_avail_fd);
+    // The to_net queue signals this eventfd when it receives data
+    int data_avail_fd = to_net.get_eventfd();
+    if(data_avail_fd < 0)
+    {
+        std::cerr << "Tun thread: the to_net queue has no eventfd attached." << std::endl;
+        return;
+    }
+    int nfds = max(tun_fd, data_avail_fd) + 1;
 
     // Thread loop
     while( running )
@@ -155,51 +138,54 @@ void tun_thread::operator()(atomic_bool &running, const config &cfg,
 
             if(FD_ISSET(data_avail_fd, &read_fdset))
             {
-                // Data can be read from to_net queue
+                // Clear data_avail_fd eventfd before draining so that
+                // packets added from now on signal it again
+                to_net.clear_eventfd();
+
+                // Data can be read from to_net queue, fetch whole bursts at once
                 while(!to_net.isEmpty())
                 {
-                    to_net.consume(to_net_packet);
+                    to_net.consume_all(to_net_packets);
 
-                    if(!to_net_packet->is_valid())
+                    for(auto &to_net_packet : to_net_packets)
                     {
-                        continue;
-                    }
-
-                    // check if the dst callsign matches our callsign
-                    array<uint8_t, 30> lsf = to_net_packet->get_lsf();
-                    lsf_t *m17_lsf = reinterpret_cast<lsf_t *>(&lsf);
-                    char dst_call[10];
+                        if(!to_net_packet->is_valid())
+                        {
+                            continue;
+                        }
 
-                    decode_callsign_bytes(dst_call, m17_lsf->dst);
-                    if(radio_callsign == dst_call)
-                    {
-                        // Check if payload is intact
-                        vector<uint8_t> payload = to_net_packet->get_payload();
+                        // check if the dst callsign matches our callsign
+                        array<uint8_t, 30> lsf = to_net_packet->get_lsf();
+                        lsf_t *m17_lsf = reinterpret_cast<lsf_t *>(&lsf);
+                        char dst_call[10];
 
-                        // Check if payload is at least 1 byte + specifier + CRC (4 bytes total)
-                        // Check if the specifier corresponds to IPV4
-                        if(payload.size() >= 4 && payload[0] == 0x04)
+                        decode_callsign_bytes(dst_call, m17_lsf->dst);
+                        if(radio_callsign == dst_call)
                         {
-                            if(CRC_M17(payload.data()+1, payload.size()-1) == 0)
-                            {
-                                payload.erase(payload.cbegin()); // Remove type specifier
-                                payload.erase(payload.cend() - 2, payload.cend()); // Remove CRC
-                                interface.send_packet(payload); // Send packet
-                            }
-                            else
+                            // Check if payload is intact, it is read in the packet without being copied
+                            byte_span payload = to_net_packet->payload();
+
+                            // Check if payload is at least 1 byte + specifier + CRC (4 bytes total)
+                            // Check if the specifier corresponds to IPV4
+                            if(payload.size() >= 4 && payload[0] == 0x04)
                             {
-                                cerr << "The CRC check of the payload failed" << endl;
+                                if(CRC_M17(payload.data()+1, payload.size()-1) == 0)
+                                {
+                                    // Send the packet without the type specifier and the CRC
+                                    interface.send_packet(payload.data()+1, payload.size()-3);
+                                }
+                                else
+                                {
+                                    cerr << "The CRC check of the payload failed" << endl;
+                                }
                             }
                         }
                     }
-                }
 
-                // Clear data_avail_fd eventfd
-                uint64_t tmp;
-                read(data_avail_fd, &tmp, 8);
+                    // The packets go back to their pool once dropped
+                    to_net_packets.clear();
+                }
             }
         }
     }
-
-    monitoring_thread.join();
 }
\ No newline at end of file
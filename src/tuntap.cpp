@@ -128,11 +128,16 @@ std::shared_ptr<std::vector<uint8_t>> tun_device::get_packet()
 
 int tun_device::send_packet(const std::vector<uint8_t> &pkt)
 {
-    int written = pwrite(tun_fd, pkt.data(), pkt.size(), 0);
+    return send_packet(pkt.data(), pkt.size());
+}
+
+int tun_device::send_packet(const uint8_t *pkt, size_t len)
+{
+    int written = pwrite(tun_fd, pkt, len, 0);
 
     if(written < 0)
         return -1;
-    else if(static_cast<size_t>(written) != pkt.size())
+    else if(static_cast<size_t>(written) != len)
         return -1;
 
     return 0;
@@ -0,0 +1,216 @@
+/****************************************************************************
+ * M17Netd                                                                  *
+ * Copyright (C) 2024 by Morgan Diepart ON4MOD                              *
+ *                       SDR-Engineering SRL                                *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU Affero General Public License as published *
+ * by the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU Affero General Public License for more details.                      *
+ *                                                                          *
+ * You should have received a copy of the GNU Affero General Public License *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    *
+ ****************************************************************************/
+
+#include <iostream>
+
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "tx_scheduler.h"
+
+using namespace std;
+
+tx_classifier::tx_classifier(const txsched_cfg &cfg): small_tcp_len(cfg.small_tcp_len)
+{
+    dscp_class.fill(tx_class::NORMAL);
+
+    for(auto d : cfg.bulk_dscp)
+    {
+        dscp_class[d & 0x3F] = tx_class::BULK;
+    }
+
+    for(auto d : cfg.interactive_dscp)
+    {
+        dscp_class[d & 0x3F] = tx_class::INTERACTIVE;
+    }
+}
+
+tx_class tx_classifier::classify(const struct ip *pkt, size_t len) const
+{
+    if(len < sizeof(struct ip))
+        return tx_class::NORMAL;
+
+    // Explicit marking by the sender takes precedence
+    tx_class cls = dscp_class[pkt->ip_tos >> 2];
+    if(cls != tx_class::NORMAL)
+        return cls;
+
+    if(pkt->ip_p == IPPROTO_ICMP)
+        return tx_class::INTERACTIVE;
+
+    if(pkt->ip_p == IPPROTO_TCP)
+    {
+        size_t ip_len = ntohs(pkt->ip_len);
+        size_t hdr_len = pkt->ip_hl * 4;
+
+        // Small segments: pure ACKs and interactive sessions keystrokes
+        if(ip_len <= small_tcp_len)
+            return tx_class::INTERACTIVE;
+
+        // Connection setup and teardown
+        if(len >= hdr_len + sizeof(struct tcphdr))
+        {
+            const struct tcphdr *tcp = reinterpret_cast<const struct tcphdr *>(reinterpret_cast<const uint8_t *>(pkt) + hdr_len);
+            if(tcp->syn || tcp->fin || tcp->rst)
+                return tx_class::INTERACTIVE;
+        }
+    }
+
+    return tx_class::NORMAL;
+}
+
+tx_scheduler::tx_scheduler(size_t maxSize, const txsched_cfg &cfg, const aqm_cfg &aqm, const string_view &src_callsign):
+                           ingress("to_radio", maxSize), src_callsign(src_callsign), weighted(cfg.weighted), current(0),
+                           sched_cfg(cfg)
+{
+    for(size_t i = 0; i < nb_classes; i++)
+    {
+        weights[i] = (cfg.weights[i] > 0) ? cfg.weights[i] : 1;
+        classes.emplace_back(maxSize, aqm);
+    }
+
+    credits = weights;
+    stats.sent.fill(0);
+    stats.dropped.fill(0);
+    stats.aqm_dropped.fill(0);
+    stats.aqm_marked.fill(0);
+}
+
+int tx_scheduler::add(shared_ptr<vector<uint8_t>> ip_pkt, const string &dst, tx_class cls)
+{
+    int ret = ingress.add({{ip_pkt, dst, chrono::steady_clock::now()}, cls});
+
+    return (ret < 0) ? -1 : 0;
+}
+
+void tx_scheduler::pull()
+{
+    entry_t e;
+    while(ingress.try_consume(e) >= 0)
+    {
+        classes[static_cast<size_t>(e.cls)].enqueue(std::move(e.pkt));
+    }
+}
+
+bool tx_scheduler::encode(size_t c, shared_ptr<m17tx_pkt> &pkt, chrono::steady_clock::time_point now)
+{
+    fq_entry e;
+    while(classes[c].dequeue(e, now))
+    {
+        try
+        {
+            pkt = make_shared<m17tx_pkt>(src_callsign, e.dst, e.ip_pkt);
+            return true;
+        }
+        catch(const exception &ex)
+        {
+            cerr << "Could not encode packet for " << e.dst << " (" << ex.what() << "), dropping it." << endl;
+        }
+    }
+
+    return false;
+}
+
+int tx_scheduler::consume(shared_ptr<m17tx_pkt> &pkt)
+{
+    pull();
+
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    int ret = -1;
+
+    if(!weighted)
+    {
+        // Strict priority: serve the highest non-empty class
+        for(size_t c = 0; c < nb_classes && ret < 0; c++)
+        {
+            if(encode(c, pkt, now))
+                ret = c;
+        }
+    }
+    else
+    {
+        // Weighted round-robin: each class sends up to its weight in packets per
+        // round. A class that is empty or out of credits passes its turn and gets
+        // its credits back for the next round. Two rounds visit every class with credits.
+        for(size_t i = 0; i < 2*nb_classes; i++)
+        {
+            size_t c = current;
+            if(!classes[c].empty() && credits[c] > 0 && encode(c, pkt, now))
+            {
+                credits[c]--;
+                ret = c;
+                break;
+            }
+
+            credits[c] = weights[c];
+            current = (current + 1) % nb_classes;
+        }
+    }
+
+    if(ret >= 0)
+        stats.sent[ret]++;
+
+    return ret;
+}
+
+bool tx_scheduler::isEmpty()
+{
+    pull();
+
+    for(const auto &c : classes)
+    {
+        if(!c.empty())
+            return false;
+    }
+
+    return true;
+}
+
+size_t tx_scheduler::length()
+{
+    pull();
+
+    size_t len = 0;
+    for(const auto &c : classes)
+    {
+        len += c.length();
+    }
+
+    return len;
+}
+
+const tx_scheduler::stats_t& tx_scheduler::get_stats()
+{
+    for(size_t c = 0; c < nb_classes; c++)
+    {
+        const fq_codel::stats_t &s = classes[c].get_stats();
+        stats.dropped[c] = s.overlimit;
+        stats.aqm_dropped[c] = s.dropped;
+        stats.aqm_marked[c] = s.marked;
+    }
+
+    return stats;
+}
+
+const txsched_cfg& tx_scheduler::get_config() const
+{
+    return sched_cfg;
+}
@@ -0,0 +1,228 @@
+/****************************************************************************
+ * M17Netd                                                                  *
+ * Copyright (C) 2024 by Morgan Diepart ON4MOD                              *
+ *                       SDR-Engineering SRL                                *
+ *                                                                          *
+ * This program is free software: you can redistribute it and/or modify     *
+ * it under the terms of the GNU Affero General Public License as published *
+ * by the Free Software Foundation, either version 3 of the License, or     *
+ * (at your option) any later version.                                      *
+ *                                                                          *
+ * This program is distributed in the hope that it will be useful,          *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of           *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the            *
+ * GNU Affero General Public License for more details.                      *
+ *                                                                          *
+ * You should have received a copy of the GNU Affero General Public License *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.    *
+ ****************************************************************************/
+
+#include <array>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "viterbi.h"
+
+using namespace std;
+
+namespace
+{
+
+constexpr size_t   nb_states  = 16;
+constexpr uint32_t max_metric = 0x1FFFE;    /** Distance between two soft bits and their complement */
+constexpr uint16_t erasure    = 0x7FFF;
+
+/**
+ * One step of the trellis: new state 2i+b comes from state i or i+8, the decision bit 2i+b is set when it comes from
+ * i+8. Butterfly i re-encodes to COST_TABLE_0[i], COST_TABLE_1[i] of libm17 from state i, to their complement from
+ * state i+8: {0, 0, 0, 0, 1, 1, 1, 1} and {0, 1, 1, 0, 0, 1, 1, 0}. Its branch metric is then one of
+ * a = s0 + s1, b = s0 + ~s1, c = ~s0 + s1 and d = ~s0 + ~s1, in the order a b b a c d d c.
+ *
+ * On ties the path from state i+8 is kept, as libm17 does.
+ *
+ * @param prev metrics before the step
+ * @param next metrics after the step
+ *
+ * @return the 16 decision bits
+ */
+inline uint16_t step(const uint32_t *prev, uint32_t *next, uint16_t s0, uint16_t s1)
+{
+    const uint32_t a = static_cast<uint32_t>(s0) + s1;
+    const uint32_t b = static_cast<uint32_t>(s0) + (0xFFFF - s1);
+    const uint32_t c = static_cast<uint32_t>(0xFFFF - s0) + s1;
+    const uint32_t d = max_metric - a;
+
+#if defined(__aarch64__)
+    const uint32x4_t weights = {1, 2, 4, 8};
+    const uint32x4_t full = vdupq_n_u32(max_metric);
+    const uint32_t lo[4] = {a, b, b, a}, hi[4] = {c, d, d, c};
+    uint32_t bits = 0;
+
+    for(size_t h = 0; h < 2; h++)
+    {
+        uint32x4_t m = vld1q_u32(h ? hi : lo);
+        uint32x4_t n = vsubq_u32(full, m);
+        uint32x4_t pa = vld1q_u32(prev + 4*h);
+        uint32x4_t pb = vld1q_u32(prev + 8 + 4*h);
+
+        uint32x4_t m0 = vaddq_u32(pa, m), m1 = vaddq_u32(pb, n);
+        uint32x4_t m2 = vaddq_u32(pa, n), m3 = vaddq_u32(pb, m);
+
+        uint32x4x2_t metrics = vzipq_u32(vminq_u32(m0, m1), vminq_u32(m2, m3));
+        uint32x4x2_t decisions = vzipq_u32(vcgeq_u32(m0, m1), vcgeq_u32(m2, m3));
+        vst1q_u32(next + 8*h, metrics.val[0]);
+        vst1q_u32(next + 8*h + 4, metrics.val[1]);
+
+        bits |= vaddvq_u32(vandq_u32(decisions.val[0], weights)) << (8*h);
+        bits |= vaddvq_u32(vandq_u32(decisions.val[1], weights)) << (8*h + 4);
+    }
+
+    return static_cast<uint16_t>(bits);
+#elif defined(__AVX2__)
+    // The metrics stay below 2^31, the signed comparisons are exact
+    const __m256i m = _mm256_setr_epi32(a, b, b, a, c, d, d, c);
+    const __m256i n = _mm256_sub_epi32(_mm256_set1_epi32(max_metric), m);
+    const __m256i pa = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(prev));
+    const __m256i pb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(prev + 8));
+
+    __m256i m0 = _mm256_add_epi32(pa, m), m1 = _mm256_add_epi32(pb, n);
+    __m256i m2 = _mm256_add_epi32(pa, n), m3 = _mm256_add_epi32(pb, m);
+
+    // lt: the path from state i is strictly better
+    __m256i lt_even = _mm256_cmpgt_epi32(m1, m0);
+    __m256i lt_odd = _mm256_cmpgt_epi32(m3, m2);
+    __m256i even = _mm256_blendv_epi8(m1, m0, lt_even);
+    __m256i odd = _mm256_blendv_epi8(m3, m2, lt_odd);
+
+    // Interleave the even and odd states, the unpacks work within 128 bits lanes
+    __m256i lo = _mm256_unpacklo_epi32(even, odd);
+    __m256i hi = _mm256_unpackhi_epi32(even, odd);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(next), _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(next + 8), _mm256_permute2x128_si256(lo, hi, 0x31));
+
+    lo = _mm256_unpacklo_epi32(lt_even, lt_odd);
+    hi = _mm256_unpackhi_epi32(lt_even, lt_odd);
+    uint32_t lt = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_permute2x128_si256(lo, hi, 0x20)))
+                | (_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_permute2x128_si256(lo, hi, 0x31))) << 8);
+
+    return static_cast<uint16_t>(~lt);
+#elif defined(__SSE2__)
+    // The metrics stay below 2^31, the signed comparisons are exact
+    const __m128i full = _mm_set1_epi32(max_metric);
+    uint32_t lt = 0;
+
+    for(size_t h = 0; h < 2; h++)
+    {
+        __m128i m = h ? _mm_setr_epi32(c, d, d, c) : _mm_setr_epi32(a, b, b, a);
+        __m128i n = _mm_sub_epi32(full, m);
+        __m128i pa = _mm_loadu_si128(reinterpret_cast<const __m128i *>(prev + 4*h));
+        __m128i pb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(prev + 8 + 4*h));
+
+        __m128i m0 = _mm_add_epi32(pa, m), m1 = _mm_add_epi32(pb, n);
+        __m128i m2 = _mm_add_epi32(pa, n), m3 = _mm_add_epi32(pb, m);
+
+        // lt: the path from state i is strictly better
+        __m128i lt_even = _mm_cmpgt_epi32(m1, m0);
+        __m128i lt_odd = _mm_cmpgt_epi32(m3, m2);
+        __m128i even = _mm_or_si128(_mm_and_si128(lt_even, m0), _mm_andnot_si128(lt_even, m1));
+        __m128i odd = _mm_or_si128(_mm_and_si128(lt_odd, m2), _mm_andnot_si128(lt_odd, m3));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(next + 8*h), _mm_unpacklo_epi32(even, odd));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(next + 8*h + 4), _mm_unpackhi_epi32(even, odd));
+
+        lt |= _mm_movemask_ps(_mm_castsi128_ps(_mm_unpacklo_epi32(lt_even, lt_odd))) << (8*h);
+        lt |= _mm_movemask_ps(_mm_castsi128_ps(_mm_unpackhi_epi32(lt_even, lt_odd))) << (8*h + 4);
+    }
+
+    return static_cast<uint16_t>(~lt);
+#else
+    const uint32_t metric[8] = {a, b, b, a, c, d, d, c};
+    uint16_t bits = 0;
+
+    for(size_t i = 0; i < nb_states/2; i++)
+    {
+        uint32_t m0 = prev[i] + metric[i];
+        uint32_t m1 = prev[i + nb_states/2] + (max_metric - metric[i]);
+        uint32_t m2 = prev[i] + (max_metric - metric[i]);
+        uint32_t m3 = prev[i + nb_states/2] + metric[i];
+
+        next[2*i] = (m0 >= m1) ? m1 : m0;
+        next[2*i+1] = (m2 >= m3) ? m3 : m2;
+        bits |= (m0 >= m1) << (2*i);
+        bits |= (m2 >= m3) << (2*i + 1);
+    }
+
+    return bits;
+#endif
+}
+
+}
+
+namespace viterbi
+{
+
+uint32_t decode(uint8_t *out, const uint16_t *in, size_t len)
+{
+    len = min(len, 2*max_steps);
+
+    alignas(32) array<uint32_t, nb_states> metrics_a = {};
+    alignas(32) array<uint32_t, nb_states> metrics_b = {};
+    array<uint16_t, max_steps> history;
+    uint32_t *prev = metrics_a.data();
+    uint32_t *next = metrics_b.data();
+
+    // All the states start with a null metric, as in libm17
+    size_t steps = (len + 1)/2;
+    for(size_t pos = 0; pos < steps; pos++)
+    {
+        uint16_t s0 = in[2*pos];
+        uint16_t s1 = (2*pos + 1 < len) ? in[2*pos + 1] : erasure;
+
+        history[pos] = step(prev, next, s0, s1);
+        swap(prev, next);
+    }
+
+    // Chainback from state 0, the decoded bit of a step is the one leaving the state
+    size_t nb_bits = len/2;
+    memset(out, 0, (nb_bits + 3)/8 + 1);
+
+    uint8_t state = 0;
+    size_t bit_pos = nb_bits + 4;
+    for(size_t pos = steps; pos > 0; pos--)
+    {
+        bit_pos--;
+        bool bit = (history[pos-1] >> (state >> 4)) & 1;
+        state >>= 1;
+        if(bit)
+        {
+            state |= 0x80;
+            out[bit_pos/8] |= 1 << (7 - (bit_pos%8));
+        }
+    }
+
+    return *min_element(prev, prev + nb_states);
+}
+
+uint32_t decode_punctured(uint8_t *out, const uint16_t *in, const uint8_t *punct, size_t in_len, size_t p_len)
+{
+    array<uint16_t, 2*max_steps> depunctured;
+
+    size_t u = 0, p = 0;
+    for(size_t i = 0; i < in_len && u < depunctured.size(); u++)
+    {
+        depunctured[u] = punct[p] ? in[i++] : erasure;
+        p = (p + 1 < p_len) ? p + 1 : 0;
+    }
+
+    return decode(out, depunctured.data(), u) - (u - in_len)*erasure;
+}
+
+}